@@ -5,12 +5,43 @@
 
 #include "allocation-selector.h"
 
+#include <linux/atomic.h>
+#include <linux/minmax.h>
+
 #include "memory-alloc.h"
 
+#include "block-allocator.h"
+#include "physical-zone.h"
+#include "slab-scrubber.h"
 #include "types.h"
 
 enum {
 	ALLOCATIONS_PER_ZONE = 128,
+	/* The number of allocations a stream makes from one zone */
+	ALLOCATIONS_PER_STREAM_ZONE = 1024,
+	/*
+	 * The distance, in blocks, a write may be from the next logical block
+	 * expected in a stream and still belong to the stream, to allow for
+	 * the reordering of the blocks of large bios
+	 */
+	STREAM_WINDOW = 32,
+	/*
+	 * The number of allocations which may be waiting on a zone's thread
+	 * before allocations are moved on to another zone early
+	 */
+	MAXIMUM_ZONE_BACKLOG = 2 * ALLOCATIONS_PER_ZONE,
+	/*
+	 * The number of free blocks below which a zone is only chosen if no
+	 * other zone has more space
+	 */
+	LOW_SPACE_BLOCKS = ALLOCATIONS_PER_ZONE,
+};
+
+/* How well a physical zone can take more allocations, best first. */
+enum zone_rank {
+	ZONE_READY,
+	ZONE_SCRUBBING,
+	ZONE_LOW_ON_SPACE,
 };
 
 /**
@@ -37,34 +68,198 @@ int vdo_make_allocation_selector(zone_count_t physical_zone_count,
 	*selector = (struct allocation_selector) {
 		.next_allocation_zone = thread_id % physical_zone_count,
 		.last_physical_zone = physical_zone_count - 1,
+		.thread_id = thread_id,
 	};
 
 	*selector_ptr = selector;
 	return VDO_SUCCESS;
 }
 
+/**
+ * get_zone_backlog() - Get the number of allocations waiting on the thread of
+ *                      a physical zone.
+ * @zone: The zone.
+ *
+ * Return: The backlog of the zone.
+ */
+static inline int get_zone_backlog(struct physical_zone *zone)
+{
+	return atomic_read(&zone->pending_allocations);
+}
+
+/**
+ * get_zone_rank() - Rank how well a physical zone can take more allocations.
+ * @zone: The zone.
+ *
+ * Return: The rank of the zone.
+ */
+static enum zone_rank get_zone_rank(struct physical_zone *zone)
+{
+	struct block_allocator *allocator = zone->allocator;
+
+	if (vdo_get_allocator_free_blocks(allocator) < LOW_SPACE_BLOCKS) {
+		return ZONE_LOW_ON_SPACE;
+	}
+
+	if (vdo_get_scrubber_slab_count(allocator->slab_scrubber) > 0) {
+		return ZONE_SCRUBBING;
+	}
+
+	return ZONE_READY;
+}
+
+/**
+ * select_zone() - Choose the next physical zone from which to allocate.
+ * @selector: The selector.
+ * @zones: The physical zones.
+ *
+ * The best ranked zone with the smallest backlog is chosen. Ties go to the
+ * first zone in round-robin order after the current one, so evenly loaded
+ * zones are still used in turn.
+ *
+ * Return: The number of the chosen zone.
+ */
+static zone_count_t select_zone(struct allocation_selector *selector,
+				struct physical_zones *zones)
+{
+	zone_count_t zone_count = selector->last_physical_zone + 1;
+	zone_count_t best = (selector->next_allocation_zone + 1) % zone_count;
+	enum zone_rank best_rank = get_zone_rank(&zones->zones[best]);
+	int best_backlog = get_zone_backlog(&zones->zones[best]);
+	zone_count_t i;
+
+	for (i = 2; i <= zone_count; i++) {
+		zone_count_t z = (selector->next_allocation_zone + i) % zone_count;
+		struct physical_zone *zone = &zones->zones[z];
+		enum zone_rank rank = get_zone_rank(zone);
+		int backlog = get_zone_backlog(zone);
+
+		if ((rank < best_rank) ||
+		    ((rank == best_rank) && (backlog < best_backlog))) {
+			best = z;
+			best_rank = rank;
+			best_backlog = backlog;
+		}
+	}
+
+	return best;
+}
+
 /**
  * vdo_get_next_allocation_zone() - Get number of the physical zone from
  *                                  which to allocate next.
  * @selector: The selector to query.
+ * @zones: The physical zones.
+ *
+ * Allocations stay in one zone for a while, but move on early if that zone
+ * has fallen behind. Each move chooses the zone best able to take more
+ * allocations, considering the backlog of its thread, its free space, and
+ * whether it is still scrubbing slabs. All of the state consulted is read
+ * without locking, so this is cheap enough to call for every allocation.
  *
  * Return: The number of the physical zone from which to allocate.
  */
-zone_count_t vdo_get_next_allocation_zone(struct allocation_selector *selector)
+zone_count_t vdo_get_next_allocation_zone(struct allocation_selector *selector,
+					  struct physical_zones *zones)
 {
 	if (selector->last_physical_zone > 0) {
-		if (selector->allocation_count < ALLOCATIONS_PER_ZONE) {
+		struct physical_zone *zone =
+			&zones->zones[selector->next_allocation_zone];
+
+		if ((selector->allocation_count < ALLOCATIONS_PER_ZONE) &&
+		    (get_zone_backlog(zone) <= MAXIMUM_ZONE_BACKLOG)) {
 			selector->allocation_count++;
 		} else {
 			selector->allocation_count = 1;
-			if (selector->next_allocation_zone <
-			    selector->last_physical_zone) {
-				selector->next_allocation_zone++;
-			} else {
-				selector->next_allocation_zone = 0;
-			}
+			selector->next_allocation_zone =
+				select_zone(selector, zones);
 		}
 	}
 
 	return selector->next_allocation_zone;
 }
+
+/**
+ * find_stream() - Find the stream to which a write belongs.
+ * @selector: The selector.
+ * @lbn: The logical block being written.
+ *
+ * Return: The stream, or NULL if the write does not continue any stream.
+ */
+static struct allocation_stream *
+find_stream(struct allocation_selector *selector, logical_block_number_t lbn)
+{
+	unsigned int i;
+
+	for (i = 0; i < VDO_ALLOCATION_STREAM_COUNT; i++) {
+		struct allocation_stream *stream = &selector->streams[i];
+
+		if ((stream->allocation_count > 0) &&
+		    (lbn + STREAM_WINDOW >= stream->next_lbn) &&
+		    (lbn <= stream->next_lbn + STREAM_WINDOW)) {
+			return stream;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * start_stream() - Replace the least recently used stream with a new one.
+ * @selector: The selector.
+ * @lbn: The logical block which starts the stream.
+ *
+ * Return: The new stream, which has not yet been assigned a zone.
+ */
+static struct allocation_stream *
+start_stream(struct allocation_selector *selector, logical_block_number_t lbn)
+{
+	struct allocation_stream *stream = &selector->streams[0];
+	unsigned int i;
+
+	for (i = 1; i < VDO_ALLOCATION_STREAM_COUNT; i++) {
+		if (selector->streams[i].last_used < stream->last_used) {
+			stream = &selector->streams[i];
+		}
+	}
+
+	stream->id = ((++selector->stream_count << 16) | selector->thread_id);
+	stream->next_lbn = lbn;
+	stream->allocation_count = ALLOCATIONS_PER_STREAM_ZONE;
+	return stream;
+}
+
+/**
+ * vdo_get_allocation_stream() - Get the stream to which a data block
+ *                               allocation for a write belongs.
+ * @selector: The selector to query.
+ * @zones: The physical zones.
+ * @lbn: The logical block being written.
+ *
+ * Return: The stream, whose zone is the physical zone from which to allocate.
+ */
+const struct allocation_stream *
+vdo_get_allocation_stream(struct allocation_selector *selector,
+			  struct physical_zones *zones,
+			  logical_block_number_t lbn)
+{
+	struct allocation_stream *stream = find_stream(selector, lbn);
+
+	if (stream == NULL) {
+		stream = start_stream(selector, lbn);
+	}
+
+	if ((stream->allocation_count >= ALLOCATIONS_PER_STREAM_ZONE) ||
+	    (get_zone_backlog(&zones->zones[stream->zone]) >
+	     MAXIMUM_ZONE_BACKLOG)) {
+		/* Move the stream on to the next zone. */
+		selector->allocation_count = ALLOCATIONS_PER_ZONE;
+		stream->zone = vdo_get_next_allocation_zone(selector, zones);
+		stream->allocation_count = 0;
+	}
+
+	stream->next_lbn = max(stream->next_lbn, lbn + 1);
+	stream->allocation_count++;
+	stream->last_used = ++selector->clock;
+	return stream;
+}
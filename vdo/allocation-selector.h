@@ -14,9 +14,45 @@
  * An allocation_selector is used by any zone which does data block allocations.
  * The selector is used to round-robin allocation requests to different
  * physical zones. Currently, 128 allocations will be made to a given physical
- * zone before switching to the next.
+ * zone before switching to another, or fewer if that zone's thread falls
+ * behind. The zone switched to is the one best able to take allocations,
+ * preferring zones with space and no slabs left to scrub, and then the zone
+ * with the fewest allocations waiting on its thread.
+ *
+ * Data block allocations for writes are also grouped into streams of nearby
+ * logical blocks. All of the allocations of a stream are made from the same
+ * physical zone, which allocates sequentially from its open slab, for up to
+ * 1024 blocks before the stream moves on to another zone. This keeps the
+ * blocks of a large sequential write physically contiguous even when other
+ * writes are interleaved with it, so that the writes of the stream, and later
+ * reads of it, can be merged into large bios. Each new stream starts in the
+ * next zone chosen by the selector.
  */
 
+enum {
+	/* The number of write streams each selector tracks */
+	VDO_ALLOCATION_STREAM_COUNT = 8,
+};
+
+/**
+ * struct allocation_stream: A stream of writes to nearby logical blocks.
+ */
+struct allocation_stream {
+	/** @next_lbn: The next logical block expected in the stream. */
+	logical_block_number_t next_lbn;
+	/**
+	 * @allocation_count: The number of allocations done for the stream
+	 *                    in its current zone, 0 if the stream is unused.
+	 */
+	block_count_t allocation_count;
+	/** @last_used: The selector clock value when the stream was used. */
+	uint64_t last_used;
+	/** @id: The identifier of the stream, unique across selectors. */
+	uint64_t id;
+	/** @zone: The physical zone the stream is allocating from. */
+	zone_count_t zone;
+};
+
 /**
  * struct allocation_selector: Structure used to select which physical zone to
  *                             allocate from.
@@ -31,6 +67,14 @@ struct allocation_selector {
 	zone_count_t next_allocation_zone;
 	/** @last_physical_cone: The number of the last physical zone. */
 	zone_count_t last_physical_zone;
+	/** @clock: A counter for ordering stream uses. */
+	uint64_t clock;
+	/** @stream_count: The number of streams started. */
+	uint64_t stream_count;
+	/** @thread_id: The ID of the thread using this selector. */
+	thread_id_t thread_id;
+	/** @streams: The write streams. */
+	struct allocation_stream streams[VDO_ALLOCATION_STREAM_COUNT];
 };
 
 int __must_check
@@ -39,6 +83,12 @@ vdo_make_allocation_selector(zone_count_t physical_zone_count,
 			     struct allocation_selector **selector_ptr);
 
 zone_count_t __must_check
-vdo_get_next_allocation_zone(struct allocation_selector *selector);
+vdo_get_next_allocation_zone(struct allocation_selector *selector,
+			     struct physical_zones *zones);
+
+const struct allocation_stream * __must_check
+vdo_get_allocation_stream(struct allocation_selector *selector,
+			  struct physical_zones *zones,
+			  logical_block_number_t lbn);
 
 #endif /* ALLOCATION_SELECTOR_H */
@@ -20,6 +20,17 @@ struct atomic_bio_stats {
 	atomic64_t fua; /* Number of REQ_FUA bios */
 };
 
+/* Keep compression statistics atomically */
+struct atomic_compression_stats {
+	atomic64_t failures; /* Number of blocks which did not compress */
+	atomic64_t entropy_skipped; /* Number of blocks predicted incompressible */
+	atomic64_t entropy_audited; /* Number of predictions checked */
+	atomic64_t entropy_mispredicted; /* Number of checks which compressed */
+	atomic64_t compressed; /* Number of blocks compressed */
+	atomic64_t downgraded; /* Number of blocks compressed faster for load */
+	atomic64_t skipped_for_load; /* Number of blocks skipped for load */
+};
+
 /*
  * Counters are atomic since updates can arrive concurrently from arbitrary
  * threads.
@@ -30,6 +41,9 @@ struct atomic_statistics {
 	atomic64_t flush_out;
 	atomic64_t invalid_advice_pbn_count;
 	atomic64_t no_space_error_count;
+	atomic64_t partial_writes_coalesced;
+	atomic64_t reads_shared;
+	atomic64_t blocks_read_ahead;
 	atomic64_t read_only_error_count;
 	struct atomic_bio_stats bios_in;
 	struct atomic_bio_stats bios_in_partial;
@@ -43,6 +57,7 @@ struct atomic_statistics {
 	struct atomic_bio_stats bios_journal_completed;
 	struct atomic_bio_stats bios_page_cache;
 	struct atomic_bio_stats bios_page_cache_completed;
+	struct atomic_compression_stats compression;
 };
 
 #endif /* ATOMIC_STATS_H */
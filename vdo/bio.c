@@ -5,6 +5,8 @@
 
 #include "bio.h"
 
+#include <linux/highmem.h>
+
 #include "logger.h"
 #include "memory-alloc.h"
 #include "numeric.h"
@@ -43,6 +45,37 @@ void vdo_bio_copy_data_out(struct bio *bio, char *data_ptr)
 	}
 }
 
+/*
+ * Map the data of a bio which consists of a single, complete block in one
+ * page, so that it can be read or written in place. Returns NULL if the bio
+ * is not such a bio. Mappings must be released with vdo_unmap_bio_block(),
+ * on the thread which made them, in the reverse order in which they were
+ * made.
+ */
+char *vdo_map_bio_block(struct bio *bio)
+{
+	struct bio_vec biovec;
+
+	if (bio->bi_iter.bi_size != VDO_BLOCK_SIZE) {
+		return NULL;
+	}
+
+	biovec = bio_iovec(bio);
+	if (biovec.bv_len != VDO_BLOCK_SIZE) {
+		return NULL;
+	}
+
+	return ((char *) kmap_local_page(biovec.bv_page)) + biovec.bv_offset;
+}
+
+/*
+ * Release a mapping made by vdo_map_bio_block().
+ */
+void vdo_unmap_bio_block(char *block)
+{
+	kunmap_local(block);
+}
+
 void vdo_free_bio(struct bio *bio)
 {
 	if (bio == NULL) {
@@ -98,7 +131,7 @@ static void count_all_bios_completed(struct vio *vio, struct bio *bio)
 {
 	struct atomic_statistics *stats = &vdo_from_vio(vio)->stats;
 
-	if (is_data_vio(vio)) {
+	if (is_data_vio(vio) || (vio->type == VIO_TYPE_READAHEAD)) {
 		vdo_count_bios(&stats->bios_out_completed, bio);
 		return;
 	}
@@ -13,6 +13,8 @@
 
 void vdo_bio_copy_data_in(struct bio *bio, char *data_ptr);
 void vdo_bio_copy_data_out(struct bio *bio, char *data_ptr);
+char * __must_check vdo_map_bio_block(struct bio *bio);
+void vdo_unmap_bio_block(char *block);
 
 static inline int vdo_get_bio_result(struct bio *bio)
 {
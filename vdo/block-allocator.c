@@ -372,18 +372,99 @@ static int allocate_slab_block(struct vdo_slab *slab,
 	return VDO_SUCCESS;
 }
 
+/*
+ * Get the allocation run of a write stream, replacing the least recently
+ * used run if the stream does not have one.
+ */
+static struct allocation_run *get_allocation_run(struct block_allocator *allocator,
+						 uint64_t stream)
+{
+	struct allocation_run *run = &allocator->runs[0];
+	unsigned int i;
+
+	for (i = 0; i < VDO_ALLOCATION_RUN_COUNT; i++) {
+		if (allocator->runs[i].stream == stream) {
+			run = &allocator->runs[i];
+			break;
+		}
+
+		if (allocator->runs[i].last_used < run->last_used) {
+			run = &allocator->runs[i];
+		}
+	}
+
+	if (run->stream != stream) {
+		run->stream = stream;
+		run->slab = NULL;
+	}
+
+	run->last_used = ++allocator->run_clock;
+	return run;
+}
+
+/*
+ * Allocate the next block of a write stream from the stream's run in the
+ * open slab, reserving a new run if necessary. Returns VDO_NO_SPACE if no
+ * run could be reserved, in which case the block should be allocated
+ * normally.
+ */
+static int allocate_run_block(struct block_allocator *allocator,
+			      uint64_t stream,
+			      physical_block_number_t *block_number_ptr)
+{
+	struct vdo_slab *slab = allocator->open_slab;
+	struct allocation_run *run = get_allocation_run(allocator, stream);
+	int result = VDO_NO_SPACE;
+
+	if (run->slab == slab) {
+		result = vdo_allocate_unreferenced_block_in_run(slab->reference_counts,
+								run,
+								block_number_ptr);
+	}
+
+	if ((result == VDO_NO_SPACE) &&
+	    vdo_start_allocation_run(slab->reference_counts,
+				     allocator->runs,
+				     VDO_ALLOCATION_RUN_COUNT,
+				     run)) {
+		result = vdo_allocate_unreferenced_block_in_run(slab->reference_counts,
+								run,
+								block_number_ptr);
+	}
+
+	if (result == VDO_SUCCESS) {
+		vdo_adjust_free_block_count(slab, false);
+	}
+
+	return result;
+}
+
 /*
  * The block allocated will have a provisional reference and the reference
  * must be either confirmed with a subsequent increment or vacated with a
- * subsequent decrement via vdo_release_block_reference().
+ * subsequent decrement via vdo_release_block_reference(). If the allocation
+ * is for a write stream (stream is non-zero), the block is allocated from a
+ * run of the open slab reserved for the stream when possible.
  */
 int vdo_allocate_block(struct block_allocator *allocator,
+		       uint64_t stream,
 		       physical_block_number_t *block_number_ptr)
 {
 	if (allocator->open_slab != NULL) {
+		int result = VDO_NO_SPACE;
+
+		if (stream != 0) {
+			result = allocate_run_block(allocator,
+						    stream,
+						    block_number_ptr);
+		}
+
 		/* Try to allocate the next block in the currently open slab. */
-		int result =
-			allocate_slab_block(allocator->open_slab, block_number_ptr);
+		if (result == VDO_NO_SPACE) {
+			result = allocate_slab_block(allocator->open_slab,
+						     block_number_ptr);
+		}
+
 		if ((result == VDO_SUCCESS) || (result != VDO_NO_SPACE)) {
 			return result;
 		}
@@ -967,6 +1048,18 @@ void vdo_scrub_all_unrecovered_slabs_in_zone(void *context,
 	vdo_complete_completion(parent);
 }
 
+/*
+ * Get the number of free data blocks in the slabs of an allocator. This may
+ * be called from any thread.
+ */
+block_count_t vdo_get_allocator_free_blocks(const struct block_allocator *allocator)
+{
+	block_count_t data_blocks = READ_ONCE(allocator->slab_count);
+	block_count_t allocated = READ_ONCE(allocator->allocated_blocks);
+
+	data_blocks *= allocator->depot->slab_config.data_blocks;
+	return ((allocated < data_blocks) ? (data_blocks - allocated) : 0);
+}
 
 struct block_allocator_statistics
 vdo_get_block_allocator_statistics(const struct block_allocator *allocator)
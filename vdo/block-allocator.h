@@ -46,6 +46,27 @@ struct slab_actor {
 	vdo_action *callback;
 };
 
+enum {
+	/* The number of allocation runs each allocator tracks */
+	VDO_ALLOCATION_RUN_COUNT = 16,
+};
+
+/*
+ * A range of a slab reserved for the allocations of one write stream.
+ */
+struct allocation_run {
+	/* The id of the stream allocating from the run, 0 if unused */
+	uint64_t stream;
+	/* The slab of the run, NULL if the run has no range */
+	struct vdo_slab *slab;
+	/* The slab block at which to start searching for a free block */
+	slab_block_number next_index;
+	/* The slab block just past the end of the run */
+	slab_block_number end_index;
+	/* The allocator clock value when the run was last used */
+	uint64_t last_used;
+};
+
 struct block_allocator {
 	struct vdo_completion completion;
 	/* The slab depot for this allocator */
@@ -79,6 +100,10 @@ struct block_allocator {
 	struct slab_scrubber *slab_scrubber;
 	/* What phase of the close operation the allocator is to perform */
 	enum block_allocator_drain_step drain_step;
+	/* The runs reserved for write streams */
+	struct allocation_run runs[VDO_ALLOCATION_RUN_COUNT];
+	/* A counter for ordering run uses */
+	uint64_t run_clock;
 
 	/*
 	 * These statistics are all mutated only by the physical zone thread,
@@ -133,6 +158,7 @@ void vdo_queue_slab(struct vdo_slab *slab);
 void vdo_adjust_free_block_count(struct vdo_slab *slab, bool increment);
 
 int __must_check vdo_allocate_block(struct block_allocator *allocator,
+				    uint64_t stream,
 				    physical_block_number_t *block_number_ptr);
 
 void vdo_release_block_reference(struct block_allocator *allocator,
@@ -180,6 +206,9 @@ void vdo_scrub_all_unrecovered_slabs_in_zone(void *context,
 					     zone_count_t zone_number,
 					     struct vdo_completion *parent);
 
+block_count_t __must_check
+vdo_get_allocator_free_blocks(const struct block_allocator *allocator);
+
 struct block_allocator_statistics __must_check
 vdo_get_block_allocator_statistics(const struct block_allocator *allocator);
 
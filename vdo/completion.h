@@ -29,9 +29,11 @@ enum vdo_completion_type {
 	VDO_FLUSH_COMPLETION,
 	VDO_FLUSH_NOTIFICATION_COMPLETION,
 	VDO_GENERATION_FLUSHED_COMPLETION,
+	VDO_HASHER_COMPLETION,
 	VDO_HASH_ZONE_COMPLETION,
 	VDO_HASH_ZONES_COMPLETION,
 	VDO_LOCK_COUNTER_COMPLETION,
+	VDO_PACKER_COMPLETION,
 	VDO_PAGE_COMPLETION,
 	VDO_PARTITION_COPY_COMPLETION,
 	VDO_READ_ONLY_MODE_COMPLETION,
@@ -0,0 +1,357 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright Red Hat
+ */
+
+#include "compressed-block-cache.h"
+
+#include <linux/atomic.h>
+
+#include "memory-alloc.h"
+
+#include "constants.h"
+
+/**
+ * DOC:
+ *
+ * When several logical blocks map to fragments of the same compressed block,
+ * reading them would otherwise read the same physical block from storage
+ * once per fragment. The compressed block cache holds the most recently read
+ * compressed blocks so that reads of the other fragments need only
+ * decompress.
+ *
+ * The cache is split into one small, fully associative zone per logical
+ * zone. A read looks up and fills the zone of its logical block from that
+ * zone's thread, so no locking is needed. Since neighboring logical blocks
+ * are usually in the same logical zone, the fragments of a compressed block
+ * written from a sequential stream will generally be read through the same
+ * zone.
+ *
+ * A cached block remains valid for as long as its physical block is
+ * referenced. Rather than searching every zone when a physical block is
+ * freed, the physical zone which frees it increments an epoch counter
+ * selected by the block number. Each cached block records the epoch of its
+ * counter when it was cached, and is ignored once the epoch has moved on. A
+ * read only caches the block it read while it still holds the lock on its
+ * logical block, so the physical block can not be freed between the read and
+ * the recording of the epoch. Since several physical blocks share each epoch
+ * counter, freeing a block may also spuriously invalidate others, which costs
+ * only a read.
+ *
+ * A second cache of the same kind holds the data blocks read ahead of
+ * sequential read streams (see stream-detector.c). Readahead holds no lock on
+ * any logical block, so it records the epochs of the blocks it will read
+ * before reading them, while the logical blocks which map to them are known
+ * to be unlocked; a block freed while the read is in progress is then never
+ * found.
+ */
+
+enum {
+	/* The number of epoch counters (must be a power of two) */
+	CACHE_EPOCH_COUNT = 1024,
+};
+
+struct cached_block {
+	/* The physical block cached, or VDO_ZERO_BLOCK if the entry is empty */
+	physical_block_number_t pbn;
+	/* The epoch of the block's epoch counter when it was cached */
+	unsigned int epoch;
+	/* The zone clock value when this entry was last used */
+	uint64_t last_used;
+	/* The contents of the block */
+	char *data;
+};
+
+struct cache_zone {
+	/* A counter for ordering entry uses */
+	uint64_t clock;
+	/* The number of lookups which found a valid block */
+	uint64_t hits;
+	/* The number of lookups which did not */
+	uint64_t misses;
+	/* The cached blocks */
+	struct cached_block *blocks;
+};
+
+struct compressed_block_cache {
+	/* The epoch counters */
+	atomic_t epochs[CACHE_EPOCH_COUNT];
+	/* The number of zones */
+	zone_count_t zone_count;
+	/* The number of blocks cached by each zone */
+	unsigned int blocks_per_zone;
+	/* The zones */
+	struct cache_zone zones[];
+};
+
+/**
+ * vdo_make_compressed_block_cache() - Make a compressed block cache.
+ * @zone_count: The number of zones (one per logical zone).
+ * @blocks_per_zone: The number of blocks each zone may cache.
+ * @cache_ptr: A pointer to hold the new cache.
+ *
+ * Return: VDO_SUCCESS or an error.
+ */
+int vdo_make_compressed_block_cache(zone_count_t zone_count,
+				    unsigned int blocks_per_zone,
+				    struct compressed_block_cache **cache_ptr)
+{
+	struct compressed_block_cache *cache;
+	zone_count_t z;
+	int result = UDS_ALLOCATE_EXTENDED(struct compressed_block_cache,
+					   zone_count,
+					   struct cache_zone,
+					   __func__,
+					   &cache);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	cache->zone_count = zone_count;
+	cache->blocks_per_zone = blocks_per_zone;
+	for (z = 0; z < zone_count; z++) {
+		unsigned int i;
+
+		result = UDS_ALLOCATE(blocks_per_zone,
+				      struct cached_block,
+				      "block cache zone",
+				      &cache->zones[z].blocks);
+		if (result != VDO_SUCCESS) {
+			vdo_free_compressed_block_cache(cache);
+			return result;
+		}
+
+		for (i = 0; i < blocks_per_zone; i++) {
+			struct cached_block *entry = &cache->zones[z].blocks[i];
+
+			entry->pbn = VDO_ZERO_BLOCK;
+			result = UDS_ALLOCATE(VDO_BLOCK_SIZE,
+					      char,
+					      "compressed block cache entry",
+					      &entry->data);
+			if (result != VDO_SUCCESS) {
+				vdo_free_compressed_block_cache(cache);
+				return result;
+			}
+		}
+	}
+
+	*cache_ptr = cache;
+	return VDO_SUCCESS;
+}
+
+/**
+ * vdo_free_compressed_block_cache() - Free a compressed block cache.
+ * @cache: The cache to free (may be NULL).
+ */
+void vdo_free_compressed_block_cache(struct compressed_block_cache *cache)
+{
+	zone_count_t z;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	for (z = 0; z < cache->zone_count; z++) {
+		struct cached_block *blocks = cache->zones[z].blocks;
+		unsigned int i;
+
+		if (blocks == NULL) {
+			continue;
+		}
+
+		for (i = 0; i < cache->blocks_per_zone; i++) {
+			UDS_FREE(UDS_FORGET(blocks[i].data));
+		}
+
+		UDS_FREE(blocks);
+	}
+
+	UDS_FREE(cache);
+}
+
+/**
+ * get_epoch() - Get the epoch counter for a physical block.
+ * @cache: The cache.
+ * @pbn: The physical block.
+ *
+ * Return: The block's epoch counter.
+ */
+static inline atomic_t *get_epoch(struct compressed_block_cache *cache,
+				  physical_block_number_t pbn)
+{
+	return &cache->epochs[pbn & (CACHE_EPOCH_COUNT - 1)];
+}
+
+/**
+ * find_entry() - Find the entry for a physical block in a cache zone.
+ * @cache: The cache.
+ * @zone: The zone to search.
+ * @pbn: The physical block to find.
+ *
+ * Return: The entry, or NULL if the block is not in the zone.
+ */
+static struct cached_block *find_entry(struct compressed_block_cache *cache,
+				       struct cache_zone *zone,
+				       physical_block_number_t pbn)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->blocks_per_zone; i++) {
+		if (zone->blocks[i].pbn == pbn) {
+			return &zone->blocks[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * vdo_get_cached_compressed_block() - Copy a compressed block from the cache.
+ * @cache: The cache.
+ * @zone_number: The logical zone doing the lookup.
+ * @pbn: The compressed block to look up.
+ * @block: A buffer to receive the block.
+ *
+ * This must be called from the thread of the logical zone, by a data_vio
+ * which holds the lock on a logical block mapped to the physical block.
+ *
+ * Return: true if the block was cached.
+ */
+bool vdo_get_cached_compressed_block(struct compressed_block_cache *cache,
+				     zone_count_t zone_number,
+				     physical_block_number_t pbn,
+				     char *block)
+{
+	struct cache_zone *zone = &cache->zones[zone_number];
+	struct cached_block *entry = find_entry(cache, zone, pbn);
+
+	if ((entry == NULL) ||
+	    (entry->epoch != atomic_read(get_epoch(cache, pbn)))) {
+		WRITE_ONCE(zone->misses, zone->misses + 1);
+		return false;
+	}
+
+	memcpy(block, entry->data, VDO_BLOCK_SIZE);
+	entry->last_used = ++zone->clock;
+	WRITE_ONCE(zone->hits, zone->hits + 1);
+	return true;
+}
+
+/**
+ * vdo_get_cached_block_epoch() - Get the current epoch of a physical block.
+ * @cache: The cache.
+ * @pbn: The physical block.
+ *
+ * A block read by a caller which holds no lock on a logical block mapped to
+ * it must be cached with the epoch the block had when it was known to be
+ * referenced, rather than the epoch when the read completes.
+ *
+ * Return: The epoch to pass to vdo_cache_block_at_epoch().
+ */
+unsigned int vdo_get_cached_block_epoch(struct compressed_block_cache *cache,
+					physical_block_number_t pbn)
+{
+	return atomic_read(get_epoch(cache, pbn));
+}
+
+/**
+ * vdo_cache_block_at_epoch() - Add a block to the cache as of a given epoch.
+ * @cache: The cache.
+ * @zone_number: The logical zone adding the block.
+ * @pbn: The physical block read.
+ * @epoch: The epoch of the block when it was known to be referenced.
+ * @block: The contents of the block.
+ *
+ * If the block is not already cached, the least recently used entry of the
+ * zone is replaced. If the block has been freed since the epoch was taken,
+ * the entry will never be found. This must be called from the thread of the
+ * logical zone.
+ */
+void vdo_cache_block_at_epoch(struct compressed_block_cache *cache,
+			      zone_count_t zone_number,
+			      physical_block_number_t pbn,
+			      unsigned int epoch,
+			      const char *block)
+{
+	struct cache_zone *zone = &cache->zones[zone_number];
+	struct cached_block *entry = find_entry(cache, zone, pbn);
+
+	if ((entry != NULL) && (entry->epoch == epoch)) {
+		entry->last_used = ++zone->clock;
+		return;
+	}
+
+	if (entry == NULL) {
+		unsigned int i;
+
+		entry = &zone->blocks[0];
+		for (i = 1; i < cache->blocks_per_zone; i++) {
+			if (zone->blocks[i].last_used < entry->last_used) {
+				entry = &zone->blocks[i];
+			}
+		}
+	}
+
+	memcpy(entry->data, block, VDO_BLOCK_SIZE);
+	entry->pbn = pbn;
+	entry->epoch = epoch;
+	entry->last_used = ++zone->clock;
+}
+
+/**
+ * vdo_cache_compressed_block() - Add a compressed block to the cache.
+ * @cache: The cache.
+ * @zone_number: The logical zone adding the block.
+ * @pbn: The physical block read.
+ * @block: The contents of the block.
+ *
+ * This must be called from the thread of the logical zone, by a data_vio
+ * which still holds the lock on a logical block mapped to the physical block.
+ */
+void vdo_cache_compressed_block(struct compressed_block_cache *cache,
+				zone_count_t zone_number,
+				physical_block_number_t pbn,
+				const char *block)
+{
+	vdo_cache_block_at_epoch(cache,
+				 zone_number,
+				 pbn,
+				 vdo_get_cached_block_epoch(cache, pbn),
+				 block);
+}
+
+/**
+ * vdo_invalidate_cached_compressed_block() - Invalidate any cached copy of a
+ *                                            physical block.
+ * @cache: The cache.
+ * @pbn: The physical block which has become free.
+ *
+ * This may be called from any thread.
+ */
+void vdo_invalidate_cached_compressed_block(struct compressed_block_cache *cache,
+					    physical_block_number_t pbn)
+{
+	atomic_inc(get_epoch(cache, pbn));
+}
+
+/**
+ * vdo_get_compressed_block_cache_statistics() - Get the statistics of a
+ *                                               compressed block cache.
+ * @cache: The cache.
+ *
+ * Return: The totals of the statistics of all the zones.
+ */
+struct compressed_block_cache_statistics
+vdo_get_compressed_block_cache_statistics(const struct compressed_block_cache *cache)
+{
+	struct compressed_block_cache_statistics stats = { 0 };
+	zone_count_t z;
+
+	for (z = 0; z < cache->zone_count; z++) {
+		stats.hits += READ_ONCE(cache->zones[z].hits);
+		stats.misses += READ_ONCE(cache->zones[z].misses);
+	}
+
+	return stats;
+}
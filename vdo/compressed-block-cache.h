@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright Red Hat
+ */
+
+#ifndef COMPRESSED_BLOCK_CACHE_H
+#define COMPRESSED_BLOCK_CACHE_H
+
+#include "statistics.h"
+#include "types.h"
+
+enum {
+	/* The number of compressed blocks cached by each logical zone */
+	VDO_COMPRESSED_BLOCKS_PER_ZONE = 16,
+};
+
+struct compressed_block_cache;
+
+int __must_check
+vdo_make_compressed_block_cache(zone_count_t zone_count,
+				unsigned int blocks_per_zone,
+				struct compressed_block_cache **cache_ptr);
+
+void vdo_free_compressed_block_cache(struct compressed_block_cache *cache);
+
+bool __must_check
+vdo_get_cached_compressed_block(struct compressed_block_cache *cache,
+				zone_count_t zone_number,
+				physical_block_number_t pbn,
+				char *block);
+
+unsigned int __must_check
+vdo_get_cached_block_epoch(struct compressed_block_cache *cache,
+			   physical_block_number_t pbn);
+
+void vdo_cache_block_at_epoch(struct compressed_block_cache *cache,
+			      zone_count_t zone_number,
+			      physical_block_number_t pbn,
+			      unsigned int epoch,
+			      const char *block);
+
+void vdo_cache_compressed_block(struct compressed_block_cache *cache,
+				zone_count_t zone_number,
+				physical_block_number_t pbn,
+				const char *block);
+
+void
+vdo_invalidate_cached_compressed_block(struct compressed_block_cache *cache,
+				       physical_block_number_t pbn);
+
+struct compressed_block_cache_statistics
+vdo_get_compressed_block_cache_statistics(const struct compressed_block_cache *cache);
+
+#endif /* COMPRESSED_BLOCK_CACHE_H */
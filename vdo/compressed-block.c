@@ -15,6 +15,11 @@ static const struct version_number COMPRESSED_BLOCK_1_0 = {
 	.minor_version = 0,
 };
 
+static const struct version_number COMPRESSED_BLOCK_1_1 = {
+	.major_version = 1,
+	.minor_version = VDO_COMPRESSION_FORMAT_ZSTD,
+};
+
 enum {
 	COMPRESSED_BLOCK_1_0_SIZE = 4 + 4 + (2 * VDO_MAX_COMPRESSION_SLOTS),
 };
@@ -29,6 +34,7 @@ get_compressed_fragment_size(const struct compressed_block_header *header,
 /**
  * vdo_initialize_compressed_block() - Initialize a compressed block.
  * @block: The compressed block to initialize.
+ * @format: The format of the fragments in the block.
  * @size: The size of the agent's fragment.
  *
  * This method initializes the compressed block in the compressed
@@ -38,6 +44,7 @@ get_compressed_fragment_size(const struct compressed_block_header *header,
  * header and set the size of the agent's fragment.
  */
 void vdo_initialize_compressed_block(struct compressed_block *block,
+				     enum vdo_compression_format format,
 				     uint16_t size)
 {
 	/*
@@ -47,7 +54,14 @@ void vdo_initialize_compressed_block(struct compressed_block *block,
 	STATIC_ASSERT_SIZEOF(struct compressed_block_header,
 			     COMPRESSED_BLOCK_1_0_SIZE);
 
-	block->header.version = vdo_pack_version_number(COMPRESSED_BLOCK_1_0);
+	/*
+	 * Blocks of LZ4 fragments are still written as version 1.0 so that
+	 * they remain readable by older versions of vdo.
+	 */
+	block->header.version =
+		vdo_pack_version_number((format == VDO_COMPRESSION_FORMAT_ZSTD)
+					? COMPRESSED_BLOCK_1_1
+					: COMPRESSED_BLOCK_1_0);
 	block->header.sizes[0] = __cpu_to_le16(size);
 }
 
@@ -56,6 +70,7 @@ void vdo_initialize_compressed_block(struct compressed_block *block,
  *                                       fragment from a compression block.
  * @mapping_state [in] The mapping state for the look up.
  * @compressed_block [in] The compressed block that was read from disk.
+ * @format [out] The format of the fragments in the compressed block.
  * @fragment_offset [out] The offset of the fragment within a compressed block.
  * @fragment_size [out] The size of the fragment.
  *
@@ -64,6 +79,7 @@ void vdo_initialize_compressed_block(struct compressed_block *block,
  */
 int vdo_get_compressed_block_fragment(enum block_mapping_state mapping_state,
 				      struct compressed_block *block,
+				      enum vdo_compression_format *format,
 				      uint16_t *fragment_offset,
 				      uint16_t *fragment_size)
 {
@@ -78,7 +94,11 @@ int vdo_get_compressed_block_fragment(enum block_mapping_state mapping_state,
 	}
 
 	version = vdo_unpack_version_number(block->header.version);
-	if (!vdo_are_same_version(version, COMPRESSED_BLOCK_1_0)) {
+	if (vdo_are_same_version(version, COMPRESSED_BLOCK_1_0)) {
+		*format = VDO_COMPRESSION_FORMAT_LZ4;
+	} else if (vdo_are_same_version(version, COMPRESSED_BLOCK_1_1)) {
+		*format = VDO_COMPRESSION_FORMAT_ZSTD;
+	} else {
 		return VDO_INVALID_FRAGMENT;
 	}
 
@@ -13,6 +13,17 @@
 #include "header.h"
 #include "types.h"
 
+/*
+ * The format of the fragments in a compressed block. This is recorded as the
+ * minor version of the compressed block header so that versions of vdo which
+ * predate a format will refuse to read blocks written in it rather than
+ * returning garbage.
+ */
+enum vdo_compression_format {
+	VDO_COMPRESSION_FORMAT_LZ4 = 0,
+	VDO_COMPRESSION_FORMAT_ZSTD = 1,
+};
+
 /*
  * The header of a compressed block.
  */
@@ -52,10 +63,12 @@ struct compressed_block {
 
 int vdo_get_compressed_block_fragment(enum block_mapping_state mapping_state,
 				      struct compressed_block *block,
+				      enum vdo_compression_format *format,
 				      uint16_t *fragment_offset,
 				      uint16_t *fragment_size);
 
 void vdo_initialize_compressed_block(struct compressed_block *block,
+				     enum vdo_compression_format format,
 				     uint16_t size);
 
 static inline void
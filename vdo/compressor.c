@@ -0,0 +1,705 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright Red Hat
+ */
+
+#include "compressor.h"
+
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/lz4.h>
+#include <linux/string.h>
+#include <linux/version.h>
+
+#include "logger.h"
+#include "memory-alloc.h"
+
+#include "constants.h"
+#include "status-codes.h"
+
+#define VDO_HAVE_LZ4HC IS_ENABLED(CONFIG_LZ4HC_COMPRESS)
+
+/*
+ * The zstd interface used here was introduced with the zstd 1.4.10 update in
+ * 5.16.
+ */
+#ifdef RHEL_RELEASE_CODE
+#define VDO_HAVE_ZSTD_API (RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(9,2))
+#else
+#define VDO_HAVE_ZSTD_API (LINUX_VERSION_CODE >= KERNEL_VERSION(5,16,0))
+#endif
+
+#if VDO_HAVE_ZSTD_API && IS_ENABLED(CONFIG_ZSTD_COMPRESS) && \
+	IS_ENABLED(CONFIG_ZSTD_DECOMPRESS)
+#define VDO_HAVE_ZSTD 1
+#include <linux/zstd.h>
+#else
+#define VDO_HAVE_ZSTD 0
+#endif
+
+enum {
+	LZ4_DEFAULT_ACCELERATION = 1,
+	/* The largest acceleration LZ4 will actually use */
+	LZ4_MAX_ACCELERATION = 65537,
+	ZSTD_DEFAULT_LEVEL = 3,
+	/* The low bits of a packed compression setting hold the level */
+	COMPRESSION_LEVEL_BITS = 24,
+	COMPRESSION_LEVEL_MASK = (1 << COMPRESSION_LEVEL_BITS) - 1,
+	/* The LZ4 acceleration used when compression is downgraded */
+	LZ4_DOWNGRADED_ACCELERATION = 8,
+	ZSTD_DOWNGRADED_LEVEL = 1,
+};
+
+/*
+ * The entropy estimate samples ENTROPY_SAMPLE_SIZE bytes from the start of
+ * each ENTROPY_SAMPLE_STRIDE bytes of a block.
+ */
+enum {
+	ENTROPY_SAMPLE_SIZE = 16,
+	ENTROPY_SAMPLE_STRIDE = 128,
+	ENTROPY_SAMPLES =
+		(VDO_BLOCK_SIZE / ENTROPY_SAMPLE_STRIDE) * ENTROPY_SAMPLE_SIZE,
+	/* A sample using fewer distinct byte values than this is compressible */
+	ENTROPY_MIN_BYTE_SET = 64,
+	/* The percentage of the maximum entropy deemed incompressible */
+	ENTROPY_INCOMPRESSIBLE_PERCENT = 90,
+	/* Logarithms are computed in quarter bits; a byte holds 32 of them */
+	ENTROPY_MAX_QUARTER_BITS = 32,
+	/* One in this many blocks predicted incompressible is compressed anyway */
+	ENTROPY_AUDIT_INTERVAL = 64,
+};
+
+/*
+ * Decoding only a prefix of a fragment saves most of the decoding of a
+ * candidate which differs, but costs decoding the prefix twice for one which
+ * matches. The probe score of a context rises by PROBE_MISMATCH_WEIGHT for
+ * each mismatch and falls by one for each match, so prefixes are decoded
+ * while more than about one candidate in eight differs.
+ */
+enum {
+	PROBE_MISMATCH_WEIGHT = 7,
+	PROBE_SCORE_LIMIT = 64,
+};
+
+/*
+ * The state for running a compression engine on a cpu thread. Only one
+ * engine runs at a time on any thread, so all of the engines share a single
+ * workspace large enough for any of them.
+ */
+struct compressor_context {
+	size_t workspace_size;
+	void *workspace;
+	/* The number of predictions to make before auditing the next one */
+	unsigned int audit_countdown;
+	/* Positive while decoding fragment prefixes first has been paying off */
+	int probe_score;
+	/* The moving average time to compress a block, in nanoseconds */
+	u64 latency;
+	/* The byte histogram of the current entropy sample */
+	u16 histogram[256];
+};
+
+static const char *COMPRESSION_TYPE_NAMES[] = {
+	[VDO_COMPRESSION_LZ4] = "lz4",
+	[VDO_COMPRESSION_LZ4HC] = "lz4hc",
+	[VDO_COMPRESSION_ZSTD] = "zstd",
+};
+
+/**
+ * is_compression_type_available() - Check whether a compression engine was
+ *                                    built into the running kernel.
+ * @type: The type of compression.
+ *
+ * Return: true if the compression engine may be used.
+ */
+static bool is_compression_type_available(enum vdo_compression_type type)
+{
+	switch (type) {
+	case VDO_COMPRESSION_LZ4:
+		return true;
+
+	case VDO_COMPRESSION_LZ4HC:
+		return VDO_HAVE_LZ4HC;
+
+	case VDO_COMPRESSION_ZSTD:
+		return VDO_HAVE_ZSTD;
+
+	default:
+		return false;
+	}
+}
+
+#if VDO_HAVE_ZSTD
+/**
+ * get_zstd_parameters() - Get the zstd parameters for compressing a block.
+ * @level: The compression level.
+ */
+static zstd_parameters get_zstd_parameters(int level)
+{
+	zstd_parameters parameters = zstd_get_params(level, VDO_BLOCK_SIZE);
+
+	/*
+	 * The size of the uncompressed data is always a block and nothing
+	 * else uses the frame header, so don't waste space on it.
+	 */
+	parameters.fParams.contentSizeFlag = 0;
+	parameters.fParams.checksumFlag = 0;
+	parameters.fParams.noDictIDFlag = 1;
+	return parameters;
+}
+
+/**
+ * get_zstd_workspace_size() - Get the workspace size needed to compress or
+ *                             decompress a block with zstd at any level.
+ */
+static size_t get_zstd_workspace_size(void)
+{
+	size_t size = zstd_dctx_workspace_bound();
+	int level;
+
+	for (level = 1; level <= zstd_max_clevel(); level++) {
+		zstd_parameters parameters = get_zstd_parameters(level);
+
+		size = max(size, zstd_cctx_workspace_bound(&parameters.cParams));
+	}
+
+	return size;
+}
+#endif /* VDO_HAVE_ZSTD */
+
+/**
+ * vdo_make_compressor_context() - Make a context for running compression
+ *                                 engines on a cpu thread.
+ * @context_ptr: A pointer to hold the new context.
+ *
+ * Return: VDO_SUCCESS or an error.
+ */
+int vdo_make_compressor_context(struct compressor_context **context_ptr)
+{
+	struct compressor_context *context;
+	size_t size = LZ4_MEM_COMPRESS;
+	int result;
+
+#if VDO_HAVE_LZ4HC
+	size = max_t(size_t, size, LZ4HC_MEM_COMPRESS);
+#endif
+#if VDO_HAVE_ZSTD
+	size = max(size, get_zstd_workspace_size());
+#endif
+
+	result = UDS_ALLOCATE(1,
+			      struct compressor_context,
+			      "compressor context",
+			      &context);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	result = UDS_ALLOCATE(size, char, "compressor workspace",
+			      &context->workspace);
+	if (result != VDO_SUCCESS) {
+		UDS_FREE(context);
+		return result;
+	}
+
+	context->workspace_size = size;
+	context->audit_countdown = ENTROPY_AUDIT_INTERVAL;
+	context->probe_score = PROBE_MISMATCH_WEIGHT;
+	*context_ptr = context;
+	return VDO_SUCCESS;
+}
+
+/**
+ * vdo_free_compressor_context() - Free a compressor context.
+ * @context: The context to free (may be NULL).
+ */
+void vdo_free_compressor_context(struct compressor_context *context)
+{
+	if (context == NULL) {
+		return;
+	}
+
+	UDS_FREE(UDS_FORGET(context->workspace));
+	UDS_FREE(context);
+}
+
+/**
+ * vdo_parse_compression_type() - Parse the name of a compression engine.
+ * @name: The name to parse.
+ * @type_ptr: A pointer to hold the type of compression.
+ *
+ * Return: VDO_SUCCESS or -EINVAL if the name is not a compression engine
+ *         which is available in the running kernel.
+ */
+int vdo_parse_compression_type(const char *name,
+			       enum vdo_compression_type *type_ptr)
+{
+	unsigned int type;
+
+	for (type = 0; type < ARRAY_SIZE(COMPRESSION_TYPE_NAMES); type++) {
+		if (strcmp(name, COMPRESSION_TYPE_NAMES[type]) != 0) {
+			continue;
+		}
+
+		if (!is_compression_type_available(type)) {
+			uds_log_error("compression type %s is not supported by this kernel",
+				      name);
+			return -EINVAL;
+		}
+
+		*type_ptr = type;
+		return VDO_SUCCESS;
+	}
+
+	uds_log_error("unknown compression type \"%s\"", name);
+	return -EINVAL;
+}
+
+/**
+ * vdo_get_compression_type_name() - Get the name of a compression engine.
+ * @type: The type of compression.
+ *
+ * Return: The name of the compression engine.
+ */
+const char *vdo_get_compression_type_name(enum vdo_compression_type type)
+{
+	if (type >= ARRAY_SIZE(COMPRESSION_TYPE_NAMES)) {
+		return "unknown";
+	}
+
+	return COMPRESSION_TYPE_NAMES[type];
+}
+
+/**
+ * vdo_get_compression_level() - Get the level at which a compression engine
+ *                               will actually run.
+ * @type: The type of compression.
+ * @level: The requested level, or VDO_DEFAULT_COMPRESSION_LEVEL.
+ *
+ * Levels outside the range supported by the engine are clamped to it.
+ *
+ * Return: The effective compression level.
+ */
+int vdo_get_compression_level(enum vdo_compression_type type, int level)
+{
+	switch (type) {
+#if VDO_HAVE_LZ4HC
+	case VDO_COMPRESSION_LZ4HC:
+		if (level == VDO_DEFAULT_COMPRESSION_LEVEL) {
+			return LZ4HC_DEFAULT_CLEVEL;
+		}
+
+		return clamp(level, LZ4HC_MIN_CLEVEL, LZ4HC_MAX_CLEVEL);
+#endif
+
+#if VDO_HAVE_ZSTD
+	case VDO_COMPRESSION_ZSTD:
+		if (level == VDO_DEFAULT_COMPRESSION_LEVEL) {
+			return ZSTD_DEFAULT_LEVEL;
+		}
+
+		return clamp(level, 1, zstd_max_clevel());
+#endif
+
+	default:
+		if (level == VDO_DEFAULT_COMPRESSION_LEVEL) {
+			return LZ4_DEFAULT_ACCELERATION;
+		}
+
+		return clamp(level, 1, LZ4_MAX_ACCELERATION);
+	}
+}
+
+/**
+ * vdo_pack_compression_setting() - Pack a compression engine and level into
+ *                                  a single word.
+ * @type: The type of compression.
+ * @level: The requested level, or VDO_DEFAULT_COMPRESSION_LEVEL.
+ *
+ * Packing both into one word allows them to be published together with a
+ * single store. Levels too large to pack are reduced to the largest level
+ * which fits, which is more than any engine supports.
+ *
+ * Return: The packed setting.
+ */
+u32 vdo_pack_compression_setting(enum vdo_compression_type type, int level)
+{
+	return (((u32) type << COMPRESSION_LEVEL_BITS) |
+		clamp(level, 0, (int) COMPRESSION_LEVEL_MASK));
+}
+
+/**
+ * vdo_unpack_compression_setting() - Unpack a compression engine and level
+ *                                    packed by
+ *                                    vdo_pack_compression_setting().
+ * @setting: The packed setting.
+ * @type_ptr: A pointer to hold the type of compression.
+ * @level_ptr: A pointer to hold the requested level.
+ */
+void vdo_unpack_compression_setting(u32 setting,
+				    enum vdo_compression_type *type_ptr,
+				    int *level_ptr)
+{
+	*type_ptr = setting >> COMPRESSION_LEVEL_BITS;
+	*level_ptr = setting & COMPRESSION_LEVEL_MASK;
+}
+
+/**
+ * vdo_downgrade_compression() - Get a faster compression setting which
+ *                               produces fragments in the same format.
+ * @type_ptr: The type of compression, which will be replaced by the faster
+ *            type.
+ * @level_ptr: The compression level, which will be replaced by the faster
+ *             level.
+ *
+ * LZ4HC is replaced by LZ4, LZ4 runs with a higher acceleration, and zstd
+ * runs at its fastest level.
+ *
+ * Return: true if the setting changed, false if it was already at least as
+ *         fast as the downgraded setting.
+ */
+bool vdo_downgrade_compression(enum vdo_compression_type *type_ptr,
+			       int *level_ptr)
+{
+	enum vdo_compression_type type = *type_ptr;
+	int level = vdo_get_compression_level(type, *level_ptr);
+
+	switch (type) {
+	case VDO_COMPRESSION_ZSTD:
+		*level_ptr = ZSTD_DOWNGRADED_LEVEL;
+		break;
+
+	case VDO_COMPRESSION_LZ4:
+		*level_ptr = max(level, (int) LZ4_DOWNGRADED_ACCELERATION);
+		break;
+
+	default:
+		*type_ptr = VDO_COMPRESSION_LZ4;
+		*level_ptr = LZ4_DOWNGRADED_ACCELERATION;
+		break;
+	}
+
+	return ((*type_ptr != type) ||
+		(vdo_get_compression_level(*type_ptr, *level_ptr) != level));
+}
+
+/**
+ * vdo_get_compression_format() - Get the on-disk format of the fragments
+ *                                produced by a compression engine.
+ * @type: The type of compression.
+ */
+enum vdo_compression_format
+vdo_get_compression_format(enum vdo_compression_type type)
+{
+	return (((type == VDO_COMPRESSION_ZSTD) && VDO_HAVE_ZSTD)
+		? VDO_COMPRESSION_FORMAT_ZSTD
+		: VDO_COMPRESSION_FORMAT_LZ4);
+}
+
+/**
+ * quarter_bit_log2() - Compute an approximate base 2 logarithm in units of
+ *                      quarter bits.
+ * @n: The value whose logarithm is wanted.
+ */
+static inline unsigned int quarter_bit_log2(u64 n)
+{
+	return ilog2(n * n * n * n);
+}
+
+/**
+ * vdo_is_block_incompressible() - Estimate whether a block of data is
+ *                                 worth compressing.
+ * @context: The compressor context of the current thread.
+ * @block: The block to examine.
+ *
+ * The estimate builds a histogram of a sample of the block and computes its
+ * Shannon entropy in integer arithmetic. Blocks whose sample uses few
+ * distinct byte values are always worth compressing. This only considers
+ * the distribution of byte values, so it can not see repeated strings, and
+ * some blocks which it deems incompressible will in fact compress.
+ *
+ * Return: true if the block is unlikely to compress.
+ */
+bool vdo_is_block_incompressible(struct compressor_context *context,
+				 const char *block)
+{
+	const u8 *data = (const u8 *) block;
+	unsigned int max_log = quarter_bit_log2(ENTROPY_SAMPLES);
+	unsigned int byte_set = 0;
+	u64 entropy = 0;
+	unsigned int offset;
+	unsigned int i;
+
+	memset(context->histogram, 0, sizeof(context->histogram));
+	for (offset = 0; offset < VDO_BLOCK_SIZE;
+	     offset += ENTROPY_SAMPLE_STRIDE) {
+		for (i = 0; i < ENTROPY_SAMPLE_SIZE; i++) {
+			context->histogram[data[offset + i]]++;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(context->histogram); i++) {
+		unsigned int count = context->histogram[i];
+
+		if (count == 0) {
+			continue;
+		}
+
+		byte_set++;
+		entropy += count * (max_log - quarter_bit_log2(count));
+	}
+
+	if (byte_set < ENTROPY_MIN_BYTE_SET) {
+		return false;
+	}
+
+	return ((entropy * 100) >= ((u64) ENTROPY_INCOMPRESSIBLE_PERCENT *
+				    ENTROPY_SAMPLES *
+				    ENTROPY_MAX_QUARTER_BITS));
+}
+
+/**
+ * vdo_audit_incompressible_prediction() - Check whether a block predicted to
+ *                                         be incompressible should be
+ *                                         compressed anyway.
+ * @context: The compressor context of the current thread.
+ *
+ * Compressing a fixed fraction of the predicted blocks measures how often
+ * the prediction is wrong.
+ *
+ * Return: true if the block should be compressed.
+ */
+bool vdo_audit_incompressible_prediction(struct compressor_context *context)
+{
+	if (--context->audit_countdown > 0) {
+		return false;
+	}
+
+	context->audit_countdown = ENTROPY_AUDIT_INTERVAL;
+	return true;
+}
+
+/**
+ * vdo_compress_block() - Compress a block of data.
+ * @context: The compressor context of the current thread.
+ * @type: The compression engine to use.
+ * @level: The compression level, which need not have been clamped.
+ * @block: The block to compress.
+ * @fragment: The buffer to receive the compressed fragment.
+ * @fragment_capacity: The size of the fragment buffer.
+ *
+ * An engine which is not available in the running kernel falls back to LZ4,
+ * so the format of the fragment must be determined with
+ * vdo_get_compression_format() on the same type as was passed here.
+ *
+ * Return: The size of the compressed fragment, or 0 if the block did not
+ *         compress to fit in the fragment buffer.
+ */
+int vdo_compress_block(struct compressor_context *context,
+		       enum vdo_compression_type type,
+		       int level,
+		       const char *block,
+		       char *fragment,
+		       int fragment_capacity)
+{
+	level = vdo_get_compression_level(type, level);
+	switch (type) {
+#if VDO_HAVE_LZ4HC
+	case VDO_COMPRESSION_LZ4HC:
+		return LZ4_compress_HC(block,
+				       fragment,
+				       VDO_BLOCK_SIZE,
+				       fragment_capacity,
+				       level,
+				       context->workspace);
+#endif
+
+#if VDO_HAVE_ZSTD
+	case VDO_COMPRESSION_ZSTD:
+	{
+		zstd_parameters parameters = get_zstd_parameters(level);
+		zstd_cctx *cctx = zstd_init_cctx(context->workspace,
+						 context->workspace_size);
+		size_t size;
+
+		if (cctx == NULL) {
+			return 0;
+		}
+
+		size = zstd_compress_cctx(cctx,
+					  fragment,
+					  fragment_capacity,
+					  block,
+					  VDO_BLOCK_SIZE,
+					  &parameters);
+		return (zstd_is_error(size) ? 0 : size);
+	}
+#endif
+
+	default:
+		return LZ4_compress_fast(block,
+					 fragment,
+					 VDO_BLOCK_SIZE,
+					 fragment_capacity,
+					 level,
+					 context->workspace);
+	}
+}
+
+/**
+ * vdo_decompress_fragment_prefix() - Decompress at least the start of a
+ *                                    compressed fragment.
+ * @context: The compressor context of the current thread.
+ * @format: The format of the fragment.
+ * @fragment: The fragment to decompress.
+ * @fragment_size: The size of the fragment.
+ * @block: The buffer to receive the decompressed data, which must be able to
+ *         hold a whole block.
+ * @prefix_size: The number of bytes from the start of the block needed.
+ * @decoded_ptr: A pointer to receive the number of bytes decoded, which is
+ *               either prefix_size or VDO_BLOCK_SIZE.
+ *
+ * LZ4 fragments are only decoded until the prefix has been produced, so a
+ * caller which only needs the start of a block does not pay to decode the
+ * rest of it. Fragments in other formats can't be decoded partially, so they
+ * are decompressed entirely, as are LZ4 fragments when recent prefixes have
+ * not been paying off (see vdo_record_fragment_probe()). The whole fragment
+ * is only checked for validity when the whole block is decoded.
+ *
+ * Return: VDO_SUCCESS or VDO_INVALID_FRAGMENT.
+ */
+int vdo_decompress_fragment_prefix(struct compressor_context *context,
+				   enum vdo_compression_format format,
+				   const char *fragment,
+				   int fragment_size,
+				   char *block,
+				   int prefix_size,
+				   int *decoded_ptr)
+{
+	if ((format == VDO_COMPRESSION_FORMAT_LZ4) &&
+	    (prefix_size < VDO_BLOCK_SIZE) &&
+	    (context->probe_score > 0)) {
+		int size = LZ4_decompress_safe_partial(fragment,
+						       block,
+						       fragment_size,
+						       prefix_size,
+						       VDO_BLOCK_SIZE);
+
+		*decoded_ptr = prefix_size;
+		return ((size >= prefix_size)
+			? VDO_SUCCESS
+			: VDO_INVALID_FRAGMENT);
+	}
+
+	*decoded_ptr = VDO_BLOCK_SIZE;
+	return vdo_decompress_fragment(context,
+				       format,
+				       fragment,
+				       fragment_size,
+				       block);
+}
+
+/**
+ * vdo_record_fragment_probe() - Record whether a fragment which was decoded
+ *                               to check it against a block matched.
+ * @context: The compressor context of the current thread.
+ * @matched: Whether the fragment matched the block.
+ *
+ * This decides whether vdo_decompress_fragment_prefix() decodes prefixes on
+ * this thread.
+ */
+void vdo_record_fragment_probe(struct compressor_context *context,
+			       bool matched)
+{
+	context->probe_score = clamp(context->probe_score +
+				     (matched ? -1 : PROBE_MISMATCH_WEIGHT),
+				     -PROBE_SCORE_LIMIT,
+				     PROBE_SCORE_LIMIT);
+}
+
+/**
+ * vdo_record_compression_latency() - Add the time taken to compress a block
+ *                                    to the moving average of a thread.
+ * @context: The compressor context of the current thread.
+ * @latency: The time taken, in nanoseconds.
+ *
+ * Only the context's own thread updates its average, so no atomic operation
+ * is needed; the store only has to be whole for concurrent readers.
+ */
+void vdo_record_compression_latency(struct compressor_context *context,
+				    u64 latency)
+{
+	s64 average = context->latency;
+
+	WRITE_ONCE(context->latency,
+		   average + (((s64) latency - average) / 8));
+}
+
+/**
+ * vdo_get_compression_latency() - Get the moving average time a thread has
+ *                                 taken to compress a block.
+ * @context: The compressor context of the thread.
+ *
+ * This may be called from any thread.
+ *
+ * Return: The average time, in nanoseconds, or 0 if the thread has not
+ *         compressed anything.
+ */
+u64 vdo_get_compression_latency(struct compressor_context *context)
+{
+	return READ_ONCE(context->latency);
+}
+
+/**
+ * vdo_decompress_fragment() - Decompress a compressed fragment.
+ * @context: The compressor context of the current thread.
+ * @format: The format of the fragment.
+ * @fragment: The fragment to decompress.
+ * @fragment_size: The size of the fragment.
+ * @block: The buffer to receive the decompressed block.
+ *
+ * Return: VDO_SUCCESS or VDO_INVALID_FRAGMENT.
+ */
+int vdo_decompress_fragment(struct compressor_context *context,
+			    enum vdo_compression_format format,
+			    const char *fragment,
+			    int fragment_size,
+			    char *block)
+{
+	if (format == VDO_COMPRESSION_FORMAT_LZ4) {
+		int size = LZ4_decompress_safe(fragment,
+					       block,
+					       fragment_size,
+					       VDO_BLOCK_SIZE);
+
+		return ((size == VDO_BLOCK_SIZE)
+			? VDO_SUCCESS
+			: VDO_INVALID_FRAGMENT);
+	}
+
+#if VDO_HAVE_ZSTD
+	if (format == VDO_COMPRESSION_FORMAT_ZSTD) {
+		zstd_dctx *dctx = zstd_init_dctx(context->workspace,
+						 context->workspace_size);
+		size_t size;
+
+		if (dctx == NULL) {
+			return VDO_INVALID_FRAGMENT;
+		}
+
+		size = zstd_decompress_dctx(dctx,
+					    block,
+					    VDO_BLOCK_SIZE,
+					    fragment,
+					    fragment_size);
+		return ((!zstd_is_error(size) && (size == VDO_BLOCK_SIZE))
+			? VDO_SUCCESS
+			: VDO_INVALID_FRAGMENT);
+	}
+#endif
+
+	uds_log_debug("%s: compressed fragment format %u is not supported",
+		      __func__,
+		      format);
+	return VDO_INVALID_FRAGMENT;
+}
@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright Red Hat
+ */
+
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include "compressed-block.h"
+#include "types.h"
+
+/*
+ * The compression engines which may be selected for a vdo. LZ4 and LZ4HC
+ * both produce fragments in the LZ4 format and differ only in how hard they
+ * work to do so.
+ */
+enum vdo_compression_type {
+	VDO_COMPRESSION_LZ4,
+	VDO_COMPRESSION_LZ4HC,
+	VDO_COMPRESSION_ZSTD,
+};
+
+/*
+ * A compression level of zero selects the default level of the compression
+ * engine. For LZ4 the level is the acceleration factor, so higher levels are
+ * faster and compress less; for LZ4HC and zstd, higher levels are slower and
+ * compress more.
+ */
+enum {
+	VDO_DEFAULT_COMPRESSION_LEVEL = 0,
+};
+
+/* The per-thread state needed to run any of the compression engines. */
+struct compressor_context;
+
+int __must_check
+vdo_make_compressor_context(struct compressor_context **context_ptr);
+
+void vdo_free_compressor_context(struct compressor_context *context);
+
+int __must_check
+vdo_parse_compression_type(const char *name,
+			   enum vdo_compression_type *type_ptr);
+
+const char * __must_check
+vdo_get_compression_type_name(enum vdo_compression_type type);
+
+int __must_check
+vdo_get_compression_level(enum vdo_compression_type type, int level);
+
+u32 __must_check
+vdo_pack_compression_setting(enum vdo_compression_type type, int level);
+
+void vdo_unpack_compression_setting(u32 setting,
+				    enum vdo_compression_type *type_ptr,
+				    int *level_ptr);
+
+bool vdo_downgrade_compression(enum vdo_compression_type *type_ptr,
+			       int *level_ptr);
+
+enum vdo_compression_format __must_check
+vdo_get_compression_format(enum vdo_compression_type type);
+
+bool __must_check
+vdo_is_block_incompressible(struct compressor_context *context,
+			    const char *block);
+
+bool __must_check
+vdo_audit_incompressible_prediction(struct compressor_context *context);
+
+void vdo_record_compression_latency(struct compressor_context *context,
+				    u64 latency);
+
+u64 __must_check
+vdo_get_compression_latency(struct compressor_context *context);
+
+int __must_check vdo_compress_block(struct compressor_context *context,
+				    enum vdo_compression_type type,
+				    int level,
+				    const char *block,
+				    char *fragment,
+				    int fragment_capacity);
+
+int __must_check
+vdo_decompress_fragment(struct compressor_context *context,
+			enum vdo_compression_format format,
+			const char *fragment,
+			int fragment_size,
+			char *block);
+
+int __must_check
+vdo_decompress_fragment_prefix(struct compressor_context *context,
+			       enum vdo_compression_format format,
+			       const char *fragment,
+			       int fragment_size,
+			       char *block,
+			       int prefix_size,
+			       int *decoded_ptr);
+
+void vdo_record_fragment_probe(struct compressor_context *context,
+			       bool matched);
+
+#endif /* COMPRESSOR_H */
@@ -11,7 +11,10 @@
 #include <linux/device-mapper.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
 #include <linux/sched.h>
 #include <linux/spinlock.h>
 #include <linux/wait.h>
@@ -73,10 +76,40 @@
  * permit, or doesn't need one and relaunched. If neither of these exist, the
  * data_vio is returned to the pool. Finally, if any waiting bios were
  * launched, the threads which blocked trying to submit them are awakened.
+ *
+ * In order to keep submitting threads from contending for the pool's lock on
+ * every bio, each cpu has a magazine of free data_vios and discard permits.
+ * A submitter first tries to take what it needs from the magazine of the cpu
+ * it is running on, which is protected by its own lock. Only if the magazine
+ * is empty does it go to the pool, and when it does, it also refills the
+ * magazine with up to DATA_VIO_MAGAZINE_BATCH_SIZE more resources. Resources
+ * in a magazine count as busy in their limiter, so the limits are never
+ * exceeded, but since they are not actually in use, they are left out of the
+ * maximum in use which the limiter reports. Magazines are only refilled while
+ * less than half of a limiter's resources are busy and no one is waiting; a
+ * submitter which would otherwise block first returns the contents of all the
+ * magazines to the pool, as does a drain.
+ *
+ * The request limit may optionally be adjusted to meet a target latency.
+ * When a target is set, the latency of each request, from launch until the
+ * data_vio is released, is recorded in a histogram by
+ * process_release_callback(). After every DATA_VIO_LATENCY_WINDOW requests,
+ * the 99th percentile latency is compared with the target. If it is over, the
+ * limit is cut by a quarter, otherwise it is raised by
+ * DATA_VIO_LIMIT_INCREMENT (additive increase, multiplicative decrease). The
+ * limit never leaves the range from DATA_VIO_MINIMUM_LIMIT to the size of the
+ * pool. This keeps the vdo from admitting more requests than it can service
+ * promptly, which would otherwise just queue in the hash zones and journals.
  */
 
 enum {
 	DATA_VIO_RELEASE_BATCH_SIZE = 128,
+	DATA_VIO_MAGAZINE_BATCH_SIZE = 16,
+	DATA_VIO_MAGAZINE_SIZE = 2 * DATA_VIO_MAGAZINE_BATCH_SIZE,
+	DATA_VIO_LATENCY_BUCKETS = 32,
+	DATA_VIO_LATENCY_WINDOW = 1024,
+	DATA_VIO_LIMIT_INCREMENT = 16,
+	DATA_VIO_MINIMUM_LIMIT = 128,
 };
 
 static const unsigned int VDO_SECTORS_PER_BLOCK_MASK =
@@ -121,6 +154,20 @@ struct limiter {
 	uint64_t arrival;
 };
 
+/*
+ * A per-cpu cache of resources which have already been taken from the pool.
+ */
+struct data_vio_magazine {
+	/* Lock protecting the magazine */
+	spinlock_t lock;
+	/* The number of data_vios in the magazine */
+	vio_count_t count;
+	/* The number of discard permits in the magazine */
+	vio_count_t discard_permits;
+	/* The data_vios in the magazine */
+	struct list_head data_vios;
+};
+
 /*
  * A data_vio_pool is a collection of preallocated data_vios which may be
  * acquired from any thread, and are released in batches.
@@ -147,6 +194,33 @@ struct data_vio_pool {
 	struct funnel_queue *queue;
 	/* Whether the pool is processing, or scheduled to process releases */
 	atomic_t processing;
+	/* The per-cpu magazines of free data_vios and discard permits */
+	struct data_vio_magazine __percpu *magazines;
+	/* Whether any magazine may hold resources */
+	bool magazines_loaded;
+	/*
+	 * The number of data_vios in use as of the end of the most recent
+	 * batch of releases
+	 */
+	vio_count_t recent_active;
+	/* The number of data_vios in the pool, which bounds the request limit */
+	vio_count_t size;
+	/*
+	 * The target 99th percentile request latency in microseconds, or 0 if
+	 * the request limit is fixed
+	 */
+	unsigned int latency_target;
+	/*
+	 * The number of requests in the current window whose latency in
+	 * microseconds had each binary order of magnitude
+	 */
+	unsigned int latency_histogram[DATA_VIO_LATENCY_BUCKETS];
+	/* The number of requests in the current window */
+	unsigned int latency_window_count;
+	/* The median latency of the last window, in microseconds */
+	unsigned int latency_p50;
+	/* The 99th percentile latency of the last window, in microseconds */
+	unsigned int latency_p99;
 	/* The data vios in the pool */
 	struct data_vio data_vios[];
 };
@@ -172,6 +246,207 @@ static inline uint64_t get_arrival_time(struct bio *bio)
 	return (uint64_t) bio->bi_private;
 }
 
+/**
+ * reclaim_magazines() - Return the contents of all the magazines to the pool.
+ * @pool: The pool, whose lock must be held.
+ */
+static void reclaim_magazines(struct data_vio_pool *pool)
+{
+	unsigned int cpu;
+
+	if (!pool->magazines_loaded) {
+		return;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct data_vio_magazine *magazine =
+			per_cpu_ptr(pool->magazines, cpu);
+
+		spin_lock(&magazine->lock);
+		list_splice_init(&magazine->data_vios, &pool->available);
+		WRITE_ONCE(pool->limiter.busy,
+			   pool->limiter.busy - magazine->count);
+		WRITE_ONCE(pool->discard_limiter.busy,
+			   (pool->discard_limiter.busy
+			    - magazine->discard_permits));
+		WRITE_ONCE(magazine->count, 0);
+		WRITE_ONCE(magazine->discard_permits, 0);
+		spin_unlock(&magazine->lock);
+	}
+
+	pool->magazines_loaded = false;
+}
+
+/**
+ * get_refill_count() - Get the number of resources which may be moved from a
+ *                      limiter to a magazine.
+ * @limiter: The limiter, whose pool's lock must be held.
+ * @room: The space remaining in the magazine.
+ *
+ * Return: The number of resources to move.
+ */
+static vio_count_t get_refill_count(struct limiter *limiter, vio_count_t room)
+{
+	vio_count_t threshold = limiter->limit / 2;
+
+	if ((limiter->busy >= threshold) ||
+	    !bio_list_empty(&limiter->waiters) ||
+	    !bio_list_empty(&limiter->new_waiters)) {
+		return 0;
+	}
+
+	return min3(threshold - limiter->busy,
+		    room,
+		    (vio_count_t) DATA_VIO_MAGAZINE_BATCH_SIZE);
+}
+
+/**
+ * refill_magazine() - Move free resources from the pool to the magazine of the
+ *                     current cpu if the pool is lightly loaded.
+ * @pool: The pool, whose lock must be held.
+ * @discard: Whether to refill discard permits as well as data_vios.
+ */
+static void refill_magazine(struct data_vio_pool *pool, bool discard)
+{
+	struct data_vio_magazine *magazine;
+	vio_count_t count;
+	vio_count_t permits = 0;
+	vio_count_t i;
+
+	if (!vdo_is_state_normal(&pool->state)) {
+		return;
+	}
+
+	magazine = raw_cpu_ptr(pool->magazines);
+	spin_lock(&magazine->lock);
+	count = get_refill_count(&pool->limiter,
+				 DATA_VIO_MAGAZINE_SIZE - magazine->count);
+	if (discard) {
+		permits = get_refill_count(&pool->discard_limiter,
+					   (DATA_VIO_MAGAZINE_SIZE
+					    - magazine->discard_permits));
+	}
+
+	for (i = 0; i < count; i++) {
+		list_move(pool->available.next, &magazine->data_vios);
+	}
+
+	WRITE_ONCE(magazine->count, magazine->count + count);
+	WRITE_ONCE(magazine->discard_permits,
+		   magazine->discard_permits + permits);
+	spin_unlock(&magazine->lock);
+
+	if ((count == 0) && (permits == 0)) {
+		return;
+	}
+
+	WRITE_ONCE(pool->limiter.busy, pool->limiter.busy + count);
+	WRITE_ONCE(pool->discard_limiter.busy,
+		   pool->discard_limiter.busy + permits);
+	pool->magazines_loaded = true;
+}
+
+/**
+ * get_data_vio_from_magazine() - Try to get the resources for a bio from the
+ *                                magazine of the current cpu.
+ * @pool: The pool.
+ * @bio: The bio which needs a data_vio.
+ *
+ * Return: A data_vio (and a discard permit if the bio is a discard), or NULL
+ *         if the magazine does not have what the bio needs.
+ */
+static struct data_vio *
+get_data_vio_from_magazine(struct data_vio_pool *pool, struct bio *bio)
+{
+	struct data_vio_magazine *magazine = raw_cpu_ptr(pool->magazines);
+	bool discard = (bio_op(bio) == REQ_OP_DISCARD);
+	struct data_vio *data_vio;
+
+	if (READ_ONCE(magazine->count) == 0) {
+		return NULL;
+	}
+
+	spin_lock(&magazine->lock);
+	if ((magazine->count == 0) ||
+	    (discard && (magazine->discard_permits == 0))) {
+		spin_unlock(&magazine->lock);
+		return NULL;
+	}
+
+	data_vio = list_first_entry(&magazine->data_vios,
+				    struct data_vio,
+				    pool_entry);
+	list_del_init(&data_vio->pool_entry);
+	WRITE_ONCE(magazine->count, magazine->count - 1);
+	if (discard) {
+		WRITE_ONCE(magazine->discard_permits,
+			   magazine->discard_permits - 1);
+	}
+
+	spin_unlock(&magazine->lock);
+	return data_vio;
+}
+
+/**
+ * get_active_count() - Get the number of resources of one type which are
+ *                      actually in use.
+ * @pool: The pool.
+ * @discards: Whether to count discard permits rather than data_vios.
+ *
+ * The resources in the magazines are counted as busy by their limiters, but
+ * are not in use. Since the magazines are read without the pool's lock, the
+ * result may be slightly stale.
+ *
+ * Return: The number of resources in use.
+ */
+static vio_count_t get_active_count(struct data_vio_pool *pool,
+				    bool discards)
+{
+	struct limiter *limiter = (discards ?
+				   &pool->discard_limiter :
+				   &pool->limiter);
+	vio_count_t busy = READ_ONCE(limiter->busy);
+	vio_count_t total = 0;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct data_vio_magazine *magazine =
+			per_cpu_ptr(pool->magazines, cpu);
+
+		total += (discards ?
+			  READ_ONCE(magazine->discard_permits) :
+			  READ_ONCE(magazine->count));
+	}
+
+	return ((busy > total) ? (busy - total) : 0);
+}
+
+/**
+ * update_max_busy() - Update the maximum number of resources of one type
+ *                     which have been in use at once.
+ * @limiter: The limiter, whose pool's lock must be held.
+ *
+ * Resources parked in the magazines are not in use, so they are not counted.
+ * Since the active count is only less than the busy count, the magazines
+ * need not be examined unless the busy count exceeds the current maximum.
+ */
+static void update_max_busy(struct limiter *limiter)
+{
+	struct data_vio_pool *pool = limiter->pool;
+	vio_count_t active;
+
+	if (limiter->max_busy >= limiter->busy) {
+		return;
+	}
+
+	active = (pool->magazines_loaded ?
+		  get_active_count(pool, (limiter == &pool->discard_limiter)) :
+		  limiter->busy);
+	if (limiter->max_busy < active) {
+		WRITE_ONCE(limiter->max_busy, active);
+	}
+}
+
 /**
  * check_for_drain_complete_locked() - Check whether a data_vio_pool
  *                                     has no outstanding data_vios or
@@ -254,7 +529,10 @@ static void launch_bio(struct vdo *vdo,
 	} else {
 		/*
 		 * Copy the bio data to a char array so that we can continue to
-		 * use the data after we acknowledge the bio.
+		 * use the data after we acknowledge the bio. The copy also
+		 * ensures that the data checked, hashed, compressed and
+		 * written are all the same, since the submitter may modify
+		 * its pages while the write is in flight.
 		 */
 		vdo_bio_copy_data_in(bio, data_vio->data_block);
 		data_vio->is_zero_block = is_zero_block(data_vio->data_block);
@@ -264,6 +542,10 @@ static void launch_bio(struct vdo *vdo,
 		operation |= DATA_VIO_FUA;
 	}
 
+	if (READ_ONCE(vdo->data_vio_pool->latency_target) > 0) {
+		data_vio->arrival = ktime_get_ns();
+	}
+
 	lbn = ((bio->bi_iter.bi_sector - vdo->starting_sector_offset)
 	       / VDO_SECTORS_PER_BLOCK);
 	launch_data_vio(data_vio, lbn, operation);
@@ -315,34 +597,27 @@ static void assign_data_vio_to_waiter(struct limiter *limiter)
 static void update_limiter(struct limiter *limiter)
 {
 	struct bio_list *waiters = &limiter->waiters;
-	vio_count_t available = limiter->limit - limiter->busy;
+	vio_count_t busy;
 
 	ASSERT_LOG_ONLY((limiter->release_count <= limiter->busy),
 			"Release count %u is not more than busy count %u",
 			limiter->release_count,
 			limiter->busy);
 
+	/*
+	 * The limit may have been lowered below the number of busy resources,
+	 * in which case no waiters are assigned until enough have been
+	 * released.
+	 */
 	get_waiters(limiter);
-	for (; (limiter->release_count > 0) && !bio_list_empty(waiters);
-	     limiter->release_count--) {
+	busy = limiter->busy - limiter->release_count;
+	limiter->release_count = 0;
+	for (; (busy < limiter->limit) && !bio_list_empty(waiters); busy++) {
 		limiter->assigner(limiter);
 	}
 
-	if (limiter->release_count > 0) {
-		WRITE_ONCE(limiter->busy,
-			   limiter->busy - limiter->release_count);
-		limiter->release_count = 0;
-		return;
-	}
-
-	for (; (available > 0) && !bio_list_empty(waiters); available--) {
-		limiter->assigner(limiter);
-	}
-
-	WRITE_ONCE(limiter->busy, limiter->limit - available);
-	if (limiter->max_busy < limiter->busy) {
-		WRITE_ONCE(limiter->max_busy, limiter->busy);
-	}
+	WRITE_ONCE(limiter->busy, busy);
+	update_max_busy(limiter);
 }
 
 /**
@@ -378,7 +653,21 @@ static void reuse_or_release_resources(struct data_vio_pool *pool,
 		}
 	}
 
-	if (pool->limiter.arrival < pool->discard_limiter.arrival) {
+	if ((pool->limiter.busy - pool->limiter.release_count) >
+	    pool->limiter.limit) {
+		/*
+		 * The limit has been lowered, so don't reuse the data_vio,
+		 * unless a discard already holds a permit and is waiting for
+		 * it. Shrinking past such a discard would leave its permit
+		 * tied up until the limit settles.
+		 */
+		if (pool->discard_limiter.arrival < UINT64_MAX) {
+			assign_data_vio(&pool->discard_limiter, data_vio);
+		} else {
+			list_add(&data_vio->pool_entry, returned);
+			pool->limiter.release_count++;
+		}
+	} else if (pool->limiter.arrival < pool->discard_limiter.arrival) {
 		assign_data_vio(&pool->limiter, data_vio);
 	} else if (pool->discard_limiter.arrival < UINT64_MAX) {
 		assign_data_vio(&pool->discard_limiter, data_vio);
@@ -388,6 +677,103 @@ static void reuse_or_release_resources(struct data_vio_pool *pool,
 	}
 }
 
+/**
+ * record_latency() - Record the latency of a request which is being released.
+ * @pool: The pool.
+ * @data_vio: The data_vio which serviced the request.
+ * @now: The current time in ns.
+ */
+static void record_latency(struct data_vio_pool *pool,
+			   struct data_vio *data_vio,
+			   uint64_t now)
+{
+	uint64_t latency;
+
+	if ((data_vio->arrival == 0) || (now < data_vio->arrival)) {
+		return;
+	}
+
+	latency = div_u64(now - data_vio->arrival, NSEC_PER_USEC);
+	pool->latency_histogram[min_t(unsigned int,
+				      ilog2(latency | 1),
+				      DATA_VIO_LATENCY_BUCKETS - 1)]++;
+	pool->latency_window_count++;
+}
+
+/**
+ * get_latency_percentile() - Get a percentile of the latencies in the current
+ *                            window.
+ * @pool: The pool.
+ * @percentile: The percentile to get.
+ *
+ * Return: The upper bound of the histogram bucket containing the percentile,
+ *         in microseconds.
+ */
+static unsigned int get_latency_percentile(struct data_vio_pool *pool,
+					   unsigned int percentile)
+{
+	unsigned int wanted = DIV_ROUND_UP(pool->latency_window_count *
+					   percentile,
+					   100);
+	unsigned int seen = 0;
+	unsigned int bucket;
+
+	for (bucket = 0; bucket < DATA_VIO_LATENCY_BUCKETS - 1; bucket++) {
+		seen += pool->latency_histogram[bucket];
+		if (seen >= wanted) {
+			break;
+		}
+	}
+
+	return ((2U << bucket) - 1);
+}
+
+/**
+ * adjust_request_limit() - Adjust the request limit once a window of latency
+ *                          measurements is complete.
+ * @pool: The pool, whose lock must be held.
+ */
+static void adjust_request_limit(struct data_vio_pool *pool)
+{
+	struct limiter *limiter = &pool->limiter;
+	unsigned int target = READ_ONCE(pool->latency_target);
+	vio_count_t limit = limiter->limit;
+
+	if (target == 0) {
+		if (pool->latency_window_count > 0) {
+			memset(pool->latency_histogram,
+			       0,
+			       sizeof(pool->latency_histogram));
+			pool->latency_window_count = 0;
+		}
+
+		return;
+	}
+
+	if (pool->latency_window_count < DATA_VIO_LATENCY_WINDOW) {
+		return;
+	}
+
+	WRITE_ONCE(pool->latency_p50, get_latency_percentile(pool, 50));
+	WRITE_ONCE(pool->latency_p99, get_latency_percentile(pool, 99));
+	memset(pool->latency_histogram, 0, sizeof(pool->latency_histogram));
+	pool->latency_window_count = 0;
+
+	if (pool->latency_p99 > target) {
+		limit -= limit / 4;
+	} else {
+		limit += DATA_VIO_LIMIT_INCREMENT;
+	}
+
+	WRITE_ONCE(limiter->limit,
+		   clamp_t(vio_count_t,
+			   limit,
+			   min_t(vio_count_t,
+				 DATA_VIO_MINIMUM_LIMIT,
+				 pool->size),
+			   pool->size));
+}
+
 /**
  * process_release_callback() - Process a batch of data_vio releases.
  * @completion: The pool with data_vios to release.
@@ -400,6 +786,7 @@ static void process_release_callback(struct vdo_completion *completion)
 	vio_count_t processed;
 	vio_count_t to_wake;
 	vio_count_t discards_to_wake;
+	uint64_t now = 0;
 	LIST_HEAD(returned);
 
 	spin_lock(&pool->lock);
@@ -415,6 +802,10 @@ static void process_release_callback(struct vdo_completion *completion)
 		}
 	}
 
+	if (READ_ONCE(pool->latency_target) > 0) {
+		now = ktime_get_ns();
+	}
+
 	for (processed = 0;
 	     processed < DATA_VIO_RELEASE_BATCH_SIZE;
 	     processed++) {
@@ -427,6 +818,10 @@ static void process_release_callback(struct vdo_completion *completion)
 		}
 
 		data_vio = data_vio_from_funnel_queue_entry(entry);
+		if (now > 0) {
+			record_latency(pool, data_vio, now);
+		}
+
 		acknowledge_data_vio(data_vio);
 		reuse_or_release_resources(pool, data_vio, &returned);
 	}
@@ -441,6 +836,7 @@ static void process_release_callback(struct vdo_completion *completion)
 	 */
 	update_limiter(&pool->discard_limiter);
 	list_splice(&returned, &pool->available);
+	adjust_request_limit(pool);
 	update_limiter(&pool->limiter);
 	to_wake = pool->limiter.wake_count;
 	pool->limiter.wake_count = 0;
@@ -457,6 +853,12 @@ static void process_release_callback(struct vdo_completion *completion)
 		   && check_for_drain_complete_locked(pool));
 	spin_unlock(&pool->lock);
 
+	/*
+	 * Sample the active count here, where it costs one walk of the
+	 * magazines per batch, for readers which can not afford the walk.
+	 */
+	WRITE_ONCE(pool->recent_active, get_active_count(pool, false));
+
 	if (to_wake > 0) {
 		wake_up_nr(&pool->limiter.blocked_threads, to_wake);
 	}
@@ -501,6 +903,7 @@ int make_data_vio_pool(struct vdo *vdo,
 	int result;
 	struct data_vio_pool *pool;
 	vio_count_t i;
+	unsigned int cpu;
 
 	result = UDS_ALLOCATE_EXTENDED(struct data_vio_pool,
 				       pool_size,
@@ -523,6 +926,7 @@ int make_data_vio_pool(struct vdo *vdo,
 			   assign_data_vio_to_waiter,
 			   pool_size);
 	pool->limiter.permitted_waiters = &pool->limiter.waiters;
+	pool->size = pool_size;
 	INIT_LIST_HEAD(&pool->available);
 	spin_lock_init(&pool->lock);
 	vdo_set_admin_state_code(&pool->state,
@@ -542,6 +946,20 @@ int make_data_vio_pool(struct vdo *vdo,
 		return result;
 	}
 
+	pool->magazines = alloc_percpu(struct data_vio_magazine);
+	if (pool->magazines == NULL) {
+		free_data_vio_pool(UDS_FORGET(pool));
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct data_vio_magazine *magazine =
+			per_cpu_ptr(pool->magazines, cpu);
+
+		spin_lock_init(&magazine->lock);
+		INIT_LIST_HEAD(&magazine->data_vios);
+	}
+
 	for (i = 0; i < pool_size; i++) {
 		struct data_vio *data_vio = &pool->data_vios[i];
 
@@ -578,6 +996,10 @@ void free_data_vio_pool(struct data_vio_pool *pool)
 	BUG_ON(atomic_read(&pool->processing));
 
 	spin_lock(&pool->lock);
+	if (pool->magazines != NULL) {
+		reclaim_magazines(pool);
+	}
+
 	ASSERT_LOG_ONLY((pool->limiter.busy == 0),
 			"data_vio pool must not have %u busy entries when being freed",
 			pool->limiter.busy);
@@ -598,12 +1020,24 @@ void free_data_vio_pool(struct data_vio_pool *pool)
 		destroy_data_vio(data_vio);
 	}
 
+	if (pool->magazines != NULL) {
+		free_percpu(UDS_FORGET(pool->magazines));
+	}
+
 	free_funnel_queue(UDS_FORGET(pool->queue));
 	UDS_FREE(pool);
 }
 
 static bool acquire_permit(struct limiter *limiter, struct bio *bio)
 {
+	if (limiter->busy >= limiter->limit) {
+		/*
+		 * Some of the busy resources may only be sitting in
+		 * magazines, so take them back before deciding to block.
+		 */
+		reclaim_magazines(limiter->pool);
+	}
+
 	if (limiter->busy >= limiter->limit) {
 		DEFINE_WAIT(wait);
 
@@ -618,10 +1052,7 @@ static bool acquire_permit(struct limiter *limiter, struct bio *bio)
 	}
 
 	WRITE_ONCE(limiter->busy, limiter->busy + 1);
-	if (limiter->max_busy < limiter->busy) {
-		WRITE_ONCE(limiter->max_busy, limiter->busy);
-	}
-
+	update_max_busy(limiter);
 	return true;
 }
 
@@ -631,19 +1062,26 @@ static bool acquire_permit(struct limiter *limiter, struct bio *bio)
  * @pool: The pool from which to acquire a data_vio.
  * @bio: The bio to launch.
  *
- * This will block if data_vios or discard permits are not available.
+ * This will block if data_vios or discard permits are not available. The
+ * magazine of the current cpu is tried before the pool itself.
  */
 void vdo_launch_bio(struct data_vio_pool *pool, struct bio *bio)
 {
 	struct data_vio *data_vio;
+	bool discard = (bio_op(bio) == REQ_OP_DISCARD);
 
 	ASSERT_LOG_ONLY(!vdo_is_state_quiescent(&pool->state),
 			"data_vio_pool not quiescent on acquire");
 
 	bio->bi_private = (void *) jiffies;
+	data_vio = get_data_vio_from_magazine(pool, bio);
+	if (data_vio != NULL) {
+		launch_bio(pool->completion.vdo, data_vio, bio);
+		return;
+	}
+
 	spin_lock(&pool->lock);
-	if ((bio_op(bio) == REQ_OP_DISCARD) &&
-	    !acquire_permit(&pool->discard_limiter, bio)) {
+	if (discard && !acquire_permit(&pool->discard_limiter, bio)) {
 		return;
 	}
 
@@ -652,6 +1090,7 @@ void vdo_launch_bio(struct data_vio_pool *pool, struct bio *bio)
 	}
 
 	data_vio = get_available_data_vio(pool);
+	refill_magazine(pool, discard);
 	spin_unlock(&pool->lock);
 	launch_bio(pool->completion.vdo, data_vio, bio);
 }
@@ -683,6 +1122,7 @@ static void initiate_drain(struct admin_state *state)
 						  state);
 
 	spin_lock(&pool->lock);
+	reclaim_magazines(pool);
 	drained = check_for_drain_complete_locked(pool);
 	spin_unlock(&pool->lock);
 
@@ -781,7 +1221,7 @@ void dump_data_vio_pool(struct data_vio_pool *pool, bool dump_vios)
 
 vio_count_t get_data_vio_pool_active_discards(struct data_vio_pool *pool)
 {
-	return READ_ONCE(pool->discard_limiter.busy);
+	return get_active_count(pool, true);
 }
 
 vio_count_t get_data_vio_pool_discard_limit(struct data_vio_pool *pool)
@@ -797,7 +1237,7 @@ vio_count_t get_data_vio_pool_maximum_discards(struct data_vio_pool *pool)
 int set_data_vio_pool_discard_limit(struct data_vio_pool *pool,
 				    vio_count_t limit)
 {
-	if (get_data_vio_pool_request_limit(pool) < limit) {
+	if (pool->size < limit) {
 		// The discard limit may not be higher than the data_vio limit.
 		return -EINVAL;
 	}
@@ -811,7 +1251,25 @@ int set_data_vio_pool_discard_limit(struct data_vio_pool *pool,
 
 vio_count_t get_data_vio_pool_active_requests(struct data_vio_pool *pool)
 {
-	return READ_ONCE(pool->limiter.busy);
+	return get_active_count(pool, false);
+}
+
+/**
+ * get_data_vio_pool_recent_active_requests() - Get the number of data_vios
+ *                                              in use as of the last batch
+ *                                              of releases.
+ * @pool: The pool.
+ *
+ * Unlike get_data_vio_pool_active_requests(), this does not examine the
+ * per-cpu magazines, so it is cheap enough to call on every packer timer
+ * start, at the cost of lagging behind by up to one batch of releases.
+ *
+ * Return: The number of data_vios in use.
+ */
+vio_count_t
+get_data_vio_pool_recent_active_requests(struct data_vio_pool *pool)
+{
+	return READ_ONCE(pool->recent_active);
 }
 
 vio_count_t get_data_vio_pool_request_limit(struct data_vio_pool *pool)
@@ -823,3 +1281,38 @@ vio_count_t get_data_vio_pool_maximum_requests(struct data_vio_pool *pool)
 {
 	return READ_ONCE(pool->limiter.max_busy);
 }
+
+unsigned int get_data_vio_pool_latency_target(struct data_vio_pool *pool)
+{
+	return READ_ONCE(pool->latency_target);
+}
+
+/**
+ * set_data_vio_pool_latency_target() - Set the target request latency.
+ * @pool: The pool.
+ * @target: The target 99th percentile latency in microseconds, or 0 to use
+ *          the full size of the pool as a fixed request limit.
+ */
+void set_data_vio_pool_latency_target(struct data_vio_pool *pool,
+				      unsigned int target)
+{
+	spin_lock(&pool->lock);
+	WRITE_ONCE(pool->latency_target, target);
+	if (target == 0) {
+		WRITE_ONCE(pool->limiter.limit, pool->size);
+		WRITE_ONCE(pool->latency_p50, 0);
+		WRITE_ONCE(pool->latency_p99, 0);
+	}
+
+	spin_unlock(&pool->lock);
+}
+
+unsigned int get_data_vio_pool_latency_p50(struct data_vio_pool *pool)
+{
+	return READ_ONCE(pool->latency_p50);
+}
+
+unsigned int get_data_vio_pool_latency_p99(struct data_vio_pool *pool)
+{
+	return READ_ONCE(pool->latency_p99);
+}
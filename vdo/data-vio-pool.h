@@ -37,7 +37,14 @@ vio_count_t get_data_vio_pool_maximum_discards(struct data_vio_pool *pool);
 int __must_check set_data_vio_pool_discard_limit(struct data_vio_pool *pool,
 						 vio_count_t limit);
 vio_count_t get_data_vio_pool_active_requests(struct data_vio_pool *pool);
+vio_count_t
+get_data_vio_pool_recent_active_requests(struct data_vio_pool *pool);
 vio_count_t get_data_vio_pool_request_limit(struct data_vio_pool *pool);
 vio_count_t get_data_vio_pool_maximum_requests(struct data_vio_pool *pool);
+unsigned int get_data_vio_pool_latency_target(struct data_vio_pool *pool);
+void set_data_vio_pool_latency_target(struct data_vio_pool *pool,
+				      unsigned int target);
+unsigned int get_data_vio_pool_latency_p50(struct data_vio_pool *pool);
+unsigned int get_data_vio_pool_latency_p99(struct data_vio_pool *pool);
 
 #endif // DATA_VIO_POOL_H
@@ -5,7 +5,7 @@
 
 #include "data-vio.h"
 
-#include <linux/lz4.h>
+#include <linux/ktime.h>
 
 #include "memory-alloc.h"
 #include "permassert.h"
@@ -16,6 +16,7 @@
 #include "block-map.h"
 #include "compressed-block.h"
 #include "compression-state.h"
+#include "compressor.h"
 #include "dump.h"
 #include "int-map.h"
 #include "logical-zone.h"
@@ -145,13 +146,31 @@ static void initialize_lbn_lock(struct data_vio *data_vio,
 
 	lock->lbn = lbn;
 	lock->locked = false;
+	lock->coalescing = false;
 	initialize_wait_queue(&lock->waiters);
+	initialize_wait_queue(&lock->coalesced);
 	zone_number = vdo_compute_logical_zone(data_vio);
 	lock->zone = &vdo->logical_zones->zones[zone_number];
 }
 
 void attempt_logical_block_lock(struct vdo_completion *completion);
 
+/**
+ * is_coalescible_write() - Check whether a data_vio is a partial write which
+ *                          may be merged with others to the same block.
+ * @data_vio: The data_vio to check.
+ *
+ * Discards and FUA writes are never merged.
+ *
+ * Return: true if the data_vio may be merged.
+ */
+static bool is_coalescible_write(struct data_vio *data_vio)
+{
+	return (is_read_modify_write_data_vio(data_vio) &&
+		(data_vio->remaining_discard == 0) &&
+		!data_vio_requires_fua(data_vio));
+}
+
 /**
  * launch_data_vio() - (Re)initialize a data_vio to have a new logical
  *                     block number, keeping the same parent and other
@@ -175,6 +194,8 @@ void launch_data_vio(struct data_vio *data_vio,
 	initialize_lbn_lock(data_vio, lbn);
 	INIT_LIST_HEAD(&data_vio->hash_lock_entry);
 	INIT_LIST_HEAD(&data_vio->write_entry);
+	INIT_HLIST_NODE(&data_vio->shared_read_entry);
+	initialize_wait_queue(&data_vio->shared_readers);
 
 	memset(&data_vio->allocation, 0, sizeof(data_vio->allocation));
 
@@ -340,6 +361,7 @@ int set_data_vio_mapped_location(struct data_vio *data_vio,
 static void launch_locked_request(struct data_vio *data_vio)
 {
 	data_vio->logical.locked = true;
+	data_vio->logical.coalescing = is_coalescible_write(data_vio);
 
 	if (is_write_data_vio(data_vio)) {
 		launch_write_data_vio(data_vio);
@@ -413,7 +435,27 @@ void attempt_logical_block_lock(struct vdo_completion *completion)
 		return;
 	}
 
+	/*
+	 * If the lock holder is a partial write which has not yet merged its
+	 * data into the block it read, and no one else is waiting for it, a
+	 * partial write can be merged into it. The merged write will complete
+	 * when the lock holder does.
+	 */
 	data_vio->last_async_operation = VIO_ASYNC_OP_ATTEMPT_LOGICAL_BLOCK_LOCK;
+	if (lock_holder->logical.coalescing &&
+	    is_coalescible_write(data_vio) &&
+	    !has_waiters(&lock_holder->logical.waiters)) {
+		result = enqueue_data_vio(&lock_holder->logical.coalesced,
+					  data_vio);
+		if (result != VDO_SUCCESS) {
+			finish_data_vio(data_vio, result);
+			return;
+		}
+
+		atomic64_inc(&vdo->stats.partial_writes_coalesced);
+		return;
+	}
+
 	result = enqueue_data_vio(&lock_holder->logical.waiters,
 				  data_vio);
 	if (result != VDO_SUCCESS) {
@@ -427,9 +469,7 @@ void attempt_logical_block_lock(struct vdo_completion *completion)
 	 */
 	if (!is_read_data_vio(lock_holder) &&
 	    cancel_vio_compression(lock_holder)) {
-		data_vio->compression.lock_holder = lock_holder;
-		launch_data_vio_packer_callback(data_vio,
-						vdo_remove_lock_holder_from_packer);
+		vdo_remove_lock_holder_from_packer(data_vio, lock_holder);
 	}
 }
 
@@ -465,10 +505,26 @@ static void release_lock(struct data_vio *data_vio)
 	return;
 }
 
+/**
+ * finish_coalesced_write() - Finish a partial write which was merged into
+ *                            another.
+ * @waiter: The merged data_vio.
+ * @context: A pointer to the result of the data_vio into which it was merged.
+ *
+ * Implements waiter_callback.
+ */
+static void finish_coalesced_write(struct waiter *waiter, void *context)
+{
+	finish_data_vio(waiter_as_data_vio(waiter), *((int *) context));
+}
+
 /**
  * vdo_release_logical_block_lock() - Release the lock on the logical block,
  *                                    if any, that a data_vio has acquired.
  * @data_vio: The data_vio releasing its logical block lock.
+ *
+ * Any partial writes which were merged into the data_vio are finished with
+ * its result.
  */
 void vdo_release_logical_block_lock(struct data_vio *data_vio)
 {
@@ -477,6 +533,14 @@ void vdo_release_logical_block_lock(struct data_vio *data_vio)
 	int result;
 
 	assert_data_vio_in_logical_zone(data_vio);
+	lock->coalescing = false;
+	if (has_waiters(&lock->coalesced)) {
+		result = data_vio_as_completion(data_vio)->result;
+		notify_all_waiters(&lock->coalesced,
+				   finish_coalesced_write,
+				   &result);
+	}
+
 	if (!has_waiters(&data_vio->logical.waiters)) {
 		release_lock(data_vio);
 		return;
@@ -549,10 +613,23 @@ void data_vio_allocate_data_block(struct data_vio *data_vio,
 	ASSERT_LOG_ONLY((allocation->pbn == VDO_ZERO_BLOCK),
 			"data_vio does not have an allocation");
 	allocation->write_lock_type = write_lock_type;
-	allocation->first_allocation_zone =
-		vdo_get_next_allocation_zone(selector);
+	if (write_lock_type == VIO_BLOCK_MAP_WRITE_LOCK) {
+		allocation->stream = 0;
+		allocation->first_allocation_zone =
+			vdo_get_next_allocation_zone(selector,
+						     vdo->physical_zones);
+	} else {
+		const struct allocation_stream *stream =
+			vdo_get_allocation_stream(selector,
+						  vdo->physical_zones,
+						  data_vio->logical.lbn);
+
+		allocation->stream = stream->id;
+		allocation->first_allocation_zone = stream->zone;
+	}
 	allocation->zone =
 		&vdo->physical_zones->zones[allocation->first_allocation_zone];
+	atomic_inc(&allocation->zone->pending_allocations);
 
 	data_vio_as_completion(data_vio)->error_handler = error_handler;
 	launch_data_vio_allocated_zone_callback(data_vio, callback);
@@ -602,31 +679,71 @@ void acknowledge_data_vio(struct data_vio *data_vio)
 /**
  * compress_data_vio() - A function to compress the data in a data_vio.
  * @data_vio: The data_vio to compress.
+ *
+ * Blocks whose sampled entropy predicts that they will not compress are not
+ * compressed, except for a fraction of them which are compressed in order to
+ * count how often that prediction is wrong. When the cpu threads are over
+ * their compression budget, a faster compression setting is used.
  */
 void compress_data_vio(struct data_vio *data_vio)
 {
 	int size;
-	char *context = get_work_queue_private_data();
+	u64 start;
+	struct compressor_context *context = get_work_queue_private_data();
+	struct vdo *vdo = vdo_from_data_vio(data_vio);
+	struct atomic_compression_stats *stats = &vdo->stats.compression;
+	enum vdo_compression_type type;
+	int level;
+	bool audited = false;
+
+	vdo_unpack_compression_setting(READ_ONCE(vdo->compression_setting),
+				       &type,
+				       &level);
+
+	/*
+	 * Use block size plus one as an indicator for uncompressible data.
+	 */
+	data_vio->compression.size = VDO_BLOCK_SIZE + 1;
+	if (vdo_is_block_incompressible(context, data_vio->data_block)) {
+		if (!vdo_audit_incompressible_prediction(context)) {
+			atomic64_inc(&stats->entropy_skipped);
+			return;
+		}
+
+		audited = true;
+		atomic64_inc(&stats->entropy_audited);
+	}
+
+	if (vdo_should_downgrade_compression(vdo, context) &&
+	    vdo_downgrade_compression(&type, &level)) {
+		atomic64_inc(&stats->downgraded);
+	}
 
 	/*
          * By putting the compressed data at the start of the compressed
          * block data field, we won't need to copy it if this data_vio
          * becomes a compressed write agent.
          */
-	size = LZ4_compress_default(data_vio->data_block,
-				    data_vio->compression.block->data,
-				    VDO_BLOCK_SIZE,
-				    VDO_MAX_COMPRESSED_FRAGMENT_SIZE,
-				    context);
-	if (size > 0) {
-		data_vio->compression.size = size;
-	} else {
-		/*
-		 * Use block size plus one as an indicator for uncompressible
-		 * data.
-		 */
-		data_vio->compression.size = VDO_BLOCK_SIZE + 1;
+	start = ktime_get_ns();
+	size = vdo_compress_block(context,
+				  type,
+				  level,
+				  data_vio->data_block,
+				  data_vio->compression.block->data,
+				  VDO_MAX_COMPRESSED_FRAGMENT_SIZE);
+	vdo_record_compression_latency(context, ktime_get_ns() - start);
+	atomic64_inc(&stats->compressed);
+	data_vio->compression.format = vdo_get_compression_format(type);
+	if (size <= 0) {
+		atomic64_inc(&stats->failures);
+		return;
+	}
+
+	if (audited) {
+		atomic64_inc(&stats->entropy_mispredicted);
 	}
+
+	data_vio->compression.size = size;
 }
 
 /**
@@ -640,11 +757,38 @@ int uncompress_data_vio(struct data_vio *data_vio,
 			enum block_mapping_state mapping_state,
 			char *buffer)
 {
-	int size;
+	int decoded;
+
+	return uncompress_data_vio_prefix(data_vio,
+					  mapping_state,
+					  buffer,
+					  VDO_BLOCK_SIZE,
+					  &decoded);
+}
+
+/**
+ * uncompress_data_vio_prefix() - Uncompress at least the start of the data a
+ *                                data_vio has just read.
+ * @data_vio: The data_vio to uncompress.
+ * @mapping_state: The mapping state indicating which fragment to decompress.
+ * @buffer: The buffer to receive the uncompressed data, which must be able to
+ *          hold a whole block.
+ * @prefix_size: The number of bytes from the start of the block needed.
+ * @decoded_ptr: A pointer to receive the number of bytes actually decoded,
+ *               which is either prefix_size or VDO_BLOCK_SIZE.
+ */
+int uncompress_data_vio_prefix(struct data_vio *data_vio,
+			       enum block_mapping_state mapping_state,
+			       char *buffer,
+			       int prefix_size,
+			       int *decoded_ptr)
+{
+	enum vdo_compression_format format;
 	uint16_t fragment_offset, fragment_size;
 	struct compressed_block *block = data_vio->compression.block;
 	int result = vdo_get_compressed_block_fragment(mapping_state,
 						       block,
+						       &format,
 						       &fragment_offset,
 						       &fragment_size);
 
@@ -655,27 +799,64 @@ int uncompress_data_vio(struct data_vio *data_vio,
 		return result;
 	}
 
-	size = LZ4_decompress_safe((block->data + fragment_offset),
-				   buffer,
-				   fragment_size,
-				   VDO_BLOCK_SIZE);
-	if (size != VDO_BLOCK_SIZE) {
-		uds_log_debug("%s: lz4 error", __func__);
-		return VDO_INVALID_FRAGMENT;
+	result = vdo_decompress_fragment_prefix(get_work_queue_private_data(),
+						format,
+						(block->data + fragment_offset),
+						fragment_size,
+						buffer,
+						prefix_size,
+						decoded_ptr);
+	if (result != VDO_SUCCESS) {
+		uds_log_debug("%s: decompression error", __func__);
+		return result;
 	}
 
 	return VDO_SUCCESS;
 }
 
+/*
+ * The number of 64-bit words examined between early exit checks when scanning
+ * a block. Accumulating a cache line at a time without branching lets the
+ * compiler keep the loop tight while still bailing out quickly on the common
+ * case of a block which is not zero.
+ */
+enum {
+	WORDS_PER_SCAN_STEP = 8,
+};
+
 /* Return true if a data block contains all zeros. */
 bool is_zero_block(char *block)
 {
-	int i;
+	const uint64_t *words = (const uint64_t *) block;
+	uint64_t bits = 0;
+	unsigned int i;
 
+	/* Most non-zero blocks are non-zero at the start. */
+	if (words[0] != 0) {
+		return false;
+	}
 
-	for (i = 0; i < VDO_BLOCK_SIZE; i += sizeof(uint64_t)) {
-		if (*((uint64_t *) &block[i]))
+	for (i = 1; i < WORDS_PER_SCAN_STEP; i++) {
+		bits |= words[i];
+	}
+
+	if (bits != 0) {
+		return false;
+	}
+
+	for (i = WORDS_PER_SCAN_STEP;
+	     i < VDO_BLOCK_SIZE / sizeof(uint64_t);
+	     i += WORDS_PER_SCAN_STEP) {
+		unsigned int j;
+
+		for (j = 0; j < WORDS_PER_SCAN_STEP; j++) {
+			bits |= words[i + j];
+		}
+
+		if (bits != 0) {
 			return false;
+		}
 	}
+
 	return true;
 }
@@ -77,6 +77,13 @@ struct lbn_lock {
 	bool locked;
 	/* The queue of waiters for the lock */
 	struct wait_queue waiters;
+	/*
+	 * Whether partial writes to the LBN may still be merged into this
+	 * read-modify-write
+	 */
+	bool coalescing;
+	/* The partial writes which have been merged into this one */
+	struct wait_queue coalesced;
 	/* The logical zone of the LBN */
 	struct logical_zone *zone;
 };
@@ -129,6 +136,9 @@ struct compression_state {
 	/* The compressed size of this block */
 	uint16_t size;
 
+	/* The format in which this block was compressed */
+	enum vdo_compression_format format;
+
 	/*
 	 * The packer input or output bin slot which holds the enclosing
 	 * data_vio
@@ -173,6 +183,9 @@ struct allocation {
 	/* The type of write lock to obtain on the allocated block */
 	enum pbn_lock_type write_lock_type;
 
+	/* The id of the write stream of the allocation, 0 if none */
+	uint64_t stream;
+
 	/* The zone which was the start of the current allocation cycle */
 	zone_count_t first_allocation_zone;
 
@@ -253,6 +266,19 @@ struct data_vio {
 	 */
 	struct zoned_pbn duplicate;
 
+	/* Whether the chunk name is a SHA-256 digest of the data */
+	bool trusted_name;
+
+	/*
+	 * Whether the advice may be trusted without reading the duplicate,
+	 * provided that the duplicate has not been freed since the advice was
+	 * recorded
+	 */
+	bool trusted_advice;
+
+	/* The advice epoch of the duplicate when the advice was recorded */
+	uint32_t advice_epoch;
+
 	/*
 	 * The sequence number of the recovery journal block containing the
 	 * increment entry for this vio.
@@ -296,6 +322,21 @@ struct data_vio {
 
 	struct dedupe_context *dedupe_context;
 
+	/*
+	 * The entry in the table of shared reads while this data_vio is
+	 * reading its mapped block from storage
+	 */
+	struct hlist_node shared_read_entry;
+
+	/* The data_vios waiting for this data_vio's read of its mapped block */
+	struct wait_queue shared_readers;
+
+	/*
+	 * The time (in ns) at which this data_vio was launched, if the pool is
+	 * measuring request latency, otherwise 0
+	 */
+	uint64_t arrival;
+
 	/*
 	 * Fields beyond this point will not be reset when a pooled data_vio
 	 * is reused.
@@ -889,20 +930,23 @@ launch_data_vio_journal_callback(struct data_vio *data_vio,
 
 /**
  * assert_data_vio_in_packer_zone() - Check that a data_vio is running on the
- *                                    packer thread.
+ *                                    thread of its packer.
  * @data_vio: The data_vio in question.
+ *
+ * Each data_vio is packed by the packer of its allocated zone.
  */
 static inline void assert_data_vio_in_packer_zone(struct data_vio *data_vio)
 {
-	thread_id_t packer_thread =
-		get_thread_config_from_data_vio(data_vio)->packer_thread;
+	zone_count_t zone = data_vio->allocation.zone->zone_number;
+	thread_id_t expected =
+		get_thread_config_from_data_vio(data_vio)->packer_threads[zone];
 	thread_id_t thread_id = vdo_get_callback_thread_id();
 
-	ASSERT_LOG_ONLY((packer_thread == thread_id),
+	ASSERT_LOG_ONLY((expected == thread_id),
 			"data_vio for logical block %llu on thread %u, should be on packer thread %u",
 			(unsigned long long) data_vio->logical.lbn,
 			thread_id,
-			packer_thread);
+			expected);
 }
 
 /**
@@ -914,8 +958,10 @@ static inline void
 set_data_vio_packer_callback(struct data_vio *data_vio,
 			     vdo_action *callback)
 {
+	zone_count_t zone = data_vio->allocation.zone->zone_number;
 	thread_id_t packer_thread =
-		get_thread_config_from_data_vio(data_vio)->packer_thread;
+		get_thread_config_from_data_vio(data_vio)->packer_threads[zone];
+
 	vdo_set_completion_callback(data_vio_as_completion(data_vio),
 				    callback,
 				    packer_thread);
@@ -1119,6 +1165,13 @@ int __must_check uncompress_data_vio(struct data_vio *data_vio,
 				     enum block_mapping_state mapping_state,
 				     char *buffer);
 
+int __must_check
+uncompress_data_vio_prefix(struct data_vio *data_vio,
+			   enum block_mapping_state mapping_state,
+			   char *buffer,
+			   int prefix_size,
+			   int *decoded_ptr);
+
 /**
  * Prepare a data_vio's vio and bio to submit I/O.
  *
@@ -48,6 +48,16 @@
  * new copy of the data to a full data block or a slot in a compressed block
  * (WRITING).
  *
+ * When trusted dedupe is enabled, blocks are named by SHA-256 digests, and
+ * the advice recorded for them also records the advice epoch of the advised
+ * block. Each epoch is a counter shared by many physical blocks which is
+ * advanced whenever one of them is freed. Since a block can not be rewritten
+ * without first being freed, if the epoch of the advised block is unchanged
+ * once its PBN lock is held, the block still holds the data it held when the
+ * advice was recorded, and the lock skips VERIFYING. The epochs are not
+ * saved, so advice also records a random tag for the load which recorded it,
+ * and advice from other loads is always verified.
+ *
  * Cleaning up consists of updating the index when the data location is
  * different from the initial index query (UPDATING, triggered by stale
  * advice, compression, and rollover), releasing the PBN lock on the duplicate
@@ -108,13 +118,17 @@
  * When a hash_lock needs to query the index, it attempts to acquire an unused
  * dedupe_context from its hash_zone's pool. If one is available, that context
  * is prepared, associated with the hash_lock's agent, added to the list of
- * pending contexts, and then sent to the index. The context's state will be
- * transitioned from DEDUPE_CONTEXT_IDLE to DEDUPE_CONTEXT_PENDING. If all goes
- * well, the dedupe callback will be called by the index which will change the
- * context's state to DEDUPE_CONTEXT_COMPLETE, and the associated data_vio will
- * be enqueued to run back in the hash zone where the query results will be
- * processed and the context will be put back in the idle state and returned to
- * the hash_zone's available list.
+ * pending contexts, and then sent to the index. Requests are sent to the
+ * index in batches: each is added to the zone's batch, which is started once
+ * it is full or once the work already queued for the zone has been done, so
+ * that a burst of queries wakes each index zone thread once rather than once
+ * per query. The context's state will be transitioned from
+ * DEDUPE_CONTEXT_IDLE to DEDUPE_CONTEXT_PENDING. If all goes well, the dedupe
+ * callback will be called by the index which will change the context's state
+ * to DEDUPE_CONTEXT_COMPLETE, and the associated data_vio will be enqueued to
+ * run back in the hash zone where the query results will be processed and the
+ * context will be put back in the idle state and returned to the hash_zone's
+ * available list.
  *
  * The first time an index query is launched from a given hash_zone, a timer is
  * started. When the timer fires, the hash_zone's completion is enqueued to run
@@ -140,11 +154,14 @@
 #include "dedupe.h"
 
 #include <linux/atomic.h>
+#include <linux/bitops.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/kobject.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/murmurhash3.h>
+#include <linux/random.h>
 #include <linux/ratelimit.h>
 #include <linux/spinlock.h>
 #include <linux/timer.h>
@@ -159,6 +176,7 @@
 #include "admin-state.h"
 #include "completion.h"
 #include "compression-state.h"
+#include "compressor.h"
 #include "constants.h"
 #include "data-vio.h"
 #include "io-submitter.h"
@@ -179,6 +197,7 @@
 struct uds_attribute {
 	struct attribute attr;
 	const char *(*show_string)(struct hash_zones *);
+	ssize_t (*show)(struct hash_zones *, char *);
 };
 
 enum timer_state {
@@ -218,6 +237,11 @@ enum {
 	UDS_ADVICE_VERSION = 2,
 	/* version byte + state byte + 64-bit little-endian PBN */
 	UDS_ADVICE_SIZE = 1 + 1 + sizeof(uint64_t),
+	/* Version 3 is version 2 advice for a block named by SHA-256 */
+	UDS_TRUSTED_ADVICE_VERSION = 3,
+	/* version 2 advice + 16-bit load tag + 32-bit advice epoch */
+	UDS_TRUSTED_ADVICE_SIZE =
+		UDS_ADVICE_SIZE + sizeof(uint16_t) + sizeof(uint32_t),
 };
 
 enum hash_lock_state {
@@ -334,6 +358,41 @@ struct hash_lock {
 
 enum {
 	LOCK_POOL_CAPACITY = MAXIMUM_VDO_USER_VIOS,
+	/* The number of recently deduplicated block hashes each zone caches */
+	ADVICE_CACHE_CAPACITY = 1024,
+	/* The number of advice epochs (must be a power of two) */
+	ADVICE_EPOCH_COUNT = 1 << 16,
+	/* The number of bytes compared between checks for a difference */
+	COMPARE_STRIDE = 64,
+	WORDS_PER_COMPARE_STRIDE = COMPARE_STRIDE / sizeof(uint64_t),
+	/*
+	 * The number of bytes of a compressed candidate duplicate decoded and
+	 * compared before decoding the rest (a multiple of COMPARE_STRIDE)
+	 */
+	VERIFY_PROBE_SIZE = 512,
+	/*
+	 * The number of buckets in each zone's histogram of index latencies;
+	 * bucket n counts latencies of less than 2^n microseconds
+	 */
+	LATENCY_BUCKETS = 32,
+	/* The number of latencies recorded between timeout recomputations */
+	LATENCY_SAMPLE_INTERVAL = 1024,
+	/* The factor by which the timeout exceeds the 99th percentile latency */
+	LATENCY_MARGIN_FACTOR = 2,
+};
+
+/*
+ * The last known location of the data with a block hash, remembered after the
+ * hash lock for the hash is released so that a later write of the same data
+ * need not query the index.
+ */
+struct cached_advice {
+	/* The block hash, which is also the key in the advice map */
+	struct uds_chunk_name hash;
+	/* The location of the data, or VDO_ZERO_BLOCK if the entry is unused */
+	struct zoned_pbn advice;
+	/* The entry in the zone's list of cached advice */
+	struct list_head lru_entry;
 };
 
 struct dedupe_context {
@@ -341,6 +400,7 @@ struct dedupe_context {
 	struct uds_request request;
 	struct list_head list_entry;
 	uint64_t submission_jiffies;
+	uint64_t submission_time;
 	struct data_vio *requestor;
 	atomic_t state;
 };
@@ -370,6 +430,15 @@ struct hash_zone {
 	/* Array of all hash_locks */
 	struct hash_lock *lock_array;
 
+	/* Mapping from chunk_name fields to cached advice */
+	struct pointer_map *advice_map;
+
+	/* The cached advice, least recently used first */
+	struct list_head advice_lru;
+
+	/* Array of all cached advice entries */
+	struct cached_advice *advice_array;
+
 	/* These fields are used to manage the dedupe contexts */
 	struct list_head available;
 	struct list_head pending;
@@ -379,6 +448,34 @@ struct hash_zone {
 	unsigned int active;
 	atomic_t timer_state;
 
+	/*
+	 * The index requests waiting to be started as a batch once the work
+	 * already queued for the zone has been done, and the completion which
+	 * starts them
+	 */
+	struct uds_request *query_batch[UDS_MAX_REQUEST_BATCH];
+	unsigned int query_batch_size;
+	struct vdo_completion batch_completion;
+	bool batch_queued;
+
+	/*
+	 * The timeout for index requests derived from their recent latencies,
+	 * in jiffies, or 0 if not yet computed. Only modified on the hash
+	 * zone thread.
+	 */
+	uint64_t latency_timeout_jiffies;
+	/*
+	 * The histogram of recent index request latencies, updated by the
+	 * index callback thread and decayed by the hash zone thread
+	 */
+	atomic_t latencies[LATENCY_BUCKETS];
+	/* The number of latencies recorded since the last recomputation */
+	atomic_t latency_samples;
+	/* The number of requests which timed out (hash zone thread only) */
+	uint64_t timed_out;
+	/* The number of requests answered after they timed out */
+	atomic64_t late_advice;
+
 	/* The dedupe contexts for querying the index from this zone */
 	struct dedupe_context contexts[MAXIMUM_VDO_USER_VIOS];
 };
@@ -392,6 +489,13 @@ struct hash_zones {
 	atomic64_t timeouts;
 	atomic64_t dedupe_context_busy;
 
+	/*
+	 * The advice epochs of physical blocks, each advanced whenever a block
+	 * which selects it is freed, and the random tag of this load
+	 */
+	atomic_t *advice_epochs;
+	uint16_t advice_tag;
+
 	/*
 	 * This spinlock protects the state fields and the starting of dedupe
 	 * requests.
@@ -417,11 +521,50 @@ struct hash_zones {
 
 /* These are in milliseconds. */
 unsigned int vdo_dedupe_index_timeout_interval = 5000;
+unsigned int vdo_dedupe_index_min_timeout_interval = 250;
 unsigned int vdo_dedupe_index_min_timer_interval = 100;
-/* Same two variables, in jiffies for easier consumption. */
+/* Same three variables, in jiffies for easier consumption. */
 static uint64_t vdo_dedupe_index_timeout_jiffies;
+static uint64_t vdo_dedupe_index_min_timeout_jiffies;
 static uint64_t vdo_dedupe_index_min_timer_jiffies;
 
+/**
+ * get_timeout_jiffies() - Get the current timeout for index requests from a
+ *                         hash zone.
+ * @zone: The zone.
+ *
+ * The timeout is derived from the recent latencies of the zone's requests,
+ * limited by the minimum and maximum timeout intervals. Until enough
+ * latencies have been seen, the maximum is used.
+ *
+ * Return: The timeout in jiffies.
+ */
+static uint64_t get_timeout_jiffies(const struct hash_zone *zone)
+{
+	uint64_t timeout = READ_ONCE(zone->latency_timeout_jiffies);
+	uint64_t ceiling = READ_ONCE(vdo_dedupe_index_timeout_jiffies);
+
+	if (timeout == 0) {
+		return ceiling;
+	}
+
+	timeout = max(timeout, READ_ONCE(vdo_dedupe_index_min_timeout_jiffies));
+	return min(timeout, ceiling);
+}
+
+/**
+ * get_advice_epoch() - Get the advice epoch of a physical block.
+ * @zones: The hash zones.
+ * @pbn: The physical block.
+ *
+ * Return: The block's advice epoch counter.
+ */
+static inline atomic_t *get_advice_epoch(struct hash_zones *zones,
+					 physical_block_number_t pbn)
+{
+	return &zones->advice_epochs[pbn & (ADVICE_EPOCH_COUNT - 1)];
+}
+
 static inline struct hash_zone *
 as_hash_zone(struct vdo_completion *completion)
 {
@@ -475,6 +618,88 @@ static void return_hash_lock_to_pool(struct hash_zone *zone,
 	list_add_tail(&lock->pool_node, &zone->lock_pool);
 }
 
+/**
+ * cache_advice() - Remember the verified location of the data of a hash lock
+ *                  which is being released.
+ * @zone: The zone of the lock.
+ * @lock: The lock, whose duplicate location has been verified.
+ *
+ * If the hash is not already cached, the least recently used entry is
+ * replaced.
+ */
+static void cache_advice(struct hash_zone *zone, const struct hash_lock *lock)
+{
+	struct cached_advice *entry =
+		pointer_map_get(zone->advice_map, &lock->hash);
+
+	if (entry == NULL) {
+		int result;
+
+		entry = list_first_entry(&zone->advice_lru,
+					 struct cached_advice,
+					 lru_entry);
+		if (entry->advice.pbn != VDO_ZERO_BLOCK) {
+			pointer_map_remove(zone->advice_map, &entry->hash);
+		}
+
+		entry->advice.pbn = VDO_ZERO_BLOCK;
+		entry->hash = lock->hash;
+		result = pointer_map_put(zone->advice_map,
+					 &entry->hash,
+					 entry,
+					 false,
+					 NULL);
+		if (result != VDO_SUCCESS) {
+			return;
+		}
+	}
+
+	entry->advice = lock->duplicate;
+	list_move_tail(&entry->lru_entry, &zone->advice_lru);
+}
+
+/**
+ * get_cached_advice() - Look up cached advice for the data of a data_vio.
+ * @zone: The hash zone of the data_vio.
+ * @data_vio: The data_vio, whose duplicate field will be set to the advice
+ *            if any is found.
+ *
+ * Return: true if advice was found.
+ */
+static bool get_cached_advice(struct hash_zone *zone,
+			      struct data_vio *data_vio)
+{
+	struct cached_advice *entry =
+		pointer_map_get(zone->advice_map, &data_vio->chunk_name);
+
+	if (entry == NULL) {
+		return false;
+	}
+
+	data_vio->duplicate = entry->advice;
+	list_move_tail(&entry->lru_entry, &zone->advice_lru);
+	return true;
+}
+
+/**
+ * invalidate_cached_advice() - Forget any cached advice for a block hash.
+ * @zone: The hash zone of the hash.
+ * @hash: The hash whose advice has proven not to be a duplicate.
+ */
+static void invalidate_cached_advice(struct hash_zone *zone,
+				     const struct uds_chunk_name *hash)
+{
+	struct cached_advice *entry =
+		pointer_map_remove(zone->advice_map, hash);
+
+	if (entry == NULL) {
+		return;
+	}
+
+	entry->advice.pbn = VDO_ZERO_BLOCK;
+	list_move(&entry->lru_entry, &zone->advice_lru);
+}
+
 /**
  * vdo_get_duplicate_lock() - Get the PBN lock on the duplicate data
  *                            location for a data_vio from the
@@ -773,9 +998,7 @@ static void wait_on_hash_lock(struct hash_lock *lock,
 		 * packer, and because the wait queue link isn't used for
 		 * sending the message.
 		 */
-		data_vio->compression.lock_holder = lock->agent;
-		launch_data_vio_packer_callback(data_vio,
-						vdo_remove_lock_holder_from_packer);
+		vdo_remove_lock_holder_from_packer(data_vio, lock->agent);
 	}
 }
 
@@ -1433,6 +1656,9 @@ static void finish_verifying(struct vdo_completion *completion)
 	}
 
 	lock->verified = agent->is_duplicate;
+	if (!lock->verified) {
+		invalidate_cached_advice(agent->hash_zone, &lock->hash);
+	}
 
 	/*
 	 * Only count the result of the initial verification of the advice as
@@ -1482,13 +1708,34 @@ static void finish_verifying(struct vdo_completion *completion)
 	}
 }
 
-static bool blocks_equal(char *block1, char *block2)
+/**
+ * data_equal() - Check whether two buffers hold the same data.
+ * @data1: The first buffer.
+ * @data2: The second buffer.
+ * @size: The number of bytes to compare, a multiple of COMPARE_STRIDE.
+ *
+ * The differences of all the words of each stride are combined before being
+ * tested, so there is only one branch per cache line, and the comparison
+ * stops at the first line which differs.
+ *
+ * Return: true if the buffers are equal.
+ */
+static bool data_equal(const char *data1, const char *data2, unsigned int size)
 {
-	int i;
+	const uint64_t *words1 = (const uint64_t *) data1;
+	const uint64_t *words2 = (const uint64_t *) data2;
+	unsigned int count = size / sizeof(uint64_t);
+	unsigned int i;
 
+	for (i = 0; i < count; i += WORDS_PER_COMPARE_STRIDE) {
+		uint64_t difference = 0;
+		unsigned int j;
+
+		for (j = 0; j < WORDS_PER_COMPARE_STRIDE; j++) {
+			difference |= words1[i + j] ^ words2[i + j];
+		}
 
-	for (i = 0; i < VDO_BLOCK_SIZE; i += sizeof(uint64_t)) {
-		if (*((uint64_t *) &block1[i]) != *((uint64_t *) &block2[i])) {
+		if (difference != 0) {
 			return false;
 		}
 	}
@@ -1496,6 +1743,11 @@ static bool blocks_equal(char *block1, char *block2)
 	return true;
 }
 
+static bool blocks_equal(const char *block1, const char *block2)
+{
+	return data_equal(block1, block2, VDO_BLOCK_SIZE);
+}
+
 static void verify_callback(struct vdo_completion *completion)
 {
 	struct data_vio *agent = as_data_vio(completion);
@@ -1505,19 +1757,50 @@ static void verify_callback(struct vdo_completion *completion)
 	launch_data_vio_hash_zone_callback(agent, finish_verifying);
 }
 
+/**
+ * uncompress_and_verify() - Decompress a compressed candidate duplicate and
+ *                           compare it to the agent's data.
+ * @completion: The agent.
+ *
+ * Stale advice and hash collisions almost always differ from the start of
+ * the block, so when such candidates are common, only the first
+ * VERIFY_PROBE_SIZE bytes of the fragment are decoded and compared before
+ * paying to decode the whole fragment. Otherwise, or if the fragment can't be
+ * decoded partially, the whole block is decoded and compared at once.
+ */
 static void uncompress_and_verify(struct vdo_completion *completion)
 {
 	struct data_vio *agent = as_data_vio(completion);
-	int result = uncompress_data_vio(agent,
-					 agent->duplicate.state,
-					 agent->scratch_block);
+	struct compressor_context *context = get_work_queue_private_data();
+	const char *data = agent->data_block;
+	char *scratch = agent->scratch_block;
+	bool matched = false;
+	int decoded;
+	int result = uncompress_data_vio_prefix(agent,
+						agent->duplicate.state,
+						scratch,
+						VERIFY_PROBE_SIZE,
+						&decoded);
 
 	if (result == VDO_SUCCESS) {
-		verify_callback(completion);
-		return;
+		if (decoded == VDO_BLOCK_SIZE) {
+			matched = blocks_equal(data, scratch);
+		} else if (data_equal(data, scratch, VERIFY_PROBE_SIZE)) {
+			/* The probe decodes the same again; don't recheck it. */
+			result = uncompress_data_vio(agent,
+						     agent->duplicate.state,
+						     scratch);
+			matched = ((result == VDO_SUCCESS) &&
+				   data_equal(data + VERIFY_PROBE_SIZE,
+					      scratch + VERIFY_PROBE_SIZE,
+					      (VDO_BLOCK_SIZE -
+					       VERIFY_PROBE_SIZE)));
+		}
+
+		vdo_record_fragment_probe(context, matched);
 	}
 
-	agent->is_duplicate = false;
+	agent->is_duplicate = matched;
 	launch_data_vio_hash_zone_callback(agent, finish_verifying);
 }
 
@@ -1598,9 +1881,13 @@ static void finish_locking(struct vdo_completion *completion)
 {
 	struct data_vio *agent = as_data_vio(completion);
 	struct hash_lock *lock = agent->hash_lock;
+	bool trusted = agent->trusted_advice;
 
 	assert_hash_lock_agent(agent, __func__);
 
+	/* Advice is only trusted by the lock attempt which followed it. */
+	agent->trusted_advice = false;
+
 	if (completion->result != VDO_SUCCESS) {
 		/* XXX clearDuplicateLocation()? */
 		agent->is_duplicate = false;
@@ -1629,6 +1916,18 @@ static void finish_locking(struct vdo_completion *completion)
 	ASSERT_LOG_ONLY(lock->duplicate_lock != NULL,
 			"must hold duplicate_lock if flagged as a duplicate");
 
+	if (!lock->verified && trusted) {
+		/*
+		 * LOCKING -> DEDUPING transition: The advice was recorded for
+		 * a block with the same SHA-256 name, and the block has not
+		 * been freed since, so it is a true duplicate without being
+		 * read.
+		 */
+		increment_stat(&agent->hash_zone->statistics.dedupe_advice_trusted);
+		finish_verifying(completion);
+		return;
+	}
+
 	if (!lock->verified) {
 		/*
 		 * LOCKING -> VERIFYING transition: Continue on the unverified
@@ -1796,6 +2095,18 @@ static void lock_duplicate_pbn(struct vdo_completion *completion)
 	 */
 	set_duplicate_lock(agent->hash_lock, lock);
 
+	/*
+	 * Blocks are only freed on this thread, and the lock now keeps the
+	 * block from being freed, so if its epoch is unchanged, it still holds
+	 * the data it held when the advice was recorded.
+	 */
+	if (agent->trusted_advice &&
+	    (atomic_read(get_advice_epoch(vdo_from_data_vio(agent)->hash_zones,
+					  agent->duplicate.pbn)) !=
+	     agent->advice_epoch)) {
+		agent->trusted_advice = false;
+	}
+
 	/*
 	 * XXX VDOSTORY-190 Optimization: Same as start_locking() lazily
 	 * changing state to save on having to switch back to the hash zone
@@ -2052,6 +2363,7 @@ static bool decode_uds_advice(struct dedupe_context *context)
 	const struct uds_chunk_data *encoding = &request->old_metadata;
 	struct vdo *vdo = vdo_from_data_vio(data_vio);
 	struct zoned_pbn *advice = &data_vio->duplicate;
+	bool trusted = false;
 	byte version;
 	int result;
 
@@ -2060,7 +2372,8 @@ static bool decode_uds_advice(struct dedupe_context *context)
 	}
 
 	version = encoding->data[offset++];
-	if (version != UDS_ADVICE_VERSION) {
+	if ((version != UDS_ADVICE_VERSION) &&
+	    (version != UDS_TRUSTED_ADVICE_VERSION)) {
 		uds_log_error("invalid UDS advice version code %u", version);
 		return false;
 	}
@@ -2068,7 +2381,24 @@ static bool decode_uds_advice(struct dedupe_context *context)
 	advice->state = encoding->data[offset++];
 	advice->pbn = get_unaligned_le64(&encoding->data[offset]);
 	offset += sizeof(uint64_t);
-	BUG_ON(offset != UDS_ADVICE_SIZE);
+	if (version == UDS_TRUSTED_ADVICE_VERSION) {
+		uint16_t tag = get_unaligned_le16(&encoding->data[offset]);
+
+		offset += sizeof(uint16_t);
+		data_vio->advice_epoch =
+			get_unaligned_le32(&encoding->data[offset]);
+		offset += sizeof(uint32_t);
+		BUG_ON(offset != UDS_TRUSTED_ADVICE_SIZE);
+
+		/*
+		 * The advice can only be trusted if both names are SHA-256
+		 * digests, and the epoch was recorded during this load.
+		 */
+		trusted = (data_vio->trusted_name &&
+			   (tag == vdo->hash_zones->advice_tag));
+	} else {
+		BUG_ON(offset != UDS_ADVICE_SIZE);
+	}
 
 	/* Don't use advice that's clearly meaningless. */
 	if ((advice->state == VDO_MAPPING_STATE_UNMAPPED) ||
@@ -2090,6 +2420,7 @@ static bool decode_uds_advice(struct dedupe_context *context)
 		return false;
 	}
 
+	data_vio->trusted_advice = trusted;
 	return true;
 }
 
@@ -2161,11 +2492,28 @@ static void finish_querying(struct vdo_completion *completion)
  * Starts deduplication for a hash lock that has finished initializing by
  * making the data_vio that requested it the agent, entering the QUERYING
  * state, and using the agent to perform the UDS query on behalf of the lock.
+ * If the zone has cached advice for the hash, the query is skipped and the
+ * advice is verified directly.
  */
 static void start_querying(struct hash_lock *lock, struct data_vio *data_vio)
 {
+	struct hash_zone *zone = data_vio->hash_zone;
+
 	set_agent(lock, data_vio);
 	set_hash_lock_state(lock, VDO_HASH_LOCK_QUERYING);
+	if (READ_ONCE(vdo_from_data_vio(data_vio)->hash_zones->dedupe_flag) &&
+	    get_cached_advice(zone, data_vio)) {
+		increment_stat(&zone->statistics.dedupe_advice_cached);
+		data_vio->is_duplicate = true;
+		lock->duplicate = data_vio->duplicate;
+		/*
+		 * QUERYING -> LOCKING transition: The advice is still
+		 * unverified, so treat it exactly like advice from UDS.
+		 */
+		start_locking(lock, data_vio);
+		return;
+	}
+
 	data_vio->last_async_operation = VIO_ASYNC_OP_CHECK_FOR_DUPLICATION;
 	set_data_vio_hash_zone_callback(data_vio, finish_querying);
 	query_index(data_vio,
@@ -2456,6 +2804,10 @@ void vdo_release_hash_lock(struct data_vio *data_vio)
 	ASSERT_LOG_ONLY(list_empty(&lock->duplicate_ring),
 			"hash lock returned to zone must not reference DataVIOs");
 
+	if (lock->verified && (lock->duplicate.pbn != VDO_ZERO_BLOCK)) {
+		cache_advice(zone, lock);
+	}
+
 	return_hash_lock_to_pool(zone, lock);
 }
 
@@ -2574,6 +2926,8 @@ static ssize_t dedupe_status_show(struct kobject *directory,
 		container_of(directory, struct hash_zones, dedupe_directory);
 	if (ua->show_string != NULL) {
 		return sprintf(buf, "%s\n", ua->show_string(zones));
+	} else if (ua->show != NULL) {
+		return ua->show(zones, buf);
 	} else {
 		return -EINVAL;
 	}
@@ -2599,8 +2953,38 @@ static struct uds_attribute dedupe_status_attribute = {
 	.show_string = vdo_get_dedupe_index_state_name,
 };
 
+/*
+ * Show the current index timeout of each hash zone, and how many of its
+ * requests have timed out and been answered after timing out.
+ */
+static ssize_t dedupe_timeouts_show(struct hash_zones *zones, char *buf)
+{
+	ssize_t length = 0;
+	zone_count_t z;
+
+	for (z = 0; z < zones->zone_count; z++) {
+		struct hash_zone *zone = &zones->zones[z];
+
+		length += scnprintf(buf + length,
+				    PAGE_SIZE - length,
+				    "zone %u: timeout %u ms, timed out %llu, late %llu\n",
+				    z,
+				    jiffies_to_msecs(get_timeout_jiffies(zone)),
+				    (unsigned long long) READ_ONCE(zone->timed_out),
+				    (unsigned long long) atomic64_read(&zone->late_advice));
+	}
+
+	return length;
+}
+
+static struct uds_attribute dedupe_timeouts_attribute = {
+	.attr = {.name = "timeouts", .mode = 0444, },
+	.show = dedupe_timeouts_show,
+};
+
 static struct attribute *dedupe_attrs[] = {
 	&dedupe_status_attribute.attr,
+	&dedupe_timeouts_attribute.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(dedupe);
@@ -2733,6 +3117,65 @@ static void change_dedupe_state(struct vdo_completion *completion)
 	spin_unlock(&zones->lock);
 }
 
+/**
+ * record_latency() - Add the latency of a finished index request to the
+ *                    histogram of its zone.
+ * @context: The context of the request.
+ *
+ * This is called from the index callback thread.
+ */
+static void record_latency(struct dedupe_context *context)
+{
+	uint64_t latency_us = ((ktime_get_ns() - context->submission_time) /
+			       NSEC_PER_USEC);
+	unsigned int bucket = min_t(unsigned int,
+				    fls64(latency_us),
+				    LATENCY_BUCKETS - 1);
+
+	atomic_inc(&context->zone->latencies[bucket]);
+	atomic_inc(&context->zone->latency_samples);
+}
+
+/**
+ * update_timeout() - Recompute the timeout of a hash zone from its histogram
+ *                    of recent latencies.
+ * @zone: The zone.
+ *
+ * The timeout is a multiple of the 99th percentile latency. The histogram is
+ * then halved so that older latencies count for less.
+ */
+static void update_timeout(struct hash_zone *zone)
+{
+	unsigned int counts[LATENCY_BUCKETS];
+	unsigned int samples = atomic_read(&zone->latency_samples);
+	uint64_t total = 0;
+	uint64_t seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		counts[i] = atomic_read(&zone->latencies[i]);
+		total += counts[i];
+	}
+
+	for (i = 0; i < LATENCY_BUCKETS - 1; i++) {
+		seen += counts[i];
+		if (seen * 100 >= total * 99) {
+			break;
+		}
+	}
+
+	WRITE_ONCE(zone->latency_timeout_jiffies,
+		   max_t(uint64_t,
+			 usecs_to_jiffies(LATENCY_MARGIN_FACTOR * (1UL << i)),
+			 1));
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		atomic_sub(counts[i] / 2, &zone->latencies[i]);
+	}
+
+	atomic_sub(samples, &zone->latency_samples);
+}
+
 static void start_expiration_timer(struct dedupe_context *context)
 {
 	uint64_t start_time = context->submission_jiffies;
@@ -2744,7 +3187,7 @@ static void start_expiration_timer(struct dedupe_context *context)
 		return;
 	}
 
-	end_time = max(start_time + vdo_dedupe_index_timeout_jiffies,
+	end_time = max(start_time + get_timeout_jiffies(context->zone),
 		       jiffies + vdo_dedupe_index_min_timer_jiffies);
 	mod_timer(&context->zone->timer, end_time);
 }
@@ -2785,6 +3228,7 @@ static int initialize_index(struct vdo *vdo, struct hash_zones *zones)
 	};
 
 	vdo_set_dedupe_index_timeout_interval(vdo_dedupe_index_timeout_interval);
+	vdo_set_dedupe_index_min_timeout_interval(vdo_dedupe_index_min_timeout_interval);
 	vdo_set_dedupe_index_min_timer_interval(vdo_dedupe_index_min_timer_interval);
 
 	/*
@@ -2840,6 +3284,8 @@ static void finish_index_operation(struct uds_request *request)
 	struct dedupe_context *context = container_of(request,
 						      struct dedupe_context,
 						      request);
+
+	record_latency(context);
 	if (change_context_state(context,
 				 DEDUPE_CONTEXT_PENDING,
 				 DEDUPE_CONTEXT_COMPLETE)) {
@@ -2855,6 +3301,7 @@ static void finish_index_operation(struct uds_request *request)
 	 * This query has timed out, so try to mark it complete and hence
 	 * eligible for reuse. Its data_vio has already moved on.
 	 */
+	atomic64_inc(&context->zone->late_advice);
 	if (!change_context_state(context,
 				  DEDUPE_CONTEXT_TIMED_OUT,
 				  DEDUPE_CONTEXT_TIMED_OUT_COMPLETE)) {
@@ -2911,9 +3358,7 @@ timeout_index_operations_callback(struct vdo_completion *completion)
 {
 	struct dedupe_context *context, *tmp;
 	struct hash_zone *zone = as_hash_zone(completion);
-	uint64_t timeout_jiffies =
-		msecs_to_jiffies(vdo_dedupe_index_timeout_interval);
-	unsigned long cutoff = jiffies - timeout_jiffies;
+	unsigned long cutoff = jiffies - get_timeout_jiffies(zone);
 	unsigned int timed_out = 0;
 
 	atomic_set(&zone->timer_state, DEDUPE_QUERY_TIMER_IDLE);
@@ -2955,6 +3400,7 @@ timeout_index_operations_callback(struct vdo_completion *completion)
 	}
 
 	if (timed_out > 0) {
+		WRITE_ONCE(zone->timed_out, zone->timed_out + timed_out);
 		report_dedupe_timeouts(completion->vdo->hash_zones, timed_out);
 	}
 
@@ -2972,6 +3418,79 @@ static void timeout_index_operations(struct timer_list *t)
 	}
 }
 
+/**
+ * submit_query_batch() - Start the batched index requests of a hash zone.
+ * @zone: The hash zone.
+ */
+static void submit_query_batch(struct hash_zone *zone)
+{
+	int result;
+
+	if (zone->query_batch_size == 0) {
+		return;
+	}
+
+	result = uds_start_chunk_operations(zone->query_batch,
+					    zone->query_batch_size);
+	if (result == UDS_SUCCESS) {
+		zone->query_batch_size = 0;
+		return;
+	}
+
+	/*
+	 * Failing a request may continue its data_vio immediately, which may
+	 * batch another request into the slot just vacated. Such a request is
+	 * failed along with the rest, since the index has just refused it.
+	 */
+	while (zone->query_batch_size > 0) {
+		struct uds_request *request =
+			zone->query_batch[--zone->query_batch_size];
+
+		request->status = result;
+		finish_index_operation(request);
+	}
+}
+
+/**
+ * submit_query_batch_callback() - Start the batched index requests of a hash
+ *                                 zone once the work queued ahead of them has
+ *                                 been done.
+ * @completion: The batch completion of the zone.
+ */
+static void submit_query_batch_callback(struct vdo_completion *completion)
+{
+	struct hash_zone *zone = container_of(completion,
+					      struct hash_zone,
+					      batch_completion);
+
+	zone->batch_queued = false;
+	submit_query_batch(zone);
+}
+
+/**
+ * add_to_query_batch() - Add an index request to the batch of a hash zone.
+ * @zone: The hash zone.
+ * @request: The request to start.
+ *
+ * The batch is started when it is full, or else once the work already queued
+ * for the zone has been done, so that a burst of queries crosses into the
+ * index together rather than one at a time.
+ */
+static void add_to_query_batch(struct hash_zone *zone,
+			       struct uds_request *request)
+{
+	zone->query_batch[zone->query_batch_size++] = request;
+	if (zone->query_batch_size == UDS_MAX_REQUEST_BATCH) {
+		submit_query_batch(zone);
+		return;
+	}
+
+	if (!zone->batch_queued) {
+		zone->batch_queued = true;
+		vdo_enqueue_completion(&zone->batch_completion);
+	}
+}
+
 static int __must_check initialize_zone(struct vdo *vdo,
 					struct hash_zones *zones,
 					zone_count_t zone_number)
@@ -3000,6 +3519,12 @@ static int __must_check initialize_zone(struct vdo *vdo,
 	vdo_set_completion_callback(&zone->completion,
 				    timeout_index_operations_callback,
 				    zone->thread_id);
+	vdo_initialize_completion(&zone->batch_completion,
+				  vdo,
+				  VDO_HASH_ZONE_COMPLETION);
+	vdo_set_completion_callback(&zone->batch_completion,
+				    submit_query_batch_callback,
+				    zone->thread_id);
 	INIT_LIST_HEAD(&zone->lock_pool);
 	result = UDS_ALLOCATE(LOCK_POOL_CAPACITY,
 			      struct hash_lock,
@@ -3013,6 +3538,29 @@ static int __must_check initialize_zone(struct vdo *vdo,
 		return_hash_lock_to_pool(zone, &zone->lock_array[i]);
 	}
 
+	result = make_pointer_map(ADVICE_CACHE_CAPACITY,
+				  0,
+				  compare_keys,
+				  hash_key,
+				  &zone->advice_map);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	INIT_LIST_HEAD(&zone->advice_lru);
+	result = UDS_ALLOCATE(ADVICE_CACHE_CAPACITY,
+			      struct cached_advice,
+			      "cached advice array",
+			      &zone->advice_array);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; i < ADVICE_CACHE_CAPACITY; i++) {
+		list_add_tail(&zone->advice_array[i].lru_entry,
+			      &zone->advice_lru);
+	}
+
 	INIT_LIST_HEAD(&zone->available);
 	INIT_LIST_HEAD(&zone->pending);
 	INIT_LIST_HEAD(&zone->timed_out);
@@ -3069,8 +3617,22 @@ int vdo_make_hash_zones(struct vdo *vdo, struct hash_zones **zones_ptr)
 		return result;
 	}
 
+	result = UDS_ALLOCATE(ADVICE_EPOCH_COUNT,
+			      atomic_t,
+			      "dedupe advice epochs",
+			      &zones->advice_epochs);
+	if (result != VDO_SUCCESS) {
+		UDS_FREE(zones);
+		return result;
+	}
+
+	get_random_bytes(zones->advice_epochs,
+			 ADVICE_EPOCH_COUNT * sizeof(atomic_t));
+	zones->advice_tag = get_random_u32();
+
 	result = initialize_index(vdo, zones);
 	if (result != VDO_SUCCESS) {
+		UDS_FREE(zones->advice_epochs);
 		UDS_FREE(zones);
 		return result;
 	}
@@ -3130,8 +3692,12 @@ void vdo_free_hash_zones(struct hash_zones *zones)
 
 		free_pointer_map(UDS_FORGET(zone->hash_lock_map));
 		UDS_FREE(UDS_FORGET(zone->lock_array));
+		free_pointer_map(UDS_FORGET(zone->advice_map));
+		UDS_FREE(UDS_FORGET(zone->advice_array));
 	}
 
+	UDS_FREE(UDS_FORGET(zones->advice_epochs));
+
 	if (zones->index_session != NULL) {
 		vdo_finish_dedupe_index(zones);
 	}
@@ -3342,6 +3908,8 @@ static void get_hash_zone_statistics(const struct hash_zone *zone,
 
 	tally->dedupe_advice_valid += READ_ONCE(stats->dedupe_advice_valid);
 	tally->dedupe_advice_stale += READ_ONCE(stats->dedupe_advice_stale);
+	tally->dedupe_advice_cached += READ_ONCE(stats->dedupe_advice_cached);
+	tally->dedupe_advice_trusted += READ_ONCE(stats->dedupe_advice_trusted);
 	tally->concurrent_data_matches +=
 		READ_ONCE(stats->concurrent_data_matches);
 	tally->concurrent_hash_collisions +=
@@ -3410,6 +3978,12 @@ void vdo_get_dedupe_statistics(struct hash_zones *zones,
 		(atomic64_read(&zones->timeouts) +
 		 atomic64_read(&zones->dedupe_context_busy));
 
+	stats->dedupe_advice_late = 0;
+	for (zone = 0; zone < zones->zone_count; zone++) {
+		stats->dedupe_advice_late +=
+			atomic64_read(&zones->zones[zone].late_advice);
+	}
+
 }
 
 /**
@@ -3445,6 +4019,25 @@ struct hash_zone *vdo_select_hash_zone(struct hash_zones *zones,
 	return &zones->zones[hash];
 }
 
+/**
+ * vdo_retire_dedupe_advice() - Stop trusting any dedupe advice for a physical
+ *                              block which has been freed.
+ * @zones: The hash zones (may be NULL).
+ * @pbn: The freed block.
+ *
+ * This must be called from the thread of the physical zone which owns the
+ * block.
+ */
+void vdo_retire_dedupe_advice(struct hash_zones *zones,
+			      physical_block_number_t pbn)
+{
+	if (zones == NULL) {
+		return;
+	}
+
+	atomic_inc(get_advice_epoch(zones, pbn));
+}
+
 /**
  * dump_hash_lock() - Dump a compact description of hash_lock to the log if
  *                    the lock is not on the free list.
@@ -3560,6 +4153,27 @@ void vdo_set_dedupe_index_timeout_interval(unsigned int value)
 	vdo_dedupe_index_timeout_jiffies = alb_jiffies;
 }
 
+void vdo_set_dedupe_index_min_timeout_interval(unsigned int value)
+{
+	uint64_t min_jiffies;
+
+	/* Arbitrary maximum value is two minutes */
+	if (value > 120000) {
+		value = 120000;
+	}
+
+	/* Arbitrary minimum value is 2 jiffies */
+	min_jiffies = msecs_to_jiffies(value);
+
+	if (min_jiffies < 2) {
+		min_jiffies = 2;
+		value = jiffies_to_msecs(min_jiffies);
+	}
+
+	vdo_dedupe_index_min_timeout_interval = value;
+	vdo_dedupe_index_min_timeout_jiffies = min_jiffies;
+}
+
 void vdo_set_dedupe_index_min_timer_interval(unsigned int value)
 {
 	uint64_t min_jiffies;
@@ -3641,18 +4255,37 @@ static void prepare_uds_request(struct uds_request *request,
 				struct data_vio *data_vio,
 				enum uds_request_type operation)
 {
+	struct hash_zones *zones = vdo_from_data_vio(data_vio)->hash_zones;
+
 	request->chunk_name = data_vio->chunk_name;
 	request->type = operation;
 	if ((operation == UDS_POST) || (operation == UDS_UPDATE)) {
 		size_t offset = 0;
 		struct uds_chunk_data *encoding = &request->new_metadata;
 
-		encoding->data[offset++] = UDS_ADVICE_VERSION;
+		encoding->data[offset++] = (data_vio->trusted_name ?
+					    UDS_TRUSTED_ADVICE_VERSION :
+					    UDS_ADVICE_VERSION);
 		encoding->data[offset++] = data_vio->new_mapped.state;
 		put_unaligned_le64(data_vio->new_mapped.pbn,
 				   &encoding->data[offset]);
 		offset += sizeof(uint64_t);
-		BUG_ON(offset != UDS_ADVICE_SIZE);
+		if (!data_vio->trusted_name) {
+			BUG_ON(offset != UDS_ADVICE_SIZE);
+			return;
+		}
+
+		/*
+		 * The data_vio holds a reference to the new block, so its
+		 * epoch can not advance on its account while it is recorded.
+		 */
+		put_unaligned_le16(zones->advice_tag, &encoding->data[offset]);
+		offset += sizeof(uint16_t);
+		put_unaligned_le32(atomic_read(get_advice_epoch(zones,
+								data_vio->new_mapped.pbn)),
+				   &encoding->data[offset]);
+		offset += sizeof(uint32_t);
+		BUG_ON(offset != UDS_TRUSTED_ADVICE_SIZE);
 	}
 }
 
@@ -3666,7 +4299,6 @@ static void prepare_uds_request(struct uds_request *request,
 static void
 query_index(struct data_vio *data_vio, enum uds_request_type operation)
 {
-	int result;
 	struct dedupe_context *context;
 	struct vdo *vdo = vdo_from_data_vio(data_vio);
 	struct hash_zone *zone = data_vio->hash_zone;
@@ -3685,18 +4317,19 @@ query_index(struct data_vio *data_vio, enum uds_request_type operation)
 		return;
 	}
 
+	if (atomic_read(&zone->latency_samples) >= LATENCY_SAMPLE_INTERVAL) {
+		update_timeout(zone);
+	}
+
 	data_vio->dedupe_context = context;
 	context->requestor = data_vio;
 	context->submission_jiffies = jiffies;
+	context->submission_time = ktime_get_ns();
 	prepare_uds_request(&context->request, data_vio, operation);
 	atomic_set(&context->state, DEDUPE_CONTEXT_PENDING);
 	list_add_tail(&context->list_entry, &zone->pending);
 	start_expiration_timer(context);
-	result = uds_start_chunk_operation(&context->request);
-	if (result != UDS_SUCCESS) {
-		context->request.status = result;
-		finish_index_operation(&context->request);
-	}
+	add_to_query_batch(zone, &context->request);
 }
 
 static void set_target_state(struct hash_zones *zones,
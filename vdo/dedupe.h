@@ -55,6 +55,9 @@ struct hash_zone * __must_check
 vdo_select_hash_zone(struct hash_zones *zones,
 		     const struct uds_chunk_name *name);
 
+void vdo_retire_dedupe_advice(struct hash_zones *zones,
+			      physical_block_number_t pbn);
+
 void vdo_dump_hash_zones(struct hash_zones *zones);
 
 const char *vdo_get_dedupe_index_state_name(struct hash_zones *zones);
@@ -73,11 +76,18 @@ void vdo_resume_hash_zones(struct hash_zones *zones,
 void vdo_finish_dedupe_index(struct hash_zones *zones);
 
 /*
- * Interval (in milliseconds) from submission until switching to fast path and
- * skipping UDS.
+ * The largest interval (in milliseconds) from submission until switching to
+ * fast path and skipping UDS. Each hash zone times out requests after a
+ * multiple of its recent 99th percentile index latency, within this limit.
  */
 extern unsigned int vdo_dedupe_index_timeout_interval;
 
+/*
+ * The smallest interval (in milliseconds) which a hash zone will use as its
+ * timeout, however quickly the index has been answering it.
+ */
+extern unsigned int vdo_dedupe_index_min_timeout_interval;
+
 /*
  * Minimum time interval (in milliseconds) between timer invocations to
  * check for requests waiting for UDS that should now time out.
@@ -85,6 +95,7 @@ extern unsigned int vdo_dedupe_index_timeout_interval;
 extern unsigned int vdo_dedupe_index_min_timer_interval;
 
 void vdo_set_dedupe_index_timeout_interval(unsigned int value);
+void vdo_set_dedupe_index_min_timeout_interval(unsigned int value);
 void vdo_set_dedupe_index_min_timer_interval(unsigned int value);
 
 #endif /* DEDUPE_H */
@@ -458,6 +458,16 @@ static int process_one_key_value_pair(const char *key,
 		config->max_discard_blocks = value;
 		return VDO_SUCCESS;
 	}
+
+	if (strcmp(key, "compressionLevel") == 0) {
+		if (value > INT_MAX) {
+			uds_log_error("optional parameter error: compression level %u is too large",
+				      value);
+			return -EINVAL;
+		}
+		config->compression_level = value;
+		return VDO_SUCCESS;
+	}
 	/* Handles unknown key names */
 	return process_one_thread_config_spec(key, value,
 					      &config->thread_counts);
@@ -483,10 +493,19 @@ static int parse_one_key_value_pair(const char *key,
 		return parse_bool(value, "on", "off", &config->deduplication);
 	}
 
+	if (strcmp(key, "trustedDedupe") == 0) {
+		return parse_bool(value, "on", "off", &config->trusted_dedupe);
+	}
+
 	if (strcmp(key, "compression") == 0) {
 		return parse_bool(value, "on", "off", &config->compression);
 	}
 
+	if (strcmp(key, "compressionType") == 0) {
+		return vdo_parse_compression_type(value,
+						  &config->compression_type);
+	}
+
 	/* The remaining arguments must have integral values. */
 	result = kstrtouint(value, 10, &count);
 	if (result != UDS_SUCCESS) {
@@ -678,7 +697,10 @@ int vdo_parse_device_config(int argc,
 	};
 	config->max_discard_blocks = 1;
 	config->deduplication = true;
+	config->trusted_dedupe = false;
 	config->compression = false;
+	config->compression_type = VDO_COMPRESSION_LZ4;
+	config->compression_level = VDO_DEFAULT_COMPRESSION_LEVEL;
 
 	arg_set.argc = argc;
 	arg_set.argv = argv;
@@ -10,6 +10,7 @@
 
 #include "types.h"
 
+#include "compressor.h"
 #include "kernel-types.h"
 
 /*
@@ -46,7 +47,10 @@ struct device_config {
 	unsigned int cache_size;
 	unsigned int block_map_maximum_age;
 	bool deduplication;
+	bool trusted_dedupe;
 	bool compression;
+	enum vdo_compression_type compression_type;
+	int compression_level;
 	struct thread_count_config thread_counts;
 	block_count_t max_discard_blocks;
 };
@@ -209,6 +209,36 @@ process_vdo_message_locked(struct vdo *vdo,
 					argv[1]);
 			return -EINVAL;
 		}
+
+		if (strcasecmp(argv[0], "compression-type") == 0) {
+			u32 setting = READ_ONCE(vdo->compression_setting);
+			enum vdo_compression_type old_type, type;
+			int level;
+
+			if (vdo_parse_compression_type(argv[1], &type) != VDO_SUCCESS) {
+				return -EINVAL;
+			}
+
+			vdo_unpack_compression_setting(setting, &old_type, &level);
+			vdo_set_compression_engine(vdo, type, level);
+			return 0;
+		}
+
+		if (strcasecmp(argv[0], "compression-level") == 0) {
+			u32 setting = READ_ONCE(vdo->compression_setting);
+			enum vdo_compression_type type;
+			int old_level, level;
+
+			if ((kstrtoint(argv[1], 10, &level) != 0) || (level < 0)) {
+				uds_log_warning("invalid argument '%s' to dmsetup compression-level message",
+						argv[1]);
+				return -EINVAL;
+			}
+
+			vdo_unpack_compression_setting(setting, &type, &old_level);
+			vdo_set_compression_engine(vdo, type, level);
+			return 0;
+		}
 	}
 
 	uds_log_warning("unrecognized dmsetup message '%s' received", argv[0]);
@@ -349,8 +379,15 @@ static int vdo_initialize(struct dm_target *ti,
 		      config->block_map_maximum_age);
 	uds_log_debug("Deduplication          = %s",
 		      (config->deduplication ? "on" : "off"));
+	uds_log_debug("Trusted dedupe         = %s",
+		      (config->trusted_dedupe ? "on" : "off"));
 	uds_log_debug("Compression            = %s",
 		      (config->compression ? "on" : "off"));
+	uds_log_debug("Compression type       = %s",
+		      vdo_get_compression_type_name(config->compression_type));
+	uds_log_debug("Compression level      = %d",
+		      vdo_get_compression_level(config->compression_type,
+						config->compression_level));
 
 
 	vdo = vdo_find_matching(vdo_uses_device, config);
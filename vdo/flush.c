@@ -18,6 +18,7 @@
 #include "kernel-types.h"
 #include "logical-zone.h"
 #include "num-utils.h"
+#include "packer.h"
 #include "read-only-notifier.h"
 #include "slab-depot.h"
 #include "thread-config.h"
@@ -42,6 +43,8 @@ struct flusher {
 	sequence_number_t notify_generation;
 	/** The logical zone to notify next */
 	struct logical_zone *logical_zone_to_notify;
+	/** The packer to notify next */
+	zone_count_t packer_to_notify;
 	/** The ID of the thread on which flush requests should be made */
 	thread_id_t thread_id;
 	/** A flush request to ensure we always have at least one */
@@ -131,8 +134,13 @@ int vdo_make_flusher(struct vdo *vdo)
 
 	spin_lock_init(&vdo->flusher->lock);
 	bio_list_init(&vdo->flusher->waiting_flush_bios);
-	return UDS_ALLOCATE(1, struct vdo_flush, __func__,
-			    &vdo->flusher->spare_flush);
+	result = UDS_ALLOCATE(1, struct vdo_flush, __func__,
+			      &vdo->flusher->spare_flush);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	return vdo_make_default_thread(vdo, vdo->flusher->thread_id);
 }
 
 /**
@@ -199,18 +207,28 @@ static void finish_notification(struct vdo_completion *completion)
 }
 
 /**
- * flush_packer_callback() - Flush the packer.
+ * flush_packer_callback() - Flush a packer.
  * @completion: The flusher completion.
  *
- * Flushes the packer now that all of the logical and physical zones have been
- * notified of the new flush request. This callback is registered in
- * increment_generation().
+ * Flushes each packer in turn now that all of the logical and physical zones
+ * have been notified of the new flush request. This callback is registered
+ * both in increment_generation() and in itself.
  */
 static void flush_packer_callback(struct vdo_completion *completion)
 {
 	struct flusher *flusher = as_flusher(completion);
+	struct packers *packers = flusher->vdo->packers;
+	struct packer *packer = &packers->zones[flusher->packer_to_notify++];
+
+	vdo_increment_packer_flush_generation(packer);
+	if (flusher->packer_to_notify < packers->zone_count) {
+		packer = &packers->zones[flusher->packer_to_notify];
+		vdo_launch_completion_callback(completion,
+					       flush_packer_callback,
+					       packer->thread_id);
+		return;
+	}
 
-	vdo_increment_packer_flush_generation(flusher->vdo->packer);
 	vdo_launch_completion_callback(completion, finish_notification,
 				       flusher->thread_id);
 }
@@ -231,9 +249,10 @@ static void increment_generation(struct vdo_completion *completion)
 	vdo_increment_logical_zone_flush_generation(zone,
 						    flusher->notify_generation);
 	if (zone->next == NULL) {
+		flusher->packer_to_notify = 0;
 		vdo_launch_completion_callback(completion,
 					       flush_packer_callback,
-					       flusher->thread_id);
+					       flusher->vdo->packers->zones[0].thread_id);
 		return;
 	}
 
@@ -0,0 +1,345 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright Red Hat
+ */
+
+#include "hasher.h"
+
+#include <linux/atomic.h>
+#include <linux/murmurhash3.h>
+#include <linux/version.h>
+
+#include "logger.h"
+#include "memory-alloc.h"
+#include "permassert.h"
+
+#include "constants.h"
+#include "data-vio.h"
+#include "dedupe.h"
+#include "funnel-queue.h"
+#include "thread-config.h"
+#include "vdo.h"
+
+/**
+ * DOC:
+ *
+ * Hashing the data of each block written is one of the larger consumers of
+ * cpu time in the write path. Rather than hashing each data_vio in its own
+ * cpu queue callback, data_vios which need to be hashed are added to the
+ * funnel queue of one of a small number of hashers. Each hasher owns a
+ * completion which, whenever the hasher has pending data_vios, is scheduled
+ * on the cpu threads, using the same scheme as the release processing of
+ * the data_vio_pool. When the completion runs, it takes a batch of
+ * data_vios from the queue and hashes them MURMURHASH3_LANES at a time with
+ * murmurhash3_128_multi(), which computes exactly the same chunk names as
+ * murmurhash3_128() but overlaps the work on several blocks. Each hashed
+ * data_vio is then sent on to its hash zone.
+ *
+ * Since a funnel queue may only have one consumer, each hasher processes at
+ * most one batch at a time. There is one hasher per cpu thread so that
+ * hashing can still use all of the cpu threads.
+ *
+ * When trusted dedupe is enabled, each block is instead named by the first
+ * 128 bits of its SHA-256 digest, using the kernel's SHA-256 library (which
+ * uses the cpu's SHA or vector instructions where it can). Such names are
+ * strong enough that the hash locks may trust advice recorded for a block
+ * with the same name without reading the block to verify it. This relies on
+ * the data hashed being exactly the data written, which holds because every
+ * write is copied out of its bio before it is examined. The names are
+ * truncated to 128 bits, so collisions are bounded by about 2^64 blocks
+ * (the birthday bound) rather than 2^128.
+ */
+
+/* The sha256() library function was introduced in 5.11. */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0)) && \
+	IS_REACHABLE(CONFIG_CRYPTO_LIB_SHA256)
+#define VDO_HAVE_SHA256 1
+#include <crypto/sha2.h>
+#else
+#define VDO_HAVE_SHA256 0
+#endif
+
+enum {
+	HASH_BATCH_SIZE = 32,
+};
+
+static const uint32_t CHUNK_NAME_SEED = 0x62ea60be;
+
+struct hasher {
+	/* Completion for scheduling batches */
+	struct vdo_completion completion;
+	/* The queue of data_vios waiting to be hashed */
+	struct funnel_queue *queue;
+	/* Whether the hasher is processing, or scheduled to process a batch */
+	atomic_t processing;
+	/* The batch currently being hashed */
+	struct data_vio *batch[HASH_BATCH_SIZE];
+};
+
+struct hashers {
+	/* The number of hashers */
+	unsigned int count;
+	/* The hashers */
+	struct hasher hashers[];
+};
+
+/**
+ * as_hasher() - Convert a vdo_completion to a hasher.
+ * @completion: The completion to convert.
+ *
+ * Return: The completion as a hasher.
+ */
+static inline struct hasher *as_hasher(struct vdo_completion *completion)
+{
+	vdo_assert_completion_type(completion->type, VDO_HASHER_COMPLETION);
+	return container_of(completion, struct hasher, completion);
+}
+
+/**
+ * schedule_hashing() - Ensure that batch processing is scheduled.
+ * @hasher: The hasher which has received a data_vio.
+ *
+ * If this call switches the state to processing, enqueue. Otherwise, some
+ * other thread has already done so.
+ */
+static void schedule_hashing(struct hasher *hasher)
+{
+	/* Pairs with the barrier in process_batch_callback(). */
+	smp_mb__before_atomic();
+	if (atomic_cmpxchg(&hasher->processing, false, true)) {
+		return;
+	}
+
+	hasher->completion.requeue = true;
+	vdo_invoke_completion_callback_with_priority(&hasher->completion,
+						     CPU_Q_HASH_BLOCK_PRIORITY);
+}
+
+/**
+ * hash_batch() - Compute the chunk names of a batch of data_vios.
+ * @batch: The data_vios to hash.
+ * @count: The number of data_vios in the batch.
+ */
+static void hash_batch(struct data_vio **batch, unsigned int count)
+{
+	unsigned int i = 0;
+
+	for (; (i + MURMURHASH3_LANES) <= count; i += MURMURHASH3_LANES) {
+		const void *keys[MURMURHASH3_LANES];
+		void *names[MURMURHASH3_LANES];
+		unsigned int lane;
+
+		for (lane = 0; lane < MURMURHASH3_LANES; lane++) {
+			keys[lane] = batch[i + lane]->data_block;
+			names[lane] = &batch[i + lane]->chunk_name;
+		}
+
+		murmurhash3_128_multi(keys,
+				      VDO_BLOCK_SIZE,
+				      CHUNK_NAME_SEED,
+				      names);
+	}
+
+	for (; i < count; i++) {
+		murmurhash3_128(batch[i]->data_block,
+				VDO_BLOCK_SIZE,
+				CHUNK_NAME_SEED,
+				&batch[i]->chunk_name);
+	}
+}
+
+/**
+ * hash_batch_trusted() - Compute the SHA-256 chunk names of a batch of
+ *                        data_vios.
+ * @batch: The data_vios to hash.
+ * @count: The number of data_vios in the batch.
+ */
+static void hash_batch_trusted(struct data_vio **batch, unsigned int count)
+{
+#if VDO_HAVE_SHA256
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		u8 digest[SHA256_DIGEST_SIZE];
+
+		sha256(batch[i]->data_block, VDO_BLOCK_SIZE, digest);
+		memcpy(&batch[i]->chunk_name, digest, UDS_CHUNK_NAME_SIZE);
+		batch[i]->trusted_name = true;
+	}
+#else
+	hash_batch(batch, count);
+#endif
+}
+
+/**
+ * process_batch_callback() - Hash a batch of data_vios and send each of them
+ *                            on to its hash zone.
+ * @completion: The hasher.
+ */
+static void process_batch_callback(struct vdo_completion *completion)
+{
+	struct hasher *hasher = as_hasher(completion);
+	struct hash_zones *zones = completion->vdo->hash_zones;
+	unsigned int count;
+	unsigned int i;
+
+	assert_on_vdo_cpu_thread(completion->vdo, __func__);
+	for (count = 0; count < HASH_BATCH_SIZE; count++) {
+		struct funnel_queue_entry *entry
+			= funnel_queue_poll(hasher->queue);
+
+		if (entry == NULL) {
+			break;
+		}
+
+		hasher->batch[count] = data_vio_from_funnel_queue_entry(entry);
+		ASSERT_LOG_ONLY(!hasher->batch[count]->is_zero_block,
+				"zero blocks should not be hashed");
+	}
+
+	if (READ_ONCE(completion->vdo->trusted_dedupe)) {
+		hash_batch_trusted(hasher->batch, count);
+	} else {
+		hash_batch(hasher->batch, count);
+	}
+
+	atomic_set(&hasher->processing, false);
+	/* Pairs with the barrier in schedule_hashing(). */
+	smp_mb();
+	if (!is_funnel_queue_empty(hasher->queue)) {
+		schedule_hashing(hasher);
+	}
+
+	/*
+	 * The batch array is not touched by anyone else until this callback
+	 * runs again, which it can't do on this thread until this invocation
+	 * returns, and which can't happen on another thread until the
+	 * completion is rescheduled above.
+	 */
+	for (i = 0; i < count; i++) {
+		struct data_vio *data_vio = hasher->batch[i];
+
+		data_vio->hash_zone = vdo_select_hash_zone(zones,
+							   &data_vio->chunk_name);
+		data_vio->last_async_operation =
+			VIO_ASYNC_OP_ACQUIRE_VDO_HASH_LOCK;
+		launch_data_vio_hash_zone_callback(data_vio,
+						   data_vio_as_completion(data_vio)->callback);
+	}
+}
+
+/**
+ * vdo_make_hashers() - Make the hashers for a vdo.
+ * @vdo: The vdo which will own the hashers.
+ * @hasher_count: The number of hashers to make.
+ * @hashers_ptr: A pointer to hold the new hashers.
+ *
+ * Return: VDO_SUCCESS or an error.
+ */
+int vdo_make_hashers(struct vdo *vdo,
+		     unsigned int hasher_count,
+		     struct hashers **hashers_ptr)
+{
+	struct hashers *hashers;
+	unsigned int i;
+	int result = UDS_ALLOCATE_EXTENDED(struct hashers,
+					   hasher_count,
+					   struct hasher,
+					   __func__,
+					   &hashers);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; i < hasher_count; i++) {
+		struct hasher *hasher = &hashers->hashers[i];
+
+		vdo_initialize_completion(&hasher->completion,
+					  vdo,
+					  VDO_HASHER_COMPLETION);
+		vdo_prepare_completion(&hasher->completion,
+				       process_batch_callback,
+				       process_batch_callback,
+				       vdo->thread_config->cpu_thread,
+				       NULL);
+		result = make_funnel_queue(&hasher->queue);
+		if (result != UDS_SUCCESS) {
+			vdo_free_hashers(hashers);
+			return result;
+		}
+
+		hashers->count++;
+	}
+
+	*hashers_ptr = hashers;
+	return VDO_SUCCESS;
+}
+
+/**
+ * vdo_free_hashers() - Free the hashers of a vdo.
+ * @hashers: The hashers to free (may be NULL).
+ *
+ * No data_vios may be waiting to be hashed when this is called.
+ */
+void vdo_free_hashers(struct hashers *hashers)
+{
+	unsigned int i;
+
+	if (hashers == NULL) {
+		return;
+	}
+
+	/* Pairs with the barrier in process_batch_callback(). */
+	smp_mb();
+	for (i = 0; i < hashers->count; i++) {
+		struct hasher *hasher = &hashers->hashers[i];
+
+		ASSERT_LOG_ONLY(!atomic_read(&hasher->processing),
+				"hasher must not be processing when freed");
+		free_funnel_queue(UDS_FORGET(hasher->queue));
+	}
+
+	UDS_FREE(hashers);
+}
+
+/**
+ * vdo_hash_data_vio() - Hash the data in a data_vio, set its hash zone (which
+ *                       also flags the chunk name as set), and then continue
+ *                       it on that zone's thread.
+ * @data_vio: The data_vio to hash.
+ * @callback: The hash zone callback to launch once the data_vio is hashed.
+ *
+ * This may be called from any thread.
+ */
+void vdo_hash_data_vio(struct data_vio *data_vio, vdo_action *callback)
+{
+	struct vdo_completion *completion = data_vio_as_completion(data_vio);
+	struct hashers *hashers = completion->vdo->hashers;
+	struct hasher *hasher
+		= &hashers->hashers[data_vio->logical.lbn % hashers->count];
+
+	completion->callback = callback;
+	funnel_queue_put(hasher->queue, &completion->work_queue_entry_link);
+	schedule_hashing(hasher);
+}
+
+/**
+ * vdo_set_trusted_dedupe() - Set whether data written to a vdo is named with
+ *                            SHA-256 so that dedupe advice may be trusted.
+ * @vdo: The vdo.
+ * @trusted: Whether to trust dedupe advice.
+ *
+ * This may be called from any thread. Data_vios which have already been
+ * hashed keep the names they have.
+ */
+void vdo_set_trusted_dedupe(struct vdo *vdo, bool trusted)
+{
+	if (trusted && !VDO_HAVE_SHA256) {
+		uds_log_warning("SHA-256 is not available, so dedupe advice will be verified");
+		trusted = false;
+	}
+
+	WRITE_ONCE(vdo->trusted_dedupe, trusted);
+	uds_log_info("trusted dedupe is %s",
+		     (trusted ? "enabled" : "disabled"));
+}
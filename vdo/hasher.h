@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright Red Hat
+ */
+
+#ifndef HASHER_H
+#define HASHER_H
+
+#include "completion.h"
+#include "kernel-types.h"
+#include "types.h"
+
+struct hashers;
+
+int __must_check vdo_make_hashers(struct vdo *vdo,
+				  unsigned int hasher_count,
+				  struct hashers **hashers_ptr);
+
+void vdo_free_hashers(struct hashers *hashers);
+
+void vdo_hash_data_vio(struct data_vio *data_vio, vdo_action *callback);
+
+void vdo_set_trusted_dedupe(struct vdo *vdo, bool trusted);
+
+#endif /* HASHER_H */
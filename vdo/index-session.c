@@ -110,11 +110,8 @@ static int get_index_session(struct uds_index_session *index_session)
 	return result;
 }
 
-int uds_start_chunk_operation(struct uds_request *request)
+static int check_chunk_request(struct uds_request *request)
 {
-	size_t internal_size;
-	int result;
-
 	if (request->callback == NULL) {
 		uds_log_error("missing required callback");
 		return -EINVAL;
@@ -126,11 +123,16 @@ int uds_start_chunk_operation(struct uds_request *request)
 	case UDS_QUERY:
 	case UDS_QUERY_NO_UPDATE:
 	case UDS_UPDATE:
-		break;
+		return UDS_SUCCESS;
 	default:
 		uds_log_error("received invalid callback type");
 		return -EINVAL;
 	}
+}
+
+static void prepare_chunk_request(struct uds_request *request)
+{
+	size_t internal_size;
 
 	/* Reset all internal fields before processing. */
 	internal_size = sizeof(struct uds_request) -
@@ -139,19 +141,79 @@ int uds_start_chunk_operation(struct uds_request *request)
 	memset((char *) request + sizeof(*request) - internal_size,
 	       0, internal_size);
 
-	result = get_index_session(request->session);
+	request->found = false;
+	request->unbatched = false;
+	request->index = request->session->index;
+}
+
+int uds_start_chunk_operation(struct uds_request *request)
+{
+	int result;
+
+	result = check_chunk_request(request);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
 
-	request->found = false;
-	request->unbatched = false;
-	request->index = request->session->index;
+	result = get_index_session(request->session);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
 
+	prepare_chunk_request(request);
 	enqueue_request(request, STAGE_TRIAGE);
 	return UDS_SUCCESS;
 }
 
+int uds_start_chunk_operations(struct uds_request **requests,
+			       unsigned int count)
+{
+	struct uds_index_session *index_session;
+	unsigned int i;
+	int result;
+
+	if (count == 0) {
+		return UDS_SUCCESS;
+	}
+
+	if (count > UDS_MAX_REQUEST_BATCH) {
+		uds_log_error("request batch of %u is too large", count);
+		return -EINVAL;
+	}
+
+	index_session = requests[0]->session;
+	for (i = 0; i < count; i++) {
+		if (requests[i]->session != index_session) {
+			uds_log_error("request batch spans index sessions");
+			return -EINVAL;
+		}
+
+		result = check_chunk_request(requests[i]);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
+
+	/* Each request holds its own reference until its callback is done. */
+	for (i = 0; i < count; i++) {
+		result = get_index_session(index_session);
+		if (result != UDS_SUCCESS) {
+			while (i-- > 0) {
+				release_index_session(index_session);
+			}
+
+			return result;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		prepare_chunk_request(requests[i]);
+	}
+
+	enqueue_new_requests(requests, count);
+	return UDS_SUCCESS;
+}
+
 static void enter_callback_stage(struct uds_request *request)
 {
 	if (request->status != UDS_SUCCESS) {
@@ -1616,3 +1616,69 @@ void enqueue_request(struct uds_request *request, enum request_stage stage)
 
 	uds_request_queue_enqueue(queue, request);
 }
+
+/*
+ * Start a batch of new requests for the same index, handing them to each
+ * queue as a group so that each queue's worker is woken at most once. The
+ * requests are grouped by zone in place, so the order of the array is not
+ * preserved.
+ */
+void enqueue_new_requests(struct uds_request **requests, unsigned int count)
+{
+	struct uds_index *index;
+	unsigned int zone;
+	unsigned int start = 0;
+	unsigned int i;
+
+	if (count == 0) {
+		return;
+	}
+
+	if (ASSERT(count <= UDS_MAX_REQUEST_BATCH,
+		   "request batch of %u is not larger than %u",
+		   count,
+		   UDS_MAX_REQUEST_BATCH) != UDS_SUCCESS) {
+		for (i = 0; i < count; i++) {
+			enqueue_request(requests[i], STAGE_TRIAGE);
+		}
+
+		return;
+	}
+
+	index = requests[0]->index;
+	if (index->triage_queue != NULL) {
+		uds_request_queue_enqueue_batch(index->triage_queue,
+						requests,
+						count);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		requests[i]->zone_number =
+			get_volume_index_zone(index->volume_index,
+					      &requests[i]->chunk_name);
+	}
+
+	/*
+	 * A queued request may be processed, and completed, at any time, so
+	 * only the part of the array which has not yet been queued may be
+	 * examined or rearranged.
+	 */
+	for (zone = 0; (zone < index->zone_count) && (start < count); zone++) {
+		unsigned int end = start;
+
+		for (i = start; i < count; i++) {
+			struct uds_request *request = requests[i];
+
+			if (request->zone_number == zone) {
+				requests[i] = requests[end];
+				requests[end++] = request;
+			}
+		}
+
+		uds_request_queue_enqueue_batch(index->zone_queues[zone],
+						&requests[start],
+						end - start);
+		start = end;
+	}
+}
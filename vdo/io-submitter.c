@@ -81,7 +81,7 @@ static void count_all_bios(struct vio *vio, struct bio *bio)
 {
 	struct atomic_statistics *stats = &vdo_from_vio(vio)->stats;
 
-	if (is_data_vio(vio)) {
+	if (is_data_vio(vio) || (vio->type == VIO_TYPE_READAHEAD)) {
 		vdo_count_bios(&stats->bios_out, bio);
 		return;
 	}
@@ -358,31 +358,23 @@ void submit_data_vio_io(struct data_vio *data_vio)
 }
 
 /**
- * vdo_submit_metadata_io() - Submit I/O for a metadata vio.
- *
- * The vio is enqueued on a vdo bio queue so that bio submission (which may
- * block) does not block other vdo threads.
- *
- * That the error handler will run on the correct thread is only true so long
- * as the thread calling this function, and the thread set in the endio
- * callback are the same, as well as the fact that no error can occur on the
- * bio queue. Currently this is true for all callers, but additional care will
- * be needed if this ever changes.
-
- * @vio: the vio for which to issue I/O
- * @physical: the physical block number to read or write
- * @callback: the bio endio function which will be called after the I/O
- *            completes
- * @error_handler: the handler for submission or I/O errors (may be NULL)
- * @operation: the type of I/O to perform
- * @data: the buffer to read or write (may be NULL)
- **/
-void vdo_submit_metadata_io(struct vio *vio,
-			    physical_block_number_t physical,
-			    bio_end_io_t callback,
-			    vdo_action *error_handler,
-			    unsigned int operation,
-			    char *data)
+ * submit_vio_io() - Submit I/O for a vio which does not merge its bios.
+ * @vio: The vio for which to issue I/O.
+ * @physical: The physical block number to read or write.
+ * @callback: The bio endio function which will be called after the I/O
+ *            completes.
+ * @error_handler: The handler for submission or I/O errors (may be NULL).
+ * @bi_opf: The operation and flags for the bio.
+ * @data: The buffer to read or write (may be NULL).
+ * @priority: The priority with which to submit the bio.
+ */
+static void submit_vio_io(struct vio *vio,
+			  physical_block_number_t physical,
+			  bio_end_io_t callback,
+			  vdo_action *error_handler,
+			  unsigned int bi_opf,
+			  char *data,
+			  enum vdo_completion_priority priority)
 {
 	struct vdo_completion *completion = vio_as_completion(vio);
 	int result;
@@ -402,7 +394,7 @@ void vdo_submit_metadata_io(struct vio *vio,
 					   data,
 					   vio,
 					   callback,
-					   operation | REQ_META,
+					   bi_opf,
 					   vio->physical);
 	if (result != VDO_SUCCESS) {
 		continue_vio(vio, result);
@@ -412,8 +404,70 @@ void vdo_submit_metadata_io(struct vio *vio,
 	vdo_set_completion_callback(completion,
 				    process_vio_io,
 				    get_vio_bio_zone_thread_id(vio));
-	vdo_invoke_completion_callback_with_priority(completion,
-						     get_metadata_priority(vio));
+	vdo_invoke_completion_callback_with_priority(completion, priority);
+}
+
+/**
+ * vdo_submit_metadata_io() - Submit I/O for a metadata vio.
+ *
+ * The vio is enqueued on a vdo bio queue so that bio submission (which may
+ * block) does not block other vdo threads.
+ *
+ * That the error handler will run on the correct thread is only true so long
+ * as the thread calling this function, and the thread set in the endio
+ * callback are the same, as well as the fact that no error can occur on the
+ * bio queue. Currently this is true for all callers, but additional care will
+ * be needed if this ever changes.
+
+ * @vio: the vio for which to issue I/O
+ * @physical: the physical block number to read or write
+ * @callback: the bio endio function which will be called after the I/O
+ *            completes
+ * @error_handler: the handler for submission or I/O errors (may be NULL)
+ * @operation: the type of I/O to perform
+ * @data: the buffer to read or write (may be NULL)
+ **/
+void vdo_submit_metadata_io(struct vio *vio,
+			    physical_block_number_t physical,
+			    bio_end_io_t callback,
+			    vdo_action *error_handler,
+			    unsigned int operation,
+			    char *data)
+{
+	submit_vio_io(vio,
+		      physical,
+		      callback,
+		      error_handler,
+		      operation | REQ_META,
+		      data,
+		      get_metadata_priority(vio));
+}
+
+/**
+ * vdo_submit_readahead_io() - Submit a read of data blocks which no request
+ *                             has asked for yet.
+ * @vio: The vio for which to issue I/O, whose block count is the number of
+ *       blocks to read into its data buffer.
+ * @physical: The first physical block to read.
+ * @callback: The bio endio function which will be called after the I/O
+ *            completes.
+ * @error_handler: The handler for submission or I/O errors.
+ *
+ * The read is marked as readahead, and is submitted at data priority, since
+ * it is neither metadata nor needed by anyone yet.
+ */
+void vdo_submit_readahead_io(struct vio *vio,
+			     physical_block_number_t physical,
+			     bio_end_io_t callback,
+			     vdo_action *error_handler)
+{
+	submit_vio_io(vio,
+		      physical,
+		      callback,
+		      error_handler,
+		      REQ_OP_READ | REQ_RAHEAD,
+		      vio->data,
+		      BIO_Q_DATA_PRIORITY);
 }
 
 /**
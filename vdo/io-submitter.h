@@ -33,6 +33,11 @@ void vdo_submit_metadata_io(struct vio *vio,
 			    unsigned int operation,
 			    char *data);
 
+void vdo_submit_readahead_io(struct vio *vio,
+			     physical_block_number_t physical,
+			     bio_end_io_t callback,
+			     vdo_action *error_handler);
+
 static inline void submit_metadata_vio(struct vio *vio,
 				       physical_block_number_t physical,
 				       bio_end_io_t callback,
@@ -78,6 +78,7 @@ enum vio_type {
 	VIO_TYPE_SLAB_JOURNAL,
 	VIO_TYPE_SLAB_SUMMARY,
 	VIO_TYPE_SUPER_BLOCK,
+	VIO_TYPE_READAHEAD,
 	VIO_TYPE_TEST,
 } __packed;
 
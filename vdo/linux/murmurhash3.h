@@ -9,6 +9,13 @@
 
 #include <linux/types.h>
 
+/* The number of buffers hashed together by murmurhash3_128_multi(). */
+#define MURMURHASH3_LANES 4
+
 void murmurhash3_128(const void *key, int len, uint32_t seed, void *out);
 
+void murmurhash3_128_multi(const void *const keys[MURMURHASH3_LANES],
+			   int len, uint32_t seed,
+			   void *const outs[MURMURHASH3_LANES]);
+
 #endif /* _MURMURHASH3_H_ */
@@ -18,6 +18,7 @@
 #include "data-vio.h"
 #include "flush.h"
 #include "int-map.h"
+#include "stream-detector.h"
 #include "vdo.h"
 
 /**
@@ -85,6 +86,11 @@ static int initialize_zone(struct logical_zones *zones,
 		return result;
 	}
 
+	result = vdo_make_stream_detector(zone, &zone->stream_detector);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
 	return vdo_make_default_thread(vdo, zone->thread_id);
 }
 
@@ -156,6 +162,7 @@ void vdo_free_logical_zones(struct logical_zones *zones)
 		struct logical_zone *zone = &zones->zones[index];
 
 		UDS_FREE(UDS_FORGET(zone->selector));
+		vdo_free_stream_detector(UDS_FORGET(zone->stream_detector));
 		free_int_map(UDS_FORGET(zone->lbn_operations));
 	}
 
@@ -170,13 +177,17 @@ static inline void assert_on_zone_thread(struct logical_zone *zone,
 }
 
 /**
- * check_for_drain_complete() - Check whether this zone has drained.
+ * vdo_check_for_logical_zone_drain() - Check whether a logical zone has
+ *                                      drained.
  * @zone: The zone to check.
+ *
+ * This must be called from the zone's thread.
  */
-static void check_for_drain_complete(struct logical_zone *zone)
+void vdo_check_for_logical_zone_drain(struct logical_zone *zone)
 {
 	if (!vdo_is_state_draining(&zone->state) || zone->notifying
-	    || !list_empty(&zone->write_vios)) {
+	    || !list_empty(&zone->write_vios)
+	    || vdo_is_reading_ahead(zone->stream_detector)) {
 		return;
 	}
 
@@ -190,7 +201,7 @@ static void check_for_drain_complete(struct logical_zone *zone)
  */
 static void initiate_drain(struct admin_state *state)
 {
-	check_for_drain_complete(container_of(state,
+	vdo_check_for_logical_zone_drain(container_of(state,
 					      struct logical_zone,
 					      state));
 }
@@ -354,7 +365,7 @@ attempt_generation_complete_notification(struct vdo_completion *completion)
 	assert_on_zone_thread(zone, __func__);
 	if (zone->oldest_active_generation <= zone->notification_generation) {
 		zone->notifying = false;
-		check_for_drain_complete(zone);
+		vdo_check_for_logical_zone_drain(zone);
 		return;
 	}
 
@@ -44,6 +44,8 @@ struct logical_zone {
 	struct admin_state state;
 	/* The selector for determining which physical zone to allocate from */
 	struct allocation_selector *selector;
+	/* The detector of sequential read streams */
+	struct stream_detector *stream_detector;
 	/* The next zone */
 	struct logical_zone *next;
 };
@@ -71,6 +73,8 @@ void vdo_drain_logical_zones(struct logical_zones *zones,
 void vdo_resume_logical_zones(struct logical_zones *zones,
 			      struct vdo_completion *parent);
 
+void vdo_check_for_logical_zone_drain(struct logical_zone *zone);
+
 void
 vdo_increment_logical_zone_flush_generation(struct logical_zone *zone,
 					    sequence_number_t expected_generation);
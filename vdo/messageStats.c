@@ -312,6 +312,78 @@ int write_packer_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/* Number of bins written because they waited too long */
+	result = write_uint64_t("binsExpired : ",
+				stats->bins_expired,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of bins written after waiting under 1 ms */
+	result = write_uint64_t("binWaitUnder1ms : ",
+				stats->bin_wait_under_1ms,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of bins written after waiting 1 to 10 ms */
+	result = write_uint64_t("binWaitUnder10ms : ",
+				stats->bin_wait_under_10ms,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of bins written after waiting 10 to 100 ms */
+	result = write_uint64_t("binWaitUnder100ms : ",
+				stats->bin_wait_under_100ms,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of bins written after waiting 100 ms to 1 s */
+	result = write_uint64_t("binWaitUnder1s : ",
+				stats->bin_wait_under_1s,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of bins written after waiting over 1 s */
+	result = write_uint64_t("binWaitOver1s : ",
+				stats->bin_wait_over_1s,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of bytes of compressed fragments in the blocks written */
+	result = write_uint64_t("compressedBytesWritten : ",
+				stats->compressed_bytes_written,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of fragments moved to a fuller bin before it was written */
+	result = write_uint64_t("fragmentsRepacked : ",
+				stats->fragments_repacked,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	result = write_string(NULL, "}", suffix, buf, maxlen);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -658,6 +730,24 @@ int write_hash_lock_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/* Number of times advice was found in the hash zone's advice cache */
+	result = write_uint64_t("dedupeAdviceCached : ",
+				stats->dedupe_advice_cached,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of times the UDS advice was trusted without being read */
+	result = write_uint64_t("dedupeAdviceTrusted : ",
+				stats->dedupe_advice_trusted,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	/* Number of writes with the same data as another in-flight write */
 	result = write_uint64_t("concurrentDataMatches : ",
 				stats->concurrent_data_matches,
@@ -922,6 +1012,139 @@ int write_index_statistics(char *prefix,
 	return VDO_SUCCESS;
 }
 
+int write_compression_statistics(char *prefix,
+				 struct compression_statistics *stats,
+				 char *suffix,
+				 char **buf,
+				 unsigned int *maxlen)
+{
+	int result = write_string(prefix, "{ ", NULL, buf, maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of blocks compressed which did not fit in a fragment */
+	result = write_uint64_t("failures : ",
+				stats->failures,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of blocks not compressed due to high sampled entropy */
+	result = write_uint64_t("entropySkipped : ",
+				stats->entropy_skipped,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of high entropy blocks compressed anyway to check the estimate */
+	result = write_uint64_t("entropyAudited : ",
+				stats->entropy_audited,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of audited high entropy blocks which did compress */
+	result = write_uint64_t("entropyMispredicted : ",
+				stats->entropy_mispredicted,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of blocks run through a compression engine */
+	result = write_uint64_t("compressed : ",
+				stats->compressed,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of blocks compressed faster due to load */
+	result = write_uint64_t("downgraded : ",
+				stats->downgraded,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of blocks not compressed due to load */
+	result = write_uint64_t("skippedForLoad : ",
+				stats->skipped_for_load,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of blocks waiting for or undergoing compression */
+	result = write_uint64_t("pending : ",
+				stats->pending,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Moving average time to compress a block in ns */
+	result = write_uint64_t("averageLatency : ",
+				stats->average_latency,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	result = write_string(NULL, "}", suffix, buf, maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	return VDO_SUCCESS;
+}
+
+int write_compressed_block_cache_statistics(char *prefix,
+					    struct compressed_block_cache_statistics *stats,
+					    char *suffix,
+					    char **buf,
+					    unsigned int *maxlen)
+{
+	int result = write_string(prefix, "{ ", NULL, buf, maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of compressed block reads satisfied from the cache */
+	result = write_uint64_t("hits : ",
+				stats->hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of compressed block reads which went to storage */
+	result = write_uint64_t("misses : ",
+				stats->misses,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	result = write_string(NULL, "}", suffix, buf, maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	return VDO_SUCCESS;
+}
+
 int write_vdo_statistics(char *prefix,
 			 struct vdo_statistics *stats,
 			 char *suffix,
@@ -1065,6 +1288,24 @@ int write_vdo_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/* Counts of reads of compressed blocks from the compressed block cache */
+	result = write_compressed_block_cache_statistics("compressedBlockCache : ",
+							 &stats->compressed_block_cache,
+							 ", ",
+							 buf,
+							 maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* The statistics for compression */
+	result = write_compression_statistics("compression : ",
+					      &stats->compression,
+					      ", ",
+					      buf,
+					      maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	/* Counters for events in the block allocator */
 	result = write_block_allocator_statistics("allocator : ",
 						  &stats->allocator,
@@ -1164,6 +1405,42 @@ int write_vdo_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/* Current limit on the number of active VIOs */
+	result = write_uint32_t("requestLimit : ",
+				stats->request_limit,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Target 99th percentile request latency in microseconds */
+	result = write_uint32_t("requestLatencyTarget : ",
+				stats->request_latency_target,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Median request latency in microseconds */
+	result = write_uint32_t("requestLatencyP50 : ",
+				stats->request_latency_p50,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* 99th percentile request latency in microseconds */
+	result = write_uint32_t("requestLatencyP99 : ",
+				stats->request_latency_p99,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	/* Number of times the UDS index was too slow in responding */
 	result = write_uint64_t("dedupeAdviceTimeouts : ",
 				stats->dedupe_advice_timeouts,
@@ -1173,6 +1450,15 @@ int write_vdo_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/* Number of dedupe queries which were answered after timing out */
+	result = write_uint64_t("dedupeAdviceLate : ",
+				stats->dedupe_advice_late,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	/* Number of flush requests submitted to the storage device */
 	result = write_uint64_t("flushOut : ",
 				stats->flush_out,
@@ -1182,6 +1468,42 @@ int write_vdo_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/* Number of partial writes merged into another read-modify-write */
+	result = write_uint64_t("partialWritesCoalesced : ",
+				stats->partial_writes_coalesced,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of reads satisfied by another read of the same physical block */
+	result = write_uint64_t("readsShared : ",
+				stats->reads_shared,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of data blocks read ahead of sequential read streams */
+	result = write_uint64_t("blocksReadAhead : ",
+				stats->blocks_read_ahead,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/* Number of reads satisfied by data which was read ahead */
+	result = write_uint64_t("readaheadHits : ",
+				stats->readahead_hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	/* Logical block size */
 	result = write_uint64_t("logicalBlockSize : ",
 				stats->logical_block_size,
@@ -50,46 +50,47 @@ static __always_inline uint64_t fmix64(uint64_t k)
 	return k;
 }
 
-void murmurhash3_128(const void *key, const int len, const uint32_t seed,
-			  void *out)
+static const uint64_t c1 = 0x87c37b91114253d5LLU;
+static const uint64_t c2 = 0x4cf5ad432745937fLLU;
+
+/* Mix one 16 byte block of input into the hash state. */
+
+static __always_inline void mix_block(const uint64_t *blocks, int i,
+				      uint64_t *h1_ptr, uint64_t *h2_ptr)
 {
-	const uint8_t *data = (const uint8_t *)key;
-	const int nblocks = len / 16;
+	uint64_t h1 = *h1_ptr;
+	uint64_t h2 = *h2_ptr;
+	uint64_t k1 = getblock64(blocks, i * 2 + 0);
+	uint64_t k2 = getblock64(blocks, i * 2 + 1);
 
-	uint64_t h1 = seed;
-	uint64_t h2 = seed;
+	k1 *= c1;
+	k1 = ROTL64(k1, 31);
+	k1 *= c2;
+	h1 ^= k1;
 
-	const uint64_t c1 = 0x87c37b91114253d5LLU;
-	const uint64_t c2 = 0x4cf5ad432745937fLLU;
+	h1 = ROTL64(h1, 27);
+	h1 += h2;
+	h1 = h1 * 5 + 0x52dce729;
 
-	/* body */
+	k2 *= c2;
+	k2 = ROTL64(k2, 33);
+	k2 *= c1;
+	h2 ^= k2;
 
-	const uint64_t *blocks = (const uint64_t *)(data);
+	h2 = ROTL64(h2, 31);
+	h2 += h1;
+	h2 = h2 * 5 + 0x38495ab5;
 
-	int i;
+	*h1_ptr = h1;
+	*h2_ptr = h2;
+}
 
-	for (i = 0; i < nblocks; i++) {
-		uint64_t k1 = getblock64(blocks, i * 2 + 0);
-		uint64_t k2 = getblock64(blocks, i * 2 + 1);
-
-		k1 *= c1;
-		k1 = ROTL64(k1, 31);
-		k1 *= c2;
-		h1 ^= k1;
-
-		h1 = ROTL64(h1, 27);
-		h1 += h2;
-		h1 = h1 * 5 + 0x52dce729;
-
-		k2 *= c2;
-		k2 = ROTL64(k2, 33);
-		k2 *= c1;
-		h2 ^= k2;
-
-		h2 = ROTL64(h2, 31);
-		h2 += h1;
-		h2 = h2 * 5 + 0x38495ab5;
-	}
+/* Mix in the tail of the input, finalize the hash, and store it. */
+
+static __always_inline void finish_hash(const uint8_t *data, const int len,
+					uint64_t h1, uint64_t h2, void *out)
+{
+	const int nblocks = len / 16;
 
 	/* tail */
 
@@ -176,4 +177,66 @@ void murmurhash3_128(const void *key, const int len, const uint32_t seed,
 	putblock64((uint64_t *)out, 1, h2);
 }
 
+void murmurhash3_128(const void *key, const int len, const uint32_t seed,
+			  void *out)
+{
+	const uint8_t *data = (const uint8_t *)key;
+	const int nblocks = len / 16;
+
+	uint64_t h1 = seed;
+	uint64_t h2 = seed;
+
+	/* body */
+
+	const uint64_t *blocks = (const uint64_t *)(data);
+
+	int i;
+
+	for (i = 0; i < nblocks; i++) {
+		mix_block(blocks, i, &h1, &h2);
+	}
+
+	finish_hash(data, len, h1, h2, out);
+}
+
 EXPORT_SYMBOL(murmurhash3_128);
+
+/*
+ * Hash MURMURHASH3_LANES buffers of the same length at once. Each buffer is
+ * hashed exactly as murmurhash3_128() would hash it; the lanes are merely
+ * interleaved so that the independent multiply chains of each lane can
+ * overlap in the pipeline instead of each block waiting on the latency of
+ * the previous one.
+ */
+void murmurhash3_128_multi(const void *const keys[MURMURHASH3_LANES],
+			   const int len, const uint32_t seed,
+			   void *const outs[MURMURHASH3_LANES])
+{
+	const int nblocks = len / 16;
+	const uint64_t *blocks[MURMURHASH3_LANES];
+	uint64_t h1[MURMURHASH3_LANES];
+	uint64_t h2[MURMURHASH3_LANES];
+	int lane;
+	int i;
+
+	for (lane = 0; lane < MURMURHASH3_LANES; lane++) {
+		blocks[lane] = (const uint64_t *)(keys[lane]);
+		h1[lane] = seed;
+		h2[lane] = seed;
+	}
+
+	/* body */
+
+	for (i = 0; i < nblocks; i++) {
+		for (lane = 0; lane < MURMURHASH3_LANES; lane++) {
+			mix_block(blocks[lane], i, &h1[lane], &h2[lane]);
+		}
+	}
+
+	for (lane = 0; lane < MURMURHASH3_LANES; lane++) {
+		finish_hash((const uint8_t *)(keys[lane]), len, h1[lane],
+			    h2[lane], outs[lane]);
+	}
+}
+
+EXPORT_SYMBOL(murmurhash3_128_multi);
@@ -6,12 +6,14 @@
 #include "packer.h"
 
 #include <linux/atomic.h>
+#include <linux/jiffies.h>
 
 #include "logger.h"
 #include "memory-alloc.h"
 #include "permassert.h"
 #include "string-utils.h"
 
+#include "action-manager.h"
 #include "admin-state.h"
 #include "allocation-selector.h"
 #include "completion.h"
@@ -19,9 +21,11 @@
 #include "compressed-block.h"
 #include "compression-state.h"
 #include "data-vio.h"
+#include "data-vio-pool.h"
 #include "dedupe.h"
 #include "io-submitter.h"
 #include "pbn-lock.h"
+#include "physical-zone.h"
 #include "read-only-notifier.h"
 #include "status-codes.h"
 #include "thread-config.h"
@@ -29,6 +33,20 @@
 #include "vio.h"
 #include "vio-write.h"
 
+/*
+ * Bins which wait too long for more fragments are written out by a timer on
+ * the packer thread. The timer is started when a bin receives its first
+ * fragment, if it isn't already running. When it fires, every bin older than
+ * the deadline is written out, and the timer is restarted for the oldest
+ * remaining bin. The deadline shrinks as the data_vio pool fills so that
+ * data_vios don't sit in the packer while other requests wait for them.
+ */
+enum packer_timer_state {
+	PACKER_TIMER_IDLE,
+	PACKER_TIMER_RUNNING,
+	PACKER_TIMER_FIRED,
+};
+
 /**
  * assert_on_packer_thread() - Check that we are on the packer thread.
  * @packer: The packer.
@@ -41,6 +59,88 @@ static inline void assert_on_packer_thread(struct packer *packer,
 			"%s() called from packer thread", caller);
 }
 
+/**
+ * as_packer() - Convert a vdo_completion to a packer.
+ * @completion: The completion to convert.
+ *
+ * Return: The completion as a packer.
+ */
+static inline struct packer *as_packer(struct vdo_completion *completion)
+{
+	vdo_assert_completion_type(completion->type, VDO_PACKER_COMPLETION);
+	return container_of(completion, struct packer, completion);
+}
+
+static inline bool change_timer_state(struct packer *packer, int old, int new)
+{
+	return (atomic_cmpxchg(&packer->timer_state, old, new) == old);
+}
+
+/**
+ * get_deadline_jiffies() - Get the number of jiffies a bin may wait for more
+ *                          fragments given the current load.
+ * @packer: The packer.
+ *
+ * The configured deadline applies when the data_vio pool is idle, and shrinks
+ * in proportion to the number of data_vios which are busy.
+ */
+static unsigned long get_deadline_jiffies(struct packer *packer)
+{
+	struct data_vio_pool *pool = packer->completion.vdo->data_vio_pool;
+	uint64_t limit = max_t(uint64_t,
+			       1,
+			       get_data_vio_pool_request_limit(pool));
+	uint64_t busy = min_t(uint64_t,
+			      limit,
+			      get_data_vio_pool_recent_active_requests(pool));
+	uint64_t deadline = msecs_to_jiffies(READ_ONCE(packer->deadline));
+
+	return max_t(unsigned long, 1, (deadline * (limit - busy)) / limit);
+}
+
+/**
+ * start_deadline_timer() - Start the deadline timer if it isn't running.
+ * @packer: The packer.
+ * @arrival: The arrival time of the oldest bin which is waiting.
+ */
+static void start_deadline_timer(struct packer *packer,
+				 unsigned long arrival)
+{
+	unsigned long expires;
+
+	if ((READ_ONCE(packer->deadline) == 0) ||
+	    !change_timer_state(packer,
+				PACKER_TIMER_IDLE,
+				PACKER_TIMER_RUNNING)) {
+		return;
+	}
+
+	expires = arrival + get_deadline_jiffies(packer);
+	if (!time_after(expires, jiffies)) {
+		expires = jiffies + 1;
+	}
+
+	mod_timer(&packer->timer, expires);
+}
+
+/**
+ * deadline_timer_expired() - Schedule the writing of expired bins on the
+ *                            packer thread.
+ * @timer: The packer's timer.
+ *
+ * This is the timer function registered in vdo_make_packers().
+ */
+static void deadline_timer_expired(struct timer_list *timer)
+{
+	struct packer *packer = from_timer(packer, timer, timer);
+
+	if (change_timer_state(packer,
+			       PACKER_TIMER_RUNNING,
+			       PACKER_TIMER_FIRED)) {
+		vdo_invoke_completion_callback(&packer->completion);
+	}
+}
+
 /**
  * vdo_next_packer_bin() - Return the next bin in the free_space-sorted list.
  */
@@ -111,42 +211,45 @@ static int __must_check make_bin(struct packer *packer)
 	return VDO_SUCCESS;
 }
 
+static void write_expired_bins(struct vdo_completion *completion);
+
 /**
- * vdo_make_packer() - Make a new block packer.
- *
- * @vdo: The vdo to which this packer belongs.
+ * initialize_packer() - Initialize the packer for one physical zone.
+ * @vdo: The vdo to which the packer belongs.
+ * @packer: The packer to initialize.
+ * @zone_number: The physical zone of the packer.
  * @bin_count: The number of partial bins to keep in memory.
- * @packer_ptr: A pointer to hold the new packer.
  *
  * Return: VDO_SUCCESS or an error
  */
-int vdo_make_packer(struct vdo *vdo,
-		    block_count_t bin_count,
-		    struct packer **packer_ptr)
+static int initialize_packer(struct vdo *vdo,
+			     struct packer *packer,
+			     zone_count_t zone_number,
+			     block_count_t bin_count)
 {
-	struct packer *packer;
 	block_count_t i;
+	int result;
 
-	int result = UDS_ALLOCATE(1, struct packer, __func__, &packer);
-
-	if (result != VDO_SUCCESS) {
-		return result;
-	}
-
-	packer->thread_id = vdo->thread_config->packer_thread;
+	packer->zone_number = zone_number;
+	packer->thread_id = vdo_get_packer_zone_thread(vdo->thread_config,
+						       zone_number);
 	packer->bin_data_size = (VDO_BLOCK_SIZE
 				 - sizeof(struct compressed_block_header));
 	packer->size = bin_count;
 	packer->max_slots = VDO_MAX_COMPRESSION_SLOTS;
-	INIT_LIST_HEAD(&packer->bins);
+	packer->deadline = DEFAULT_PACKER_DEADLINE;
 	vdo_set_admin_state_code(&packer->state,
 				 VDO_ADMIN_STATE_NORMAL_OPERATION);
+	vdo_initialize_completion(&packer->completion,
+				  vdo,
+				  VDO_PACKER_COMPLETION);
+	vdo_set_completion_callback(&packer->completion,
+				    write_expired_bins,
+				    packer->thread_id);
 
 	for (i = 0; i < bin_count; i++) {
-		int result = make_bin(packer);
-
+		result = make_bin(packer);
 		if (result != VDO_SUCCESS) {
-			vdo_free_packer(packer);
 			return result;
 		}
 	}
@@ -161,51 +264,130 @@ int vdo_make_packer(struct vdo *vdo,
 				       struct vio *, __func__,
 				       &packer->canceled_bin);
 	if (result != VDO_SUCCESS) {
-		vdo_free_packer(packer);
 		return result;
 	}
 
-	result = vdo_make_default_thread(vdo, packer->thread_id);
+	return vdo_make_default_thread(vdo, packer->thread_id);
+}
+
+/**
+ * get_thread_id_for_zone() - Get the thread id of the packer for a zone.
+ *
+ * Implements vdo_zone_thread_getter.
+ */
+static thread_id_t get_thread_id_for_zone(void *context,
+					  zone_count_t zone_number)
+{
+	struct packers *packers = context;
+
+	return packers->zones[zone_number].thread_id;
+}
+
+/**
+ * vdo_make_packers() - Make the block packers, one for each physical zone.
+ * @vdo: The vdo to which the packers belong.
+ * @bin_count: The number of partial bins for each packer to keep in memory.
+ * @packers_ptr: A pointer to hold the new packers.
+ *
+ * Return: VDO_SUCCESS or an error
+ */
+int vdo_make_packers(struct vdo *vdo,
+		     block_count_t bin_count,
+		     struct packers **packers_ptr)
+{
+	struct packers *packers;
+	zone_count_t zone_count = vdo->thread_config->physical_zone_count;
+	zone_count_t z;
+	int result = UDS_ALLOCATE_EXTENDED(struct packers,
+					   zone_count,
+					   struct packer,
+					   __func__,
+					   &packers);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	/* Make every packer safe to free before initializing any of them. */
+	for (z = 0; z < zone_count; z++) {
+		INIT_LIST_HEAD(&packers->zones[z].bins);
+		timer_setup(&packers->zones[z].timer,
+			    deadline_timer_expired,
+			    0);
+	}
+
+	packers->zone_count = zone_count;
+	for (z = 0; z < zone_count; z++) {
+		result = initialize_packer(vdo,
+					   &packers->zones[z],
+					   z,
+					   bin_count);
+		if (result != VDO_SUCCESS) {
+			vdo_free_packers(packers);
+			return result;
+		}
+	}
+
+	result = vdo_make_action_manager(zone_count,
+					 get_thread_id_for_zone,
+					 vdo->thread_config->admin_thread,
+					 packers,
+					 NULL,
+					 vdo,
+					 &packers->manager);
 	if (result != VDO_SUCCESS) {
-		vdo_free_packer(packer);
+		vdo_free_packers(packers);
 		return result;
 	}
 
-	*packer_ptr = packer;
+	*packers_ptr = packers;
 	return VDO_SUCCESS;
 }
 
 /**
- * vdo_free_packer() - Free a block packer.
- * @packer: The packer to free.
+ * vdo_free_packers() - Free the block packers.
+ * @packers: The packers to free.
  */
-void vdo_free_packer(struct packer *packer)
+void vdo_free_packers(struct packers *packers)
 {
-	struct packer_bin *bin;
+	zone_count_t z;
 
-	if (packer == NULL) {
+	if (packers == NULL) {
 		return;
 	}
 
-	while ((bin = vdo_get_packer_fullest_bin(packer)) != NULL) {
-		list_del_init(&bin->list);
-		UDS_FREE(bin);
+	UDS_FREE(UDS_FORGET(packers->manager));
+	for (z = 0; z < packers->zone_count; z++) {
+		struct packer *packer = &packers->zones[z];
+		struct packer_bin *bin;
+
+		del_timer_sync(&packer->timer);
+		while ((bin = vdo_get_packer_fullest_bin(packer)) != NULL) {
+			list_del_init(&bin->list);
+			UDS_FREE(bin);
+		}
+
+		UDS_FREE(UDS_FORGET(packer->canceled_bin));
 	}
 
-	UDS_FREE(UDS_FORGET(packer->canceled_bin));
-	UDS_FREE(packer);
+	UDS_FREE(packers);
 }
 
 /**
- * get_packer_from_data_vio() - Get the packer from a data_vio.
- * @data_vio: The data_vio.
+ * get_packer_from_data_vio() - Get the packer for a data_vio.
+ * @data_vio: The data_vio, which must have an allocation.
  *
- * Return: The packer from the VDO to which the data_vio belongs.
+ * Each data_vio is packed by the packer of the physical zone of its
+ * allocation, so the block which any agent writes is in the same zone as
+ * the allocations of all the fragments in it.
+ *
+ * Return: The packer for the physical zone of the data_vio's allocation.
  */
 static inline struct packer *
 get_packer_from_data_vio(struct data_vio *data_vio)
 {
-	return vdo_from_data_vio(data_vio)->packer;
+	struct packers *packers = vdo_from_data_vio(data_vio)->packers;
+
+	return &packers->zones[data_vio->allocation.zone->zone_number];
 }
 
 /**
@@ -224,23 +406,117 @@ bool vdo_data_is_sufficiently_compressible(struct data_vio *data_vio)
 }
 
 /**
- * vdo_get_packer_statistics() - Get the current statistics from the packer.
- * @packer: The packer to query.
+ * vdo_get_packer_statistics() - Get the current statistics from the packers.
+ * @packers: The packers to query.
  *
- * Return: a copy of the current statistics for the packer.
+ * Return: the sum of the current statistics for all of the packers.
  */
-struct packer_statistics vdo_get_packer_statistics(const struct packer *packer)
+struct packer_statistics
+vdo_get_packer_statistics(const struct packers *packers)
 {
-	const struct packer_statistics *stats = &packer->statistics;
+	struct packer_statistics totals = { 0 };
+	zone_count_t z;
+
+	for (z = 0; z < packers->zone_count; z++) {
+		const struct packer_statistics *stats =
+			&packers->zones[z].statistics;
+
+		totals.compressed_fragments_written +=
+			READ_ONCE(stats->compressed_fragments_written);
+		totals.compressed_blocks_written +=
+			READ_ONCE(stats->compressed_blocks_written);
+		totals.compressed_fragments_in_packer +=
+			READ_ONCE(stats->compressed_fragments_in_packer);
+		totals.bins_expired += READ_ONCE(stats->bins_expired);
+		totals.bin_wait_under_1ms +=
+			READ_ONCE(stats->bin_wait_under_1ms);
+		totals.bin_wait_under_10ms +=
+			READ_ONCE(stats->bin_wait_under_10ms);
+		totals.bin_wait_under_100ms +=
+			READ_ONCE(stats->bin_wait_under_100ms);
+		totals.bin_wait_under_1s += READ_ONCE(stats->bin_wait_under_1s);
+		totals.bin_wait_over_1s += READ_ONCE(stats->bin_wait_over_1s);
+		totals.compressed_bytes_written +=
+			READ_ONCE(stats->compressed_bytes_written);
+		totals.fragments_repacked +=
+			READ_ONCE(stats->fragments_repacked);
+	}
 
-	return (struct packer_statistics) {
-		.compressed_fragments_written =
-			READ_ONCE(stats->compressed_fragments_written),
-		.compressed_blocks_written =
-			READ_ONCE(stats->compressed_blocks_written),
-		.compressed_fragments_in_packer =
-			READ_ONCE(stats->compressed_fragments_in_packer),
-	};
+	return totals;
+}
+
+/**
+ * vdo_get_packer_deadline() - Get the number of milliseconds a packer bin
+ *                             may wait for more fragments.
+ * @packers: The packers.
+ *
+ * Return: The deadline, or 0 if bins wait indefinitely.
+ */
+unsigned int vdo_get_packer_deadline(struct packers *packers)
+{
+	return READ_ONCE(packers->zones[0].deadline);
+}
+
+/**
+ * vdo_set_packer_deadline() - Set the number of milliseconds a packer bin
+ *                             may wait for more fragments.
+ * @packers: The packers.
+ * @deadline: The deadline, or 0 to let bins wait indefinitely.
+ *
+ * The deadline is shortened when the data_vio pool is busy. This may be
+ * called from any thread. Since bins which are already waiting may have no
+ * timer running (if the deadline was 0), or one set for the old deadline,
+ * each packer's timer is made to fire right away so that the packer thread
+ * reconsiders every waiting bin under the new deadline.
+ */
+void vdo_set_packer_deadline(struct packers *packers, unsigned int deadline)
+{
+	zone_count_t z;
+
+	for (z = 0; z < packers->zone_count; z++) {
+		struct packer *packer = &packers->zones[z];
+
+		WRITE_ONCE(packer->deadline, deadline);
+		if ((deadline == 0) ||
+		    !vdo_is_state_normal(&packer->state)) {
+			continue;
+		}
+
+		if (change_timer_state(packer,
+				       PACKER_TIMER_IDLE,
+				       PACKER_TIMER_RUNNING) ||
+		    (atomic_read(&packer->timer_state) ==
+		     PACKER_TIMER_RUNNING)) {
+			mod_timer(&packer->timer, jiffies + 1);
+		}
+	}
+}
+
+/**
+ * record_bin_wait() - Add the time a bin spent waiting to the histogram of
+ *                     bin wait times.
+ * @packer: The packer.
+ * @bin: The bin being written out.
+ */
+static void record_bin_wait(struct packer *packer, struct packer_bin *bin)
+{
+	struct packer_statistics *stats = &packer->statistics;
+	unsigned int wait = jiffies_to_msecs(jiffies - bin->arrival);
+	uint64_t *bucket;
+
+	if (wait < 1) {
+		bucket = &stats->bin_wait_under_1ms;
+	} else if (wait < 10) {
+		bucket = &stats->bin_wait_under_10ms;
+	} else if (wait < 100) {
+		bucket = &stats->bin_wait_under_100ms;
+	} else if (wait < 1000) {
+		bucket = &stats->bin_wait_under_1s;
+	} else {
+		bucket = &stats->bin_wait_over_1s;
+	}
+
+	WRITE_ONCE(*bucket, *bucket + 1);
 }
 
 /**
@@ -447,10 +723,14 @@ static void write_bin(struct packer *packer, struct packer_bin *bin)
 		return;
 	}
 
+	record_bin_wait(packer, bin);
+
 	compression = &agent->compression;
 	compression->slot = 0;
 	block = compression->block;
-	vdo_initialize_compressed_block(block, compression->size);
+	vdo_initialize_compressed_block(block,
+					compression->format,
+					compression->size);
 	offset = compression->size;
 
 	while ((client = remove_from_bin(packer, bin)) != NULL) {
@@ -501,10 +781,111 @@ static void write_bin(struct packer *packer, struct packer_bin *bin)
 		   (stats->compressed_fragments_written + slot));
 	WRITE_ONCE(stats->compressed_blocks_written,
 		   stats->compressed_blocks_written + 1);
+	WRITE_ONCE(stats->compressed_bytes_written,
+		   stats->compressed_bytes_written + offset);
 
 	submit_data_vio_io(agent);
 }
 
+/**
+ * find_best_fit() - Find the largest fragment in another bin which would fit
+ *                   in the space remaining in a bin.
+ * @packer: The packer.
+ * @target: The bin which is to be topped off.
+ * @donor_ptr: A pointer to hold the bin containing the fragment found.
+ *
+ * At most PACKER_LOOKAHEAD fragments are considered. Fragments whose
+ * compression has been canceled are skipped since they would not be written.
+ *
+ * Return: The data_vio with the best fitting fragment, or NULL if none fit.
+ */
+static struct data_vio *find_best_fit(struct packer *packer,
+				      struct packer_bin *target,
+				      struct packer_bin **donor_ptr)
+{
+	struct data_vio *best = NULL;
+	struct packer_bin *bin;
+	unsigned int examined = 0;
+
+	for (bin = vdo_get_packer_fullest_bin(packer);
+	     bin != NULL;
+	     bin = vdo_next_packer_bin(packer, bin)) {
+		slot_number_t slot;
+
+		if (bin == target) {
+			continue;
+		}
+
+		for (slot = 0; slot < bin->slots_used; slot++) {
+			struct data_vio *data_vio = bin->incoming[slot];
+			size_t size = data_vio->compression.size;
+			struct vio_compression_state state;
+
+			if (examined++ == PACKER_LOOKAHEAD) {
+				return best;
+			}
+
+			/*
+			 * Prefer later bins on ties, since they are emptier
+			 * and so are more likely to be emptied entirely.
+			 */
+			if ((size > target->free_space) ||
+			    ((best != NULL) &&
+			     (size < best->compression.size))) {
+				continue;
+			}
+
+			state = get_vio_compression_state(data_vio);
+			if (state.may_not_compress) {
+				continue;
+			}
+
+			best = data_vio;
+			*donor_ptr = bin;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * top_off_bin() - Move fragments from other bins into a bin which is about to
+ *                 be written out.
+ * @packer: The packer.
+ * @bin: The bin to top off.
+ *
+ * This must not be called while iterating over the bins since each bin which
+ * gives up a fragment is moved to its new sorted position.
+ */
+static void top_off_bin(struct packer *packer, struct packer_bin *bin)
+{
+	while (bin->slots_used < packer->max_slots) {
+		struct packer_bin *donor;
+		struct data_vio *data_vio = find_best_fit(packer, bin, &donor);
+		slot_number_t slot;
+
+		if (data_vio == NULL) {
+			return;
+		}
+
+		slot = data_vio->compression.slot;
+		donor->slots_used--;
+		if (slot < donor->slots_used) {
+			donor->incoming[slot] =
+				donor->incoming[donor->slots_used];
+			donor->incoming[slot]->compression.slot = slot;
+		}
+
+		donor->free_space += data_vio->compression.size;
+		insert_in_sorted_list(packer, donor);
+
+		add_to_bin(bin, data_vio);
+		bin->free_space -= data_vio->compression.size;
+		WRITE_ONCE(packer->statistics.fragments_repacked,
+			   packer->statistics.fragments_repacked + 1);
+	}
+}
+
 /**
  * add_data_vio_to_packer_bin() - Add a data_vio to a bin's incoming queue
  * @packer: The packer.
@@ -523,11 +904,16 @@ static void add_data_vio_to_packer_bin(struct packer *packer,
 	 * room.
 	 */
 	if (bin->free_space < data_vio->compression.size) {
+		top_off_bin(packer, bin);
 		write_bin(packer, bin);
 	}
 
 	add_to_bin(bin, data_vio);
 	bin->free_space -= data_vio->compression.size;
+	if (bin->slots_used == 1) {
+		bin->arrival = jiffies;
+		start_deadline_timer(packer, bin->arrival);
+	}
 
 	/* If we happen to exactly fill the bin, start a new batch. */
 	if ((bin->slots_used == packer->max_slots) || (bin->free_space == 0)) {
@@ -588,6 +974,113 @@ select_bin(struct packer *packer, struct data_vio *data_vio)
 	return fullest_bin;
 }
 
+/**
+ * check_for_drain_complete() - Check whether the packer has drained.
+ * @packer: The packer.
+ */
+static void check_for_drain_complete(struct packer *packer)
+{
+	if (!vdo_is_state_draining(&packer->state) ||
+	    (packer->canceled_bin->slots_used > 0)) {
+		return;
+	}
+
+	/*
+	 * If the timer has fired, its callback is queued and will check
+	 * again.
+	 */
+	if ((atomic_read(&packer->timer_state) == PACKER_TIMER_IDLE) ||
+	    change_timer_state(packer,
+			       PACKER_TIMER_RUNNING,
+			       PACKER_TIMER_IDLE)) {
+		del_timer_sync(&packer->timer);
+		vdo_finish_draining(&packer->state);
+	}
+}
+
+/**
+ * write_all_non_empty_bins() - Write out all non-empty bins on behalf of a
+ *                              flush or suspend.
+ * @packer: The packer being flushed.
+ */
+static void write_all_non_empty_bins(struct packer *packer)
+{
+	struct packer_bin *bin;
+
+	for (bin = vdo_get_packer_fullest_bin(packer);
+	     bin != NULL;
+	     bin = vdo_next_packer_bin(packer, bin)) {
+		write_bin(packer, bin);
+		/*
+		 * We don't need to re-sort the bin here since this loop will
+		 * make every bin have the same amount of free space, so every
+		 * ordering is sorted.
+		 */
+	}
+
+	check_for_drain_complete(packer);
+}
+
+/**
+ * write_expired_bins() - Write out all bins which have waited longer than the
+ *                        deadline.
+ * @completion: The packer's completion.
+ *
+ * This callback is registered in vdo_make_packers() and is launched by the
+ * deadline timer.
+ */
+static void write_expired_bins(struct vdo_completion *completion)
+{
+	struct packer *packer = as_packer(completion);
+	unsigned long deadline = get_deadline_jiffies(packer);
+	unsigned long now = jiffies;
+	unsigned long oldest = now;
+	bool waiting = false;
+	struct packer_bin *bin, *tmp;
+	LIST_HEAD(written);
+
+	assert_on_packer_thread(packer, __func__);
+	atomic_set(&packer->timer_state, PACKER_TIMER_IDLE);
+	if (!vdo_is_state_normal(&packer->state)) {
+		check_for_drain_complete(packer);
+		return;
+	}
+
+	if (READ_ONCE(packer->deadline) == 0) {
+		/* The deadline was turned off since the timer was started. */
+		return;
+	}
+
+	list_for_each_entry_safe(bin, tmp, &packer->bins, list) {
+		if (bin->slots_used == 0) {
+			continue;
+		}
+
+		if (time_before(now, bin->arrival + deadline)) {
+			waiting = true;
+			if (time_before(bin->arrival, oldest)) {
+				oldest = bin->arrival;
+			}
+
+			continue;
+		}
+
+		write_bin(packer, bin);
+		WRITE_ONCE(packer->statistics.bins_expired,
+			   packer->statistics.bins_expired + 1);
+		list_move_tail(&bin->list, &written);
+	}
+
+	/*
+	 * Every written bin is now empty, so putting them at the end of the
+	 * list preserves the sort order.
+	 */
+	list_splice_tail(&written, &packer->bins);
+	if (waiting) {
+		start_deadline_timer(packer, oldest);
+	}
+}
+
 /**
  * vdo_attempt_packing() - Attempt to rewrite the data in this data_vio as
  *                         part of a compressed block.
@@ -627,6 +1120,16 @@ void vdo_attempt_packing(struct data_vio *data_vio)
 		return;
 	}
 
+	/*
+	 * A compressed block can only hold fragments of one format, so if the
+	 * compression engine has been changed, write out everything which was
+	 * compressed by the old one before binning anything from the new one.
+	 */
+	if (data_vio->compression.format != packer->format) {
+		write_all_non_empty_bins(packer);
+		packer->format = data_vio->compression.format;
+	}
+
 	/*
 	 * The check of may_vio_block_in_packer() here will set the data_vio's
 	 * compression state to VIO_PACKING if the data_vio is allowed to be
@@ -650,74 +1153,71 @@ void vdo_attempt_packing(struct data_vio *data_vio)
 }
 
 /**
- * check_for_drain_complete() - Check whether the packer has drained.
- * @packer: The packer.
+ * flush_packer() - Flush a packer.
+ * @packer: The packer to flush.
+ *
+ * All bins with at least two compressed data blocks will be written out, and
+ * any solitary pending VIOs will be released from the packer. While flushing
+ * is in progress, any VIOs submitted to vdo_attempt_packing() will be
+ * continued immediately without attempting to pack them.
  */
-static void check_for_drain_complete(struct packer *packer)
+static void flush_packer(struct packer *packer)
 {
-	if (vdo_is_state_draining(&packer->state) &&
-	    (packer->canceled_bin->slots_used == 0)) {
-		vdo_finish_draining(&packer->state);
+	assert_on_packer_thread(packer, __func__);
+	if (vdo_is_state_normal(&packer->state)) {
+		write_all_non_empty_bins(packer);
 	}
 }
 
 /**
- * write_all_non_empty_bins() - Write out all non-empty bins on behalf of a
- *                              flush or suspend.
- * @packer: The packer being flushed.
+ * flush_packer_action() - Flush the packer of one zone.
+ *
+ * Implements vdo_zone_action.
  */
-static void write_all_non_empty_bins(struct packer *packer)
+static void flush_packer_action(void *context,
+				zone_count_t zone_number,
+				struct vdo_completion *parent)
 {
-	struct packer_bin *bin;
-
-	for (bin = vdo_get_packer_fullest_bin(packer);
-	     bin != NULL;
-	     bin = vdo_next_packer_bin(packer, bin)) {
-		write_bin(packer, bin);
-		/*
-		 * We don't need to re-sort the bin here since this loop will
-		 * make every bin have the same amount of free space, so every
-		 * ordering is sorted.
-		 */
-	}
+	struct packers *packers = context;
 
-	check_for_drain_complete(packer);
+	flush_packer(&packers->zones[zone_number]);
+	vdo_complete_completion(parent);
 }
 
 /**
- * vdo_flush_packer() - Request that the packer flush asynchronously.
- * @packer: The packer to flush.
+ * vdo_flush_packers() - Request that all of the packers flush.
+ * @packers: The packers to flush.
+ * @parent: The completion to notify once every packer has flushed.
  *
- * All bins with at least two compressed data blocks will be written out, and
- * any solitary pending VIOs will be released from the packer. While flushing
- * is in progress, any VIOs submitted to vdo_attempt_packing() will be
- * continued immediately without attempting to pack them.
+ * This must be called from the admin thread.
  */
-void vdo_flush_packer(struct packer *packer)
+void vdo_flush_packers(struct packers *packers, struct vdo_completion *parent)
 {
-	assert_on_packer_thread(packer, __func__);
-	if (vdo_is_state_normal(&packer->state)) {
-		write_all_non_empty_bins(packer);
-	}
+	vdo_schedule_action(packers->manager,
+			    NULL,
+			    flush_packer_action,
+			    NULL,
+			    parent);
 }
 
 /**
- * vdo_remove_lock_holder_from_packer() - Remove a lock holder from the packer.
+ * remove_lock_holder_from_packer() - Remove a lock holder from its packer.
  * @completion: The data_vio which needs a lock held by a data_vio in the
  *              packer. The data_vio's compression.lock_holder field will
  *              point to the data_vio to remove.
+ *
+ * This callback is registered in vdo_remove_lock_holder_from_packer().
  */
-void vdo_remove_lock_holder_from_packer(struct vdo_completion *completion)
+static void remove_lock_holder_from_packer(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
-	struct packer *packer = get_packer_from_data_vio(data_vio);
-	struct data_vio *lock_holder;
+	struct data_vio *lock_holder =
+		UDS_FORGET(data_vio->compression.lock_holder);
+	struct packer *packer = get_packer_from_data_vio(lock_holder);
 	struct packer_bin *bin;
 	slot_number_t slot;
 
-	assert_data_vio_in_packer_zone(data_vio);
-
-	lock_holder = UDS_FORGET(data_vio->compression.lock_holder);
+	assert_on_packer_thread(packer, __func__);
 	bin = lock_holder->compression.bin;
 	ASSERT_LOG_ONLY((bin != NULL), "data_vio in packer has a bin");
 
@@ -740,6 +1240,27 @@ void vdo_remove_lock_holder_from_packer(struct vdo_completion *completion)
 	check_for_drain_complete(packer);
 }
 
+/**
+ * vdo_remove_lock_holder_from_packer() - Send a data_vio to the packer holding
+ *                                        a lock holder in order to remove it.
+ * @data_vio: The data_vio which needs a lock held by a data_vio in a packer.
+ * @lock_holder: The data_vio to remove, whose compression has already been
+ *               canceled.
+ *
+ * This is a one-way message; the data_vio does not continue from the packer.
+ */
+void vdo_remove_lock_holder_from_packer(struct data_vio *data_vio,
+					struct data_vio *lock_holder)
+{
+	struct packer *packer = get_packer_from_data_vio(lock_holder);
+
+	data_vio->compression.lock_holder = lock_holder;
+	vdo_set_completion_callback(data_vio_as_completion(data_vio),
+				    remove_lock_holder_from_packer,
+				    packer->thread_id);
+	vdo_invoke_completion_callback(data_vio_as_completion(data_vio));
+}
+
 /**
  * vdo_increment_packer_flush_generation() - Increment the flush generation
  *                                           in the packer.
@@ -752,7 +1273,7 @@ void vdo_increment_packer_flush_generation(struct packer *packer)
 {
 	assert_on_packer_thread(packer, __func__);
 	packer->flush_generation++;
-	vdo_flush_packer(packer);
+	flush_packer(packer);
 }
 
 /**
@@ -768,29 +1289,66 @@ static void initiate_drain(struct admin_state *state)
 }
 
 /**
- * vdo_drain_packer() - Drain the packer by preventing any more VIOs from
- *                      entering the packer and then flushing.
- * @packer: The packer to drain.
- * @completion: The completion to finish when the packer has drained.
+ * drain_packer() - Drain the packer of one zone.
+ *
+ * Implements vdo_zone_action.
  */
-void vdo_drain_packer(struct packer *packer, struct vdo_completion *completion)
+static void drain_packer(void *context,
+			 zone_count_t zone_number,
+			 struct vdo_completion *parent)
 {
-	assert_on_packer_thread(packer, __func__);
-	vdo_start_draining(&packer->state,
-			   VDO_ADMIN_STATE_SUSPENDING,
-			   completion,
+	struct packers *packers = context;
+
+	vdo_start_draining(&packers->zones[zone_number].state,
+			   vdo_get_current_manager_operation(packers->manager),
+			   parent,
 			   initiate_drain);
 }
 
 /**
- * vdo_resume_packer() - Resume a packer which has been suspended.
- * @packer: The packer to resume.
- * @parent: The completion to finish when the packer has resumed.
+ * vdo_drain_packers() - Drain the packers by preventing any more VIOs from
+ *                       entering them and then flushing.
+ * @packers: The packers to drain.
+ * @parent: The completion to finish when the packers have drained.
  */
-void vdo_resume_packer(struct packer *packer, struct vdo_completion *parent)
+void vdo_drain_packers(struct packers *packers, struct vdo_completion *parent)
 {
-	assert_on_packer_thread(packer, __func__);
-	vdo_finish_completion(parent, vdo_resume_if_quiescent(&packer->state));
+	vdo_schedule_operation(packers->manager,
+			       VDO_ADMIN_STATE_SUSPENDING,
+			       NULL,
+			       drain_packer,
+			       NULL,
+			       parent);
+}
+
+/**
+ * resume_packer() - Resume the packer of one zone.
+ *
+ * Implements vdo_zone_action.
+ */
+static void resume_packer(void *context,
+			  zone_count_t zone_number,
+			  struct vdo_completion *parent)
+{
+	struct packers *packers = context;
+
+	vdo_finish_completion(parent,
+			      vdo_resume_if_quiescent(&packers->zones[zone_number].state));
+}
+
+/**
+ * vdo_resume_packers() - Resume packers which have been suspended.
+ * @packers: The packers to resume.
+ * @parent: The completion to finish when the packers have resumed.
+ */
+void vdo_resume_packers(struct packers *packers, struct vdo_completion *parent)
+{
+	vdo_schedule_operation(packers->manager,
+			       VDO_ADMIN_STATE_RESUMING,
+			       NULL,
+			       resume_packer,
+			       NULL,
+			       parent);
 }
 
 
@@ -813,16 +1371,16 @@ static void dump_packer_bin(const struct packer_bin *bin, bool canceled)
 }
 
 /**
- * vdo_dump_packer() - Dump the packer.
+ * dump_packer() - Dump a packer.
  * @packer: The packer.
  *
  * Context: dumps in a thread-unsafe fashion.
  */
-void vdo_dump_packer(const struct packer *packer)
+static void dump_packer(const struct packer *packer)
 {
 	struct packer_bin *bin;
 
-	uds_log_info("packer");
+	uds_log_info("packer %u", packer->zone_number);
 	uds_log_info("  flushGeneration=%llu state %s  packer_bin_count=%llu",
 		     (unsigned long long) packer->flush_generation,
 		     vdo_get_admin_state_code(&packer->state)->name,
@@ -835,3 +1393,18 @@ void vdo_dump_packer(const struct packer *packer)
 
 	dump_packer_bin(packer->canceled_bin, true);
 }
+
+/**
+ * vdo_dump_packers() - Dump the packers.
+ * @packers: The packers.
+ *
+ * Context: dumps in a thread-unsafe fashion.
+ */
+void vdo_dump_packers(const struct packers *packers)
+{
+	zone_count_t z;
+
+	for (z = 0; z < packers->zone_count; z++) {
+		dump_packer(&packers->zones[z]);
+	}
+}
@@ -7,17 +7,30 @@
 #define PACKER_H
 
 #include <linux/list.h>
+#include <linux/timer.h>
 
 #include "compiler.h"
 
 #include "admin-state.h"
 #include "block-mapping-state.h"
+#include "completion.h"
+#include "compressed-block.h"
 #include "statistics.h"
 #include "types.h"
 #include "wait-queue.h"
 
 enum {
 	DEFAULT_PACKER_BINS = 16,
+	/*
+	 * The default number of milliseconds a bin may wait for more fragments
+	 * before it is written out
+	 */
+	DEFAULT_PACKER_DEADLINE = 50,
+	/*
+	 * The number of fragments in other bins to consider when topping off a
+	 * bin which is about to be written out
+	 */
+	PACKER_LOOKAHEAD = 32,
 };
 
 /*
@@ -39,12 +52,28 @@ enum {
  * canceled and removed from their bin by the packer. These data_vios need to
  * wait for the canceller to rendezvous with them (VDO-2809) and so they sit in
  * this special bin.
+ *
+ * When a bin must be written out because an incoming fragment does not fit in
+ * it, the packer first tops it off by moving fragments from other bins into
+ * it. Looking at up to PACKER_LOOKAHEAD fragments at a time, it repeatedly
+ * moves the largest one which still fits (best-fit decreasing). This fills the
+ * written block more completely and leaves fewer fragments waiting for a
+ * later block.
+ *
+ * There is a packer for each physical zone. Unless the vdo is configured to
+ * use a single thread, each packer has its own thread (packerQ0, packerQ1,
+ * ...), separate from the thread of its physical zone. Each data_vio is
+ * packed by the packer of the zone in which it has its allocation, so the
+ * compressed block written by an agent is always in the same zone as the
+ * allocations of the other data_vios in its bin.
  */
 struct packer_bin {
 	/* List links for packer.packer_bins */
 	struct list_head list;
 	/* The number of items in the bin */
 	slot_number_t slots_used;
+	/* The time (in jiffies) at which the first item entered the bin */
+	unsigned long arrival;
 	/*
 	 * The number of compressed block bytes remaining in the current batch
 	 */
@@ -54,6 +83,8 @@ struct packer_bin {
 };
 
 struct packer {
+	/* The physical zone of this packer */
+	zone_count_t zone_number;
 	/* The ID of the packer's callback thread */
 	thread_id_t thread_id;
 	/* The number of bins */
@@ -64,6 +95,8 @@ struct packer {
 	size_t max_slots;
 	/* A list of all packer_bins, kept sorted by free_space */
 	struct list_head bins;
+	/* The format of the compressed fragments in the bins */
+	enum vdo_compression_format format;
 	/*
 	 * A bin to hold data_vios which were canceled out of the packer and
 	 * are waiting to rendezvous with the canceling data_vio.
@@ -73,6 +106,18 @@ struct packer {
 	/* The current flush generation */
 	sequence_number_t flush_generation;
 
+	/*
+	 * The number of milliseconds a bin may wait before it is written out,
+	 * when the data_vio pool is idle, or 0 to wait indefinitely
+	 */
+	unsigned int deadline;
+	/* The completion for writing out bins whose deadline has passed */
+	struct vdo_completion completion;
+	/* The timer for bin deadlines */
+	struct timer_list timer;
+	/* The state of the timer */
+	atomic_t timer_state;
+
 	/* The administrative state of the packer */
 	struct admin_state state;
 
@@ -83,31 +128,45 @@ struct packer {
 	struct packer_statistics statistics;
 };
 
-int __must_check vdo_make_packer(struct vdo *vdo,
-				 block_count_t bin_count,
-				 struct packer **packer_ptr);
+struct packers {
+	/* The action manager for the packers */
+	struct action_manager *manager;
+	/* The number of packers, which is the number of physical zones */
+	zone_count_t zone_count;
+	/* The packers, indexed by physical zone */
+	struct packer zones[];
+};
+
+int __must_check vdo_make_packers(struct vdo *vdo,
+				  block_count_t bin_count,
+				  struct packers **packers_ptr);
 
-void vdo_free_packer(struct packer *packer);
+void vdo_free_packers(struct packers *packers);
 
 bool __must_check
 vdo_data_is_sufficiently_compressible(struct data_vio *data_vio);
 
 struct packer_statistics __must_check
-vdo_get_packer_statistics(const struct packer *packer);
+vdo_get_packer_statistics(const struct packers *packers);
+
+unsigned int __must_check vdo_get_packer_deadline(struct packers *packers);
+
+void vdo_set_packer_deadline(struct packers *packers, unsigned int deadline);
 
 void vdo_attempt_packing(struct data_vio *data_vio);
 
-void vdo_flush_packer(struct packer *packer);
+void vdo_flush_packers(struct packers *packers, struct vdo_completion *parent);
 
-void vdo_remove_lock_holder_from_packer(struct vdo_completion *completion);
+void vdo_remove_lock_holder_from_packer(struct data_vio *data_vio,
+					struct data_vio *lock_holder);
 
 void vdo_increment_packer_flush_generation(struct packer *packer);
 
-void
-vdo_drain_packer(struct packer *packer, struct vdo_completion *completion);
+void vdo_drain_packers(struct packers *packers, struct vdo_completion *parent);
 
-void vdo_resume_packer(struct packer *packer, struct vdo_completion *parent);
+void vdo_resume_packers(struct packers *packers,
+			struct vdo_completion *parent);
 
-void vdo_dump_packer(const struct packer *packer);
+void vdo_dump_packers(const struct packers *packers);
 
 #endif /* PACKER_H */
@@ -216,6 +216,7 @@ static int allocate_and_lock_block(struct allocation *allocation)
 			"must not allocate a block while already holding a lock on one");
 
 	result = vdo_allocate_block(allocation->zone->allocator,
+				    allocation->stream,
 				    &allocation->pbn);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -259,6 +260,7 @@ static void retry_allocation(struct waiter *waiter,
 	data_vio->allocation.wait_for_clean_slab = false;
 	data_vio->allocation.first_allocation_zone =
 		data_vio->allocation.zone->zone_number;
+	atomic_inc(&data_vio->allocation.zone->pending_allocations);
 	continue_data_vio(data_vio, VDO_SUCCESS);
 }
 
@@ -315,6 +317,7 @@ static bool continue_allocating(struct data_vio *data_vio)
 	}
 
 	allocation->zone = zone->next;
+	atomic_inc(&allocation->zone->pending_allocations);
 	completion->callback_thread_id = allocation->zone->thread_id;
 	vdo_continue_completion(completion, VDO_SUCCESS);
 	return true;
@@ -331,7 +334,10 @@ static bool continue_allocating(struct data_vio *data_vio)
  */
 bool vdo_allocate_block_in_zone(struct data_vio *data_vio)
 {
-	int result = allocate_and_lock_block(&data_vio->allocation);
+	int result;
+
+	atomic_dec(&data_vio->allocation.zone->pending_allocations);
+	result = allocate_and_lock_block(&data_vio->allocation);
 
 	if (result == VDO_SUCCESS) {
 		return true;
@@ -6,6 +6,8 @@
 #ifndef PHYSICAL_ZONE_H
 #define PHYSICAL_ZONE_H
 
+#include <linux/atomic.h>
+
 #include "kernel-types.h"
 #include "pbn-lock.h"
 #include "types.h"
@@ -23,6 +25,11 @@ struct physical_zone {
 	struct block_allocator *allocator;
 	/* The next zone from which to attempt an allocation */
 	struct physical_zone *next;
+	/*
+	 * The number of data_vios which have been sent to this zone's thread
+	 * to allocate but have not yet tried
+	 */
+	atomic_t pending_allocations;
 };
 
 struct physical_zones {
@@ -238,6 +238,234 @@ static struct pool_stats_attribute pool_stats_attr_packer_compressed_fragments_i
 	.print = pool_stats_print_packer_compressed_fragments_in_packer,
 };
 
+/* Number of bins written because they waited too long */
+static ssize_t
+pool_stats_print_packer_bins_expired(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->packer.bins_expired);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_bins_expired = {
+	.attr = { .name = "packer_bins_expired", .mode = 0444, },
+	.print = pool_stats_print_packer_bins_expired,
+};
+
+/* Number of bins written after waiting under 1 ms */
+static ssize_t
+pool_stats_print_packer_bin_wait_under_1ms(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->packer.bin_wait_under_1ms);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_bin_wait_under_1ms = {
+	.attr = { .name = "packer_bin_wait_under_1ms", .mode = 0444, },
+	.print = pool_stats_print_packer_bin_wait_under_1ms,
+};
+
+/* Number of bins written after waiting 1 to 10 ms */
+static ssize_t
+pool_stats_print_packer_bin_wait_under_10ms(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->packer.bin_wait_under_10ms);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_bin_wait_under_10ms = {
+	.attr = { .name = "packer_bin_wait_under_10ms", .mode = 0444, },
+	.print = pool_stats_print_packer_bin_wait_under_10ms,
+};
+
+/* Number of bins written after waiting 10 to 100 ms */
+static ssize_t
+pool_stats_print_packer_bin_wait_under_100ms(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->packer.bin_wait_under_100ms);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_bin_wait_under_100ms = {
+	.attr = { .name = "packer_bin_wait_under_100ms", .mode = 0444, },
+	.print = pool_stats_print_packer_bin_wait_under_100ms,
+};
+
+/* Number of bins written after waiting 100 ms to 1 s */
+static ssize_t
+pool_stats_print_packer_bin_wait_under_1s(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->packer.bin_wait_under_1s);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_bin_wait_under_1s = {
+	.attr = { .name = "packer_bin_wait_under_1s", .mode = 0444, },
+	.print = pool_stats_print_packer_bin_wait_under_1s,
+};
+
+/* Number of bins written after waiting over 1 s */
+static ssize_t
+pool_stats_print_packer_bin_wait_over_1s(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->packer.bin_wait_over_1s);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_bin_wait_over_1s = {
+	.attr = { .name = "packer_bin_wait_over_1s", .mode = 0444, },
+	.print = pool_stats_print_packer_bin_wait_over_1s,
+};
+
+/* Number of bytes of compressed fragments in the blocks written */
+static ssize_t
+pool_stats_print_packer_compressed_bytes_written(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->packer.compressed_bytes_written);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_compressed_bytes_written = {
+	.attr = { .name = "packer_compressed_bytes_written", .mode = 0444, },
+	.print = pool_stats_print_packer_compressed_bytes_written,
+};
+
+/* Number of fragments moved to a fuller bin before it was written */
+static ssize_t
+pool_stats_print_packer_fragments_repacked(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->packer.fragments_repacked);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_fragments_repacked = {
+	.attr = { .name = "packer_fragments_repacked", .mode = 0444, },
+	.print = pool_stats_print_packer_fragments_repacked,
+};
+
+/* Number of compressed block reads satisfied from the cache */
+static ssize_t
+pool_stats_print_compressed_block_cache_hits(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compressed_block_cache.hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compressed_block_cache_hits = {
+	.attr = { .name = "compressed_block_cache_hits", .mode = 0444, },
+	.print = pool_stats_print_compressed_block_cache_hits,
+};
+
+/* Number of compressed block reads which went to storage */
+static ssize_t
+pool_stats_print_compressed_block_cache_misses(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compressed_block_cache.misses);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compressed_block_cache_misses = {
+	.attr = { .name = "compressed_block_cache_misses", .mode = 0444, },
+	.print = pool_stats_print_compressed_block_cache_misses,
+};
+
+/* Number of blocks compressed which did not fit in a fragment */
+static ssize_t
+pool_stats_print_compression_failures(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compression.failures);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_failures = {
+	.attr = { .name = "compression_failures", .mode = 0444, },
+	.print = pool_stats_print_compression_failures,
+};
+
+/* Number of blocks not compressed due to high sampled entropy */
+static ssize_t
+pool_stats_print_compression_entropy_skipped(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compression.entropy_skipped);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_entropy_skipped = {
+	.attr = { .name = "compression_entropy_skipped", .mode = 0444, },
+	.print = pool_stats_print_compression_entropy_skipped,
+};
+
+/* Number of high entropy blocks compressed anyway to check the estimate */
+static ssize_t
+pool_stats_print_compression_entropy_audited(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compression.entropy_audited);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_entropy_audited = {
+	.attr = { .name = "compression_entropy_audited", .mode = 0444, },
+	.print = pool_stats_print_compression_entropy_audited,
+};
+
+/* Number of audited high entropy blocks which did compress */
+static ssize_t
+pool_stats_print_compression_entropy_mispredicted(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compression.entropy_mispredicted);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_entropy_mispredicted = {
+	.attr = { .name = "compression_entropy_mispredicted", .mode = 0444, },
+	.print = pool_stats_print_compression_entropy_mispredicted,
+};
+
+/* Number of blocks run through a compression engine */
+static ssize_t
+pool_stats_print_compression_compressed(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compression.compressed);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_compressed = {
+	.attr = { .name = "compression_compressed", .mode = 0444, },
+	.print = pool_stats_print_compression_compressed,
+};
+
+/* Number of blocks compressed faster due to load */
+static ssize_t
+pool_stats_print_compression_downgraded(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compression.downgraded);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_downgraded = {
+	.attr = { .name = "compression_downgraded", .mode = 0444, },
+	.print = pool_stats_print_compression_downgraded,
+};
+
+/* Number of blocks not compressed due to load */
+static ssize_t
+pool_stats_print_compression_skipped_for_load(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compression.skipped_for_load);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_skipped_for_load = {
+	.attr = { .name = "compression_skipped_for_load", .mode = 0444, },
+	.print = pool_stats_print_compression_skipped_for_load,
+};
+
+/* Number of blocks waiting for or undergoing compression */
+static ssize_t
+pool_stats_print_compression_pending(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compression.pending);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_pending = {
+	.attr = { .name = "compression_pending", .mode = 0444, },
+	.print = pool_stats_print_compression_pending,
+};
+
+/* Moving average time to compress a block in ns */
+static ssize_t
+pool_stats_print_compression_average_latency(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->compression.average_latency);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_average_latency = {
+	.attr = { .name = "compression_average_latency", .mode = 0444, },
+	.print = pool_stats_print_compression_average_latency,
+};
+
 /* The total number of slabs from which blocks may be allocated */
 static ssize_t
 pool_stats_print_allocator_slab_count(struct vdo_statistics *stats, char *buf)
@@ -718,6 +946,30 @@ static struct pool_stats_attribute pool_stats_attr_hash_lock_dedupe_advice_stale
 	.print = pool_stats_print_hash_lock_dedupe_advice_stale,
 };
 
+/* Number of times advice was found in the hash zone's advice cache */
+static ssize_t
+pool_stats_print_hash_lock_dedupe_advice_cached(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->hash_lock.dedupe_advice_cached);
+}
+
+static struct pool_stats_attribute pool_stats_attr_hash_lock_dedupe_advice_cached = {
+	.attr = { .name = "hash_lock_dedupe_advice_cached", .mode = 0444, },
+	.print = pool_stats_print_hash_lock_dedupe_advice_cached,
+};
+
+/* Number of times the UDS advice was trusted without being read */
+static ssize_t
+pool_stats_print_hash_lock_dedupe_advice_trusted(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->hash_lock.dedupe_advice_trusted);
+}
+
+static struct pool_stats_attribute pool_stats_attr_hash_lock_dedupe_advice_trusted = {
+	.attr = { .name = "hash_lock_dedupe_advice_trusted", .mode = 0444, },
+	.print = pool_stats_print_hash_lock_dedupe_advice_trusted,
+};
+
 /* Number of writes with the same data as another in-flight write */
 static ssize_t
 pool_stats_print_hash_lock_concurrent_data_matches(struct vdo_statistics *stats, char *buf)
@@ -826,6 +1078,54 @@ static struct pool_stats_attribute pool_stats_attr_max_vios = {
 	.print = pool_stats_print_max_vios,
 };
 
+/* Current limit on the number of active VIOs */
+static ssize_t
+pool_stats_print_request_limit(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%u\n", stats->request_limit);
+}
+
+static struct pool_stats_attribute pool_stats_attr_request_limit = {
+	.attr = { .name = "request_limit", .mode = 0444, },
+	.print = pool_stats_print_request_limit,
+};
+
+/* Target 99th percentile request latency in microseconds */
+static ssize_t
+pool_stats_print_request_latency_target(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%u\n", stats->request_latency_target);
+}
+
+static struct pool_stats_attribute pool_stats_attr_request_latency_target = {
+	.attr = { .name = "request_latency_target", .mode = 0444, },
+	.print = pool_stats_print_request_latency_target,
+};
+
+/* Median request latency in microseconds */
+static ssize_t
+pool_stats_print_request_latency_p50(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%u\n", stats->request_latency_p50);
+}
+
+static struct pool_stats_attribute pool_stats_attr_request_latency_p50 = {
+	.attr = { .name = "request_latency_p50", .mode = 0444, },
+	.print = pool_stats_print_request_latency_p50,
+};
+
+/* 99th percentile request latency in microseconds */
+static ssize_t
+pool_stats_print_request_latency_p99(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%u\n", stats->request_latency_p99);
+}
+
+static struct pool_stats_attribute pool_stats_attr_request_latency_p99 = {
+	.attr = { .name = "request_latency_p99", .mode = 0444, },
+	.print = pool_stats_print_request_latency_p99,
+};
+
 /* Number of times the UDS index was too slow in responding */
 static ssize_t
 pool_stats_print_dedupe_advice_timeouts(struct vdo_statistics *stats, char *buf)
@@ -838,6 +1138,18 @@ static struct pool_stats_attribute pool_stats_attr_dedupe_advice_timeouts = {
 	.print = pool_stats_print_dedupe_advice_timeouts,
 };
 
+/* Number of dedupe queries which were answered after timing out */
+static ssize_t
+pool_stats_print_dedupe_advice_late(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->dedupe_advice_late);
+}
+
+static struct pool_stats_attribute pool_stats_attr_dedupe_advice_late = {
+	.attr = { .name = "dedupe_advice_late", .mode = 0444, },
+	.print = pool_stats_print_dedupe_advice_late,
+};
+
 /* Number of flush requests submitted to the storage device */
 static ssize_t
 pool_stats_print_flush_out(struct vdo_statistics *stats, char *buf)
@@ -850,6 +1162,54 @@ static struct pool_stats_attribute pool_stats_attr_flush_out = {
 	.print = pool_stats_print_flush_out,
 };
 
+/* Number of partial writes merged into another read-modify-write */
+static ssize_t
+pool_stats_print_partial_writes_coalesced(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->partial_writes_coalesced);
+}
+
+static struct pool_stats_attribute pool_stats_attr_partial_writes_coalesced = {
+	.attr = { .name = "partial_writes_coalesced", .mode = 0444, },
+	.print = pool_stats_print_partial_writes_coalesced,
+};
+
+/* Number of reads satisfied by another read of the same physical block */
+static ssize_t
+pool_stats_print_reads_shared(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->reads_shared);
+}
+
+static struct pool_stats_attribute pool_stats_attr_reads_shared = {
+	.attr = { .name = "reads_shared", .mode = 0444, },
+	.print = pool_stats_print_reads_shared,
+};
+
+/* Number of data blocks read ahead of sequential read streams */
+static ssize_t
+pool_stats_print_blocks_read_ahead(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->blocks_read_ahead);
+}
+
+static struct pool_stats_attribute pool_stats_attr_blocks_read_ahead = {
+	.attr = { .name = "blocks_read_ahead", .mode = 0444, },
+	.print = pool_stats_print_blocks_read_ahead,
+};
+
+/* Number of reads satisfied by data which was read ahead */
+static ssize_t
+pool_stats_print_readahead_hits(struct vdo_statistics *stats, char *buf)
+{
+	return sprintf(buf, "%llu\n", stats->readahead_hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_readahead_hits = {
+	.attr = { .name = "readahead_hits", .mode = 0444, },
+	.print = pool_stats_print_readahead_hits,
+};
+
 /* Logical block size */
 static ssize_t
 pool_stats_print_logical_block_size(struct vdo_statistics *stats, char *buf)
@@ -1922,6 +2282,25 @@ struct attribute *vdo_pool_stats_attrs[] = {
 	&pool_stats_attr_packer_compressed_fragments_written.attr,
 	&pool_stats_attr_packer_compressed_blocks_written.attr,
 	&pool_stats_attr_packer_compressed_fragments_in_packer.attr,
+	&pool_stats_attr_packer_bins_expired.attr,
+	&pool_stats_attr_packer_bin_wait_under_1ms.attr,
+	&pool_stats_attr_packer_bin_wait_under_10ms.attr,
+	&pool_stats_attr_packer_bin_wait_under_100ms.attr,
+	&pool_stats_attr_packer_bin_wait_under_1s.attr,
+	&pool_stats_attr_packer_bin_wait_over_1s.attr,
+	&pool_stats_attr_packer_compressed_bytes_written.attr,
+	&pool_stats_attr_packer_fragments_repacked.attr,
+	&pool_stats_attr_compressed_block_cache_hits.attr,
+	&pool_stats_attr_compressed_block_cache_misses.attr,
+	&pool_stats_attr_compression_failures.attr,
+	&pool_stats_attr_compression_entropy_skipped.attr,
+	&pool_stats_attr_compression_entropy_audited.attr,
+	&pool_stats_attr_compression_entropy_mispredicted.attr,
+	&pool_stats_attr_compression_compressed.attr,
+	&pool_stats_attr_compression_downgraded.attr,
+	&pool_stats_attr_compression_skipped_for_load.attr,
+	&pool_stats_attr_compression_pending.attr,
+	&pool_stats_attr_compression_average_latency.attr,
 	&pool_stats_attr_allocator_slab_count.attr,
 	&pool_stats_attr_allocator_slabs_opened.attr,
 	&pool_stats_attr_allocator_slabs_reopened.attr,
@@ -1962,6 +2341,8 @@ struct attribute *vdo_pool_stats_attrs[] = {
 	&pool_stats_attr_block_map_flush_count.attr,
 	&pool_stats_attr_hash_lock_dedupe_advice_valid.attr,
 	&pool_stats_attr_hash_lock_dedupe_advice_stale.attr,
+	&pool_stats_attr_hash_lock_dedupe_advice_cached.attr,
+	&pool_stats_attr_hash_lock_dedupe_advice_trusted.attr,
 	&pool_stats_attr_hash_lock_concurrent_data_matches.attr,
 	&pool_stats_attr_hash_lock_concurrent_hash_collisions.attr,
 	&pool_stats_attr_hash_lock_curr_dedupe_queries.attr,
@@ -1971,8 +2352,17 @@ struct attribute *vdo_pool_stats_attrs[] = {
 	&pool_stats_attr_instance.attr,
 	&pool_stats_attr_current_vios_in_progress.attr,
 	&pool_stats_attr_max_vios.attr,
+	&pool_stats_attr_request_limit.attr,
+	&pool_stats_attr_request_latency_target.attr,
+	&pool_stats_attr_request_latency_p50.attr,
+	&pool_stats_attr_request_latency_p99.attr,
 	&pool_stats_attr_dedupe_advice_timeouts.attr,
+	&pool_stats_attr_dedupe_advice_late.attr,
 	&pool_stats_attr_flush_out.attr,
+	&pool_stats_attr_partial_writes_coalesced.attr,
+	&pool_stats_attr_reads_shared.attr,
+	&pool_stats_attr_blocks_read_ahead.attr,
+	&pool_stats_attr_readahead_hits.attr,
 	&pool_stats_attr_logical_block_size.attr,
 	&pool_stats_attr_bios_in_read.attr,
 	&pool_stats_attr_bios_in_write.attr,
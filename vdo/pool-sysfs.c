@@ -9,6 +9,7 @@
 
 #include "data-vio-pool.h"
 #include "dedupe.h"
+#include "stream-detector.h"
 #include "vdo.h"
 
 struct pool_attribute {
@@ -59,6 +60,46 @@ static ssize_t pool_compressing_show(struct vdo *vdo, char *buf)
 		       (vdo_get_compressing(vdo) ? "1" : "0"));
 }
 
+static ssize_t pool_compression_latency_budget_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf,
+		       "%u\n",
+		       READ_ONCE(vdo->compression_latency_budget));
+}
+
+static ssize_t pool_compression_latency_budget_store(struct vdo *vdo,
+						     const char *buf,
+						     size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(vdo->compression_latency_budget, value);
+	return length;
+}
+
+static ssize_t pool_compression_queue_budget_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(vdo->compression_queue_budget));
+}
+
+static ssize_t pool_compression_queue_budget_store(struct vdo *vdo,
+						   const char *buf,
+						   size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(vdo->compression_queue_budget, value);
+	return length;
+}
+
 static ssize_t pool_discards_active_show(struct vdo *vdo, char *buf)
 {
 	return sprintf(buf,
@@ -104,6 +145,65 @@ static ssize_t pool_instance_show(struct vdo *vdo, char *buf)
 	return sprintf(buf, "%u\n", vdo->instance);
 }
 
+static ssize_t pool_packer_deadline_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", vdo_get_packer_deadline(vdo->packers));
+}
+
+static ssize_t pool_packer_deadline_store(struct vdo *vdo,
+					  const char *buf,
+					  size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	vdo_set_packer_deadline(vdo->packers, value);
+	return length;
+}
+
+static ssize_t pool_readahead_depth_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(vdo->readahead_depth));
+}
+
+static ssize_t pool_readahead_depth_store(struct vdo *vdo,
+					  const char *buf,
+					  size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > VDO_MAXIMUM_READAHEAD_DEPTH)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(vdo->readahead_depth, value);
+	return length;
+}
+
+static ssize_t pool_readahead_streams_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(vdo->readahead_streams));
+}
+
+static ssize_t pool_readahead_streams_store(struct vdo *vdo,
+					    const char *buf,
+					    size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > VDO_MAXIMUM_READAHEAD_STREAMS)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(vdo->readahead_streams, value);
+	return length;
+}
+
 static ssize_t pool_requests_active_show(struct vdo *vdo, char *buf)
 {
 	return sprintf(buf,
@@ -111,6 +211,27 @@ static ssize_t pool_requests_active_show(struct vdo *vdo, char *buf)
 		       get_data_vio_pool_active_requests(vdo->data_vio_pool));
 }
 
+static ssize_t pool_requests_latency_target_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf,
+		       "%u\n",
+		       get_data_vio_pool_latency_target(vdo->data_vio_pool));
+}
+
+static ssize_t pool_requests_latency_target_store(struct vdo *vdo,
+						  const char *buf,
+						  size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	set_data_vio_pool_latency_target(vdo->data_vio_pool, value);
+	return length;
+}
+
 static ssize_t pool_requests_limit_show(struct vdo *vdo, char *buf)
 {
 	return sprintf(buf,
@@ -138,6 +259,24 @@ static struct pool_attribute vdo_pool_compressing_attr = {
 	.show = pool_compressing_show,
 };
 
+static struct pool_attribute vdo_pool_compression_latency_budget_attr = {
+	.attr = {
+			.name = "compression_latency_budget",
+			.mode = 0644,
+		},
+	.show = pool_compression_latency_budget_show,
+	.store = pool_compression_latency_budget_store,
+};
+
+static struct pool_attribute vdo_pool_compression_queue_budget_attr = {
+	.attr = {
+			.name = "compression_queue_budget",
+			.mode = 0644,
+		},
+	.show = pool_compression_queue_budget_show,
+	.store = pool_compression_queue_budget_store,
+};
+
 static struct pool_attribute vdo_pool_discards_active_attr = {
 	.attr = {
 			.name = "discards_active",
@@ -171,6 +310,33 @@ static struct pool_attribute vdo_pool_instance_attr = {
 	.show = pool_instance_show,
 };
 
+static struct pool_attribute vdo_pool_packer_deadline_attr = {
+	.attr = {
+			.name = "packer_deadline",
+			.mode = 0644,
+		},
+	.show = pool_packer_deadline_show,
+	.store = pool_packer_deadline_store,
+};
+
+static struct pool_attribute vdo_pool_readahead_depth_attr = {
+	.attr = {
+			.name = "readahead_depth",
+			.mode = 0644,
+		},
+	.show = pool_readahead_depth_show,
+	.store = pool_readahead_depth_store,
+};
+
+static struct pool_attribute vdo_pool_readahead_streams_attr = {
+	.attr = {
+			.name = "readahead_streams",
+			.mode = 0644,
+		},
+	.show = pool_readahead_streams_show,
+	.store = pool_readahead_streams_store,
+};
+
 static struct pool_attribute vdo_pool_requests_active_attr = {
 	.attr = {
 			.name = "requests_active",
@@ -179,6 +345,15 @@ static struct pool_attribute vdo_pool_requests_active_attr = {
 	.show = pool_requests_active_show,
 };
 
+static struct pool_attribute vdo_pool_requests_latency_target_attr = {
+	.attr = {
+			.name = "requests_latency_target",
+			.mode = 0644,
+		},
+	.show = pool_requests_latency_target_show,
+	.store = pool_requests_latency_target_store,
+};
+
 static struct pool_attribute vdo_pool_requests_limit_attr = {
 	.attr = {
 			.name = "requests_limit",
@@ -197,11 +372,17 @@ static struct pool_attribute vdo_pool_requests_maximum_attr = {
 
 static struct attribute *pool_attrs[] = {
 	&vdo_pool_compressing_attr.attr,
+	&vdo_pool_compression_latency_budget_attr.attr,
+	&vdo_pool_compression_queue_budget_attr.attr,
 	&vdo_pool_discards_active_attr.attr,
 	&vdo_pool_discards_limit_attr.attr,
 	&vdo_pool_discards_maximum_attr.attr,
 	&vdo_pool_instance_attr.attr,
+	&vdo_pool_packer_deadline_attr.attr,
+	&vdo_pool_readahead_depth_attr.attr,
+	&vdo_pool_readahead_streams_attr.attr,
 	&vdo_pool_requests_active_attr.attr,
+	&vdo_pool_requests_latency_target_attr.attr,
 	&vdo_pool_requests_limit_attr.attr,
 	&vdo_pool_requests_maximum_attr.attr,
 	NULL,
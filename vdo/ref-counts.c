@@ -15,6 +15,8 @@
 #include "admin-state.h"
 #include "block-allocator.h"
 #include "completion.h"
+#include "compressed-block-cache.h"
+#include "dedupe.h"
 #include "header.h"
 #include "io-submitter.h"
 #include "journal-point.h"
@@ -25,6 +27,7 @@
 #include "reference-operation.h"
 #include "slab.h"
 #include "slab-depot-format.h"
+#include "slab-depot.h"
 #include "slab-journal.h"
 #include "slab-summary.h"
 #include "status-codes.h"
@@ -476,10 +479,26 @@ static int decrement_for_data(struct ref_counts *ref_counts,
 			*free_status_changed = false;
 			vdo_assign_pbn_lock_provisional_reference(lock);
 		} else {
+			struct vdo *vdo = ref_counts->slab->allocator->depot->vdo;
+
 			*counter_ptr = EMPTY_REFERENCE_COUNT;
 			block->allocated_count--;
 			ref_counts->free_blocks++;
 			*free_status_changed = true;
+
+			/*
+			 * The block may be reused, so drop any cached copy and
+			 * stop trusting any dedupe advice for it.
+			 */
+			vdo_invalidate_cached_compressed_block(vdo->compressed_block_cache,
+							       index_to_pbn(ref_counts,
+									    block_number));
+			vdo_invalidate_cached_compressed_block(vdo->readahead_cache,
+							       index_to_pbn(ref_counts,
+									    block_number));
+			vdo_retire_dedupe_advice(vdo->hash_zones,
+						 index_to_pbn(ref_counts,
+							      block_number));
 		}
 		break;
 
@@ -1044,6 +1063,127 @@ int vdo_allocate_unreferenced_block(struct ref_counts *ref_counts,
 	return VDO_SUCCESS;
 }
 
+/**
+ * is_reserved() - Check whether a range of a slab is already reserved by an
+ *                 allocation run.
+ * @ref_counts: The reference counters of the slab.
+ * @runs: The runs to check.
+ * @run_count: The number of runs.
+ * @end_index: The end of the range, which is the end of a reference block.
+ *
+ * Return: true if some run is still allocating from the range.
+ */
+static bool is_reserved(const struct ref_counts *ref_counts,
+			const struct allocation_run *runs,
+			unsigned int run_count,
+			slab_block_number end_index)
+{
+	unsigned int i;
+
+	for (i = 0; i < run_count; i++) {
+		if ((runs[i].slab == ref_counts->slab) &&
+		    (runs[i].end_index == end_index) &&
+		    (runs[i].next_index < end_index)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * vdo_start_allocation_run() - Reserve a range of a slab for a run of
+ *                              allocations by one write stream.
+ * @ref_counts: The reference counters of the slab.
+ * @runs: The other runs of the slab's allocator, whose ranges will not be
+ *        reserved again.
+ * @run_count: The number of runs.
+ * @run: The run to start.
+ *
+ * The range reserved is the emptiest reference block of the slab which no
+ * other run is using. The allocated count of each reference block serves as
+ * a summary of the free space in the slab, so the search need not examine
+ * any reference counts. The reservation is advisory: allocations which are
+ * not part of a stream may still be made from the range.
+ *
+ * Return: true if a range at least half free was reserved.
+ */
+bool vdo_start_allocation_run(struct ref_counts *ref_counts,
+			      const struct allocation_run *runs,
+			      unsigned int run_count,
+			      struct allocation_run *run)
+{
+	block_count_t best_free = 0;
+	uint32_t i;
+
+	run->slab = NULL;
+	for (i = 0; i < ref_counts->reference_block_count; i++) {
+		slab_block_number start = i * COUNTS_PER_BLOCK;
+		slab_block_number end = min_t(slab_block_number,
+					      start + COUNTS_PER_BLOCK,
+					      ref_counts->block_count);
+		block_count_t free_count =
+			((end - start) - ref_counts->blocks[i].allocated_count);
+
+		if ((free_count <= best_free) ||
+		    (2 * free_count < (end - start)) ||
+		    is_reserved(ref_counts, runs, run_count, end)) {
+			continue;
+		}
+
+		best_free = free_count;
+		run->slab = ref_counts->slab;
+		run->next_index = start;
+		run->end_index = end;
+	}
+
+	return (run->slab != NULL);
+}
+
+/**
+ * vdo_allocate_unreferenced_block_in_run() - Find and allocate a block with
+ *                                            a reference count of zero in
+ *                                            the range reserved by an
+ *                                            allocation run.
+ * @ref_counts: The reference counters of the slab of the run.
+ * @run: The run from which to allocate.
+ * @allocated_ptr: A pointer to hold the physical block number of the block
+ *                 that was found and allocated.
+ *
+ * Blocks are allocated in order from the run so that the blocks of a stream
+ * are physically contiguous.
+ *
+ * Return: VDO_SUCCESS if a free block was found and allocated; VDO_NO_SPACE
+ *         if the run has no unreferenced blocks left; otherwise an error
+ *         code.
+ */
+int vdo_allocate_unreferenced_block_in_run(struct ref_counts *ref_counts,
+					   struct allocation_run *run,
+					   physical_block_number_t *allocated_ptr)
+{
+	slab_block_number free_index;
+
+	if (!vdo_is_slab_open(ref_counts->slab)) {
+		return VDO_INVALID_ADMIN_STATE;
+	}
+
+	if ((run->next_index >= run->end_index) ||
+	    !vdo_find_free_block(ref_counts,
+				 run->next_index,
+				 run->end_index,
+				 &free_index)) {
+		return VDO_NO_SPACE;
+	}
+
+	ASSERT_LOG_ONLY((ref_counts->counters[free_index] ==
+			 EMPTY_REFERENCE_COUNT),
+			"free block must have ref count of zero");
+	make_provisional_reference(ref_counts, free_index);
+	run->next_index = free_index + 1;
+	*allocated_ptr = index_to_pbn(ref_counts, free_index);
+	return VDO_SUCCESS;
+}
+
 /**
  * vdo_provisionally_reference_block() - Provisionally reference a block if it
  *                                       is unreferenced.
@@ -166,6 +166,17 @@ int __must_check
 vdo_allocate_unreferenced_block(struct ref_counts *ref_counts,
 				physical_block_number_t *allocated_ptr);
 
+bool __must_check
+vdo_start_allocation_run(struct ref_counts *ref_counts,
+			 const struct allocation_run *runs,
+			 unsigned int run_count,
+			 struct allocation_run *run);
+
+int __must_check
+vdo_allocate_unreferenced_block_in_run(struct ref_counts *ref_counts,
+				       struct allocation_run *run,
+				       physical_block_number_t *allocated_ptr);
+
 int __must_check
 vdo_provisionally_reference_block(struct ref_counts *ref_counts,
 				  physical_block_number_t pbn,
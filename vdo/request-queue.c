@@ -345,14 +345,20 @@ static INLINE void wake_up_worker(struct uds_request_queue *queue)
 	}
 }
 
+static INLINE void put_request(struct uds_request_queue *queue,
+				struct uds_request *request)
+{
+	funnel_queue_put(request->requeued ? queue->retry_queue :
+					     queue->main_queue,
+			 &request->request_queue_link);
+}
+
 void uds_request_queue_enqueue(struct uds_request_queue *queue,
 			       struct uds_request *request)
 {
 	bool unbatched = request->unbatched;
 
-	funnel_queue_put(request->requeued ? queue->retry_queue :
-					     queue->main_queue,
-			 &request->request_queue_link);
+	put_request(queue, request);
 
 	/*
 	 * We must wake the worker thread when it is dormant (waiting with no
@@ -364,6 +370,28 @@ void uds_request_queue_enqueue(struct uds_request_queue *queue,
 	}
 }
 
+void uds_request_queue_enqueue_batch(struct uds_request_queue *queue,
+				     struct uds_request **requests,
+				     unsigned int count)
+{
+	bool unbatched = false;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		/* The request may be processed as soon as it is queued. */
+		unbatched |= requests[i]->unbatched;
+		put_request(queue, requests[i]);
+	}
+
+	/*
+	 * The worker only needs to be woken once for the whole batch, and the
+	 * last queue operation acts as the read fence for the dormant flag.
+	 */
+	if ((count > 0) && (atomic_read(&queue->dormant) || unbatched)) {
+		wake_up_worker(queue);
+	}
+}
+
 void uds_request_queue_finish(struct uds_request_queue *queue)
 {
 	if (queue == NULL) {
@@ -41,6 +41,18 @@ make_uds_request_queue(const char *queue_name,
 void uds_request_queue_enqueue(struct uds_request_queue *queue,
 			       struct uds_request *request);
 
+/**
+ * Add several requests to the end of the queue, waking the worker thread at
+ * most once for all of them.
+ *
+ * @param queue     the request queue that should process the requests
+ * @param requests  the requests to be processed on the queue's worker thread
+ * @param count     the number of requests
+ **/
+void uds_request_queue_enqueue_batch(struct uds_request_queue *queue,
+				     struct uds_request **requests,
+				     unsigned int count);
+
 /**
  * Shut down the request queue worker thread, then destroy and free the queue.
  *
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright Red Hat
+ */
+
+#include "shared-reads.h"
+
+#include <linux/hash.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+
+#include "memory-alloc.h"
+
+#include "data-vio.h"
+#include "wait-queue.h"
+
+/**
+ * DOC:
+ *
+ * When many logical blocks are deduplicated against the same physical
+ * block, reads of those logical blocks would otherwise each read the
+ * physical block from storage, even when the reads arrive at the same time.
+ * The shared reads table tracks, by physical block number, the data_vios
+ * which are currently reading a block from storage. A data_vio about to read
+ * a block which is already being read waits on the data_vio doing the read
+ * instead of issuing its own, and is sent a copy of the block when the read
+ * completes. Readahead reads, which the storage may fail at will, are never
+ * shared.
+ *
+ * Reads are issued from all of the logical zone threads, so the table is
+ * protected by a lock per bucket. The table entries are embedded in the
+ * data_vios so that adding a read never needs to allocate memory while
+ * holding a lock. Since every data_vio waiting on a read holds the lock on a
+ * logical block which references the physical block, the block can not be
+ * freed and reused before the shared read completes.
+ */
+
+enum {
+	SHARED_READ_BUCKET_BITS = 8,
+	SHARED_READ_BUCKET_COUNT = 1 << SHARED_READ_BUCKET_BITS,
+};
+
+struct shared_read_bucket {
+	/* The lock protecting this bucket */
+	spinlock_t lock;
+	/* The data_vios reading blocks which hash to this bucket */
+	struct hlist_head readers;
+};
+
+struct shared_reads {
+	struct shared_read_bucket buckets[SHARED_READ_BUCKET_COUNT];
+};
+
+/**
+ * vdo_make_shared_reads() - Make a table of shared reads.
+ * @reads_ptr: A pointer to hold the new table.
+ *
+ * Return: VDO_SUCCESS or an error.
+ */
+int vdo_make_shared_reads(struct shared_reads **reads_ptr)
+{
+	struct shared_reads *reads;
+	unsigned int i;
+	int result = UDS_ALLOCATE(1, struct shared_reads, __func__, &reads);
+
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; i < SHARED_READ_BUCKET_COUNT; i++) {
+		spin_lock_init(&reads->buckets[i].lock);
+		INIT_HLIST_HEAD(&reads->buckets[i].readers);
+	}
+
+	*reads_ptr = reads;
+	return VDO_SUCCESS;
+}
+
+/**
+ * vdo_free_shared_reads() - Free a table of shared reads.
+ * @reads: The table to free (may be NULL).
+ */
+void vdo_free_shared_reads(struct shared_reads *reads)
+{
+	UDS_FREE(reads);
+}
+
+/**
+ * get_bucket() - Get the bucket for a physical block.
+ * @reads: The table.
+ * @pbn: The physical block number.
+ *
+ * Return: The bucket which holds reads of the block.
+ */
+static inline struct shared_read_bucket *
+get_bucket(struct shared_reads *reads, physical_block_number_t pbn)
+{
+	return &reads->buckets[hash_64(pbn, SHARED_READ_BUCKET_BITS)];
+}
+
+/**
+ * vdo_share_read() - Either join a read of a data_vio's mapped block which is
+ *                    already in progress, or record that the data_vio is
+ *                    about to read it.
+ * @reads: The table of shared reads.
+ * @data_vio: The data_vio which is about to read its mapped block.
+ * @shared_ptr: A pointer to hold whether the data_vio joined another read.
+ *
+ * If the data_vio joins another read, it will be continued by the data_vio
+ * doing the read once the block has been read. Otherwise, the data_vio must
+ * call vdo_finish_shared_read() once its read is done.
+ *
+ * Return: VDO_SUCCESS or an error.
+ */
+int vdo_share_read(struct shared_reads *reads,
+		   struct data_vio *data_vio,
+		   bool *shared_ptr)
+{
+	physical_block_number_t pbn = data_vio->mapped.pbn;
+	struct shared_read_bucket *bucket = get_bucket(reads, pbn);
+	struct data_vio *reader;
+	int result = VDO_SUCCESS;
+
+	spin_lock(&bucket->lock);
+	hlist_for_each_entry(reader, &bucket->readers, shared_read_entry) {
+		if (reader->mapped.pbn == pbn) {
+			result = enqueue_data_vio(&reader->shared_readers,
+						  data_vio);
+			spin_unlock(&bucket->lock);
+			*shared_ptr = (result == VDO_SUCCESS);
+			return result;
+		}
+	}
+
+	hlist_add_head(&data_vio->shared_read_entry, &bucket->readers);
+	spin_unlock(&bucket->lock);
+	*shared_ptr = false;
+	return result;
+}
+
+/**
+ * vdo_finish_shared_read() - Record that a data_vio has finished reading its
+ *                            mapped block.
+ * @reads: The table of shared reads.
+ * @data_vio: The data_vio which was reading.
+ *
+ * Once this returns, no more data_vios will join the read, and the data_vio
+ * is responsible for continuing any which are waiting in its shared_readers
+ * queue. It is safe to call this more than once.
+ */
+void vdo_finish_shared_read(struct shared_reads *reads,
+			    struct data_vio *data_vio)
+{
+	struct shared_read_bucket *bucket;
+
+	if (hlist_unhashed(&data_vio->shared_read_entry)) {
+		return;
+	}
+
+	bucket = get_bucket(reads, data_vio->mapped.pbn);
+	spin_lock(&bucket->lock);
+	hlist_del_init(&data_vio->shared_read_entry);
+	spin_unlock(&bucket->lock);
+}
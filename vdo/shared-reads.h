@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright Red Hat
+ */
+
+#ifndef SHARED_READS_H
+#define SHARED_READS_H
+
+#include "kernel-types.h"
+#include "types.h"
+
+struct shared_reads;
+
+int __must_check vdo_make_shared_reads(struct shared_reads **reads_ptr);
+
+void vdo_free_shared_reads(struct shared_reads *reads);
+
+int __must_check vdo_share_read(struct shared_reads *reads,
+				struct data_vio *data_vio,
+				bool *shared_ptr);
+
+void vdo_finish_shared_read(struct shared_reads *reads,
+			    struct data_vio *data_vio);
+
+#endif /* SHARED_READS_H */
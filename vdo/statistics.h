@@ -25,7 +25,7 @@
 #include "types.h"
 
 enum {
-	STATISTICS_VERSION = 35,
+	STATISTICS_VERSION = 36,
 };
 
 struct block_allocator_statistics {
@@ -73,6 +73,22 @@ struct packer_statistics {
 	uint64_t compressed_blocks_written;
 	/** Number of VIOs that are pending in the packer */
 	uint64_t compressed_fragments_in_packer;
+	/** Number of bins written because they waited too long */
+	uint64_t bins_expired;
+	/** Number of bins written after waiting under 1 ms */
+	uint64_t bin_wait_under_1ms;
+	/** Number of bins written after waiting 1 to 10 ms */
+	uint64_t bin_wait_under_10ms;
+	/** Number of bins written after waiting 10 to 100 ms */
+	uint64_t bin_wait_under_100ms;
+	/** Number of bins written after waiting 100 ms to 1 s */
+	uint64_t bin_wait_under_1s;
+	/** Number of bins written after waiting over 1 s */
+	uint64_t bin_wait_over_1s;
+	/** Number of bytes of compressed fragments in the blocks written */
+	uint64_t compressed_bytes_written;
+	/** Number of fragments moved to a fuller bin before it was written */
+	uint64_t fragments_repacked;
 };
 
 /** The statistics for the slab journals. */
@@ -151,6 +167,10 @@ struct hash_lock_statistics {
 	uint64_t dedupe_advice_valid;
 	/** Number of times the UDS advice proved incorrect */
 	uint64_t dedupe_advice_stale;
+	/** Number of times advice was found in the hash zone's advice cache */
+	uint64_t dedupe_advice_cached;
+	/** Number of times the UDS advice was trusted without being read */
+	uint64_t dedupe_advice_trusted;
 	/** Number of writes with the same data as another in-flight write */
 	uint64_t concurrent_data_matches;
 	/** Number of writes whose hash collided with an in-flight write */
@@ -209,6 +229,36 @@ struct index_statistics {
 	uint64_t updates_not_found;
 };
 
+/** The statistics for compression */
+struct compression_statistics {
+	/** Number of blocks compressed which did not fit in a fragment */
+	uint64_t failures;
+	/** Number of blocks not compressed due to high sampled entropy */
+	uint64_t entropy_skipped;
+	/** Number of high entropy blocks compressed anyway to check the estimate */
+	uint64_t entropy_audited;
+	/** Number of audited high entropy blocks which did compress */
+	uint64_t entropy_mispredicted;
+	/** Number of blocks run through a compression engine */
+	uint64_t compressed;
+	/** Number of blocks compressed faster due to load */
+	uint64_t downgraded;
+	/** Number of blocks not compressed due to load */
+	uint64_t skipped_for_load;
+	/** Number of blocks waiting for or undergoing compression */
+	uint64_t pending;
+	/** Mean of the per-thread average times to compress a block in ns */
+	uint64_t average_latency;
+};
+
+/** Counts of reads of compressed blocks from the compressed block cache */
+struct compressed_block_cache_statistics {
+	/** Number of compressed block reads satisfied from the cache */
+	uint64_t hits;
+	/** Number of compressed block reads which went to storage */
+	uint64_t misses;
+};
+
 /** The statistics of the vdo service. */
 struct vdo_statistics {
 	uint32_t version;
@@ -239,6 +289,10 @@ struct vdo_statistics {
 	uint8_t recovery_percentage;
 	/** The statistics for the compressed block packer */
 	struct packer_statistics packer;
+	/** Counts of reads of compressed blocks from the compressed block cache */
+	struct compressed_block_cache_statistics compressed_block_cache;
+	/** The statistics for compression */
+	struct compression_statistics compression;
 	/** Counters for events in the block allocator */
 	struct block_allocator_statistics allocator;
 	/** Counters for events in the recovery journal */
@@ -261,10 +315,28 @@ struct vdo_statistics {
 	uint32_t current_vios_in_progress;
 	/** Maximum number of active VIOs */
 	uint32_t max_vios;
+	/** Current limit on the number of active VIOs */
+	uint32_t request_limit;
+	/** Target 99th percentile request latency in microseconds */
+	uint32_t request_latency_target;
+	/** Median request latency in microseconds */
+	uint32_t request_latency_p50;
+	/** 99th percentile request latency in microseconds */
+	uint32_t request_latency_p99;
 	/** Number of times the UDS index was too slow in responding */
 	uint64_t dedupe_advice_timeouts;
+	/** Number of dedupe queries which were answered after timing out */
+	uint64_t dedupe_advice_late;
 	/** Number of flush requests submitted to the storage device */
 	uint64_t flush_out;
+	/** Number of partial writes merged into another read-modify-write */
+	uint64_t partial_writes_coalesced;
+	/** Number of reads satisfied by another read of the same physical block */
+	uint64_t reads_shared;
+	/** Number of data blocks read ahead of sequential read streams */
+	uint64_t blocks_read_ahead;
+	/** Number of reads satisfied by data which was read ahead */
+	uint64_t readahead_hits;
 	/** Logical block size */
 	uint64_t logical_block_size;
 	/** Bios submitted into VDO from above */
@@ -0,0 +1,625 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright Red Hat
+ */
+
+#include "stream-detector.h"
+
+#include <linux/minmax.h>
+
+#include "memory-alloc.h"
+
+#include "admin-state.h"
+#include "block-map.h"
+#include "block-map-entry.h"
+#include "block-map-format.h"
+#include "block-map-page.h"
+#include "block-map-tree.h"
+#include "compressed-block-cache.h"
+#include "constants.h"
+#include "int-map.h"
+#include "io-submitter.h"
+#include "logical-zone.h"
+#include "slab-depot.h"
+#include "vdo.h"
+#include "vdo-page-cache.h"
+#include "vio.h"
+
+/**
+ * DOC:
+ *
+ * Each logical zone has a stream detector which watches the reads done by
+ * the zone for sequential streams. Once a stream has been seen to read
+ * enough consecutive blocks, the zone fetches the next few block map leaf
+ * pages of the stream into its page cache, so that the stream does not stall
+ * waiting for each leaf page in turn.
+ *
+ * Consecutive leaf pages belong to different trees, and so generally to
+ * different logical zones. A zone only reads ahead the pages which it owns,
+ * looking as far ahead as the readahead depth times the number of zones.
+ * Every zone a stream passes through will detect the stream in turn, so
+ * between them the zones keep all of the stream's upcoming leaf pages
+ * cached. Since each page read ahead belongs to the zone's own tree, the
+ * tree page which locates it may be safely examined from the zone's thread.
+ *
+ * The zone also reads ahead the data blocks of a stream which lie in its own
+ * leaf pages, so that a stream of small reads is not limited by the latency
+ * of each read. Using the leaf page of the blocks just ahead of the stream,
+ * the zone collects the first run of physically consecutive, uncompressed
+ * blocks, and reads up to VDO_READAHEAD_RUN_BLOCKS of them with a single bio
+ * into the vdo's readahead cache, staying no more than half that cache ahead
+ * of the stream. Each zone has at most one such read outstanding. Blocks
+ * whose logical blocks are locked are skipped, since they are already being
+ * read or written; the readahead cache drops any block which is freed while
+ * its read is in progress, so a cached block always holds the current
+ * contents of its physical block.
+ */
+
+enum {
+	/*
+	 * The distance, in blocks, an LBN may be from the expected next LBN of
+	 * a stream and still be considered part of the stream, to allow for the
+	 * reordering of the blocks of large bios
+	 */
+	STREAM_WINDOW = 32,
+	/* The number of blocks a stream must read before it is read ahead */
+	STREAM_THRESHOLD = 16,
+	/* The number of leaf page fetches each zone may have outstanding */
+	MAXIMUM_LEAF_FETCHES = 2 * VDO_MAXIMUM_READAHEAD_DEPTH,
+};
+
+struct read_stream {
+	/* The next LBN expected to be read by this stream */
+	logical_block_number_t next_lbn;
+	/* The number of blocks read by this stream, 0 if the stream is unused */
+	block_count_t length;
+	/* The last leaf page read ahead for this stream */
+	page_number_t readahead_page;
+	/* The first logical block not yet considered for data readahead */
+	logical_block_number_t readahead_lbn;
+	/* The detector clock value when this stream was last read */
+	uint64_t last_used;
+};
+
+struct leaf_fetch {
+	/* The completion for fetching the page */
+	struct vdo_page_completion page_completion;
+	/* Whether the fetch is in progress */
+	bool busy;
+};
+
+struct data_readahead {
+	/* The completion for fetching the leaf page mapping the blocks */
+	struct vdo_page_completion page_completion;
+	/* The vio for reading the blocks */
+	struct vio *vio;
+	/* The stream being read ahead */
+	struct read_stream *stream;
+	/* The first logical block to consider */
+	logical_block_number_t lbn;
+	/* The number of logical blocks to consider */
+	block_count_t count;
+	/* The first physical block being read */
+	physical_block_number_t pbn;
+	/* The readahead cache epochs of the blocks being read */
+	unsigned int epochs[VDO_READAHEAD_RUN_BLOCKS];
+	/* Whether the readahead is in progress */
+	bool busy;
+};
+
+struct stream_detector {
+	/* The zone whose reads are being watched */
+	struct logical_zone *zone;
+	/* A counter for ordering stream uses */
+	uint64_t clock;
+	/* The streams */
+	struct read_stream streams[VDO_MAXIMUM_READAHEAD_STREAMS];
+	/* The leaf page fetches */
+	struct leaf_fetch fetches[MAXIMUM_LEAF_FETCHES];
+	/* The data block readahead */
+	struct data_readahead data;
+};
+
+/**
+ * vdo_make_stream_detector() - Make a stream detector for a logical zone.
+ * @zone: The zone whose reads will be watched.
+ * @detector_ptr: A pointer to hold the new detector.
+ *
+ * Return: VDO_SUCCESS or an error.
+ */
+int vdo_make_stream_detector(struct logical_zone *zone,
+			     struct stream_detector **detector_ptr)
+{
+	struct stream_detector *detector;
+	char *buffer;
+	int result = UDS_ALLOCATE(1, struct stream_detector, __func__,
+				  &detector);
+
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	detector->zone = zone;
+	result = UDS_ALLOCATE(VDO_READAHEAD_RUN_BLOCKS * VDO_BLOCK_SIZE,
+			      char,
+			      "data readahead buffer",
+			      &buffer);
+	if (result != VDO_SUCCESS) {
+		vdo_free_stream_detector(detector);
+		return result;
+	}
+
+	result = create_multi_block_metadata_vio(zone->zones->vdo,
+						 VIO_TYPE_READAHEAD,
+						 VIO_PRIORITY_LOW,
+						 detector,
+						 VDO_READAHEAD_RUN_BLOCKS,
+						 buffer,
+						 &detector->data.vio);
+	if (result != VDO_SUCCESS) {
+		UDS_FREE(buffer);
+		vdo_free_stream_detector(detector);
+		return result;
+	}
+
+	*detector_ptr = detector;
+	return VDO_SUCCESS;
+}
+
+/**
+ * vdo_free_stream_detector() - Free a stream detector.
+ * @detector: The detector to free (may be NULL).
+ *
+ * The block map and the detector's logical zone must have been drained, so
+ * that no leaf page fetches or data readahead are outstanding.
+ */
+void vdo_free_stream_detector(struct stream_detector *detector)
+{
+	if (detector == NULL) {
+		return;
+	}
+
+	if (detector->data.vio != NULL) {
+		UDS_FREE(UDS_FORGET(detector->data.vio->data));
+		free_vio(UDS_FORGET(detector->data.vio));
+	}
+
+	UDS_FREE(detector);
+}
+
+/**
+ * vdo_is_reading_ahead() - Check whether a detector has a data readahead in
+ *                          progress.
+ * @detector: The detector to check.
+ *
+ * Return: true if data blocks are being read ahead.
+ */
+bool vdo_is_reading_ahead(const struct stream_detector *detector)
+{
+	return detector->data.busy;
+}
+
+/**
+ * finish_leaf_fetch() - Release a leaf page which has been read ahead.
+ * @completion: The page completion of the fetch.
+ *
+ * The page remains in the page cache for the stream to find. This is both
+ * the callback and the error handler of the fetch.
+ */
+static void finish_leaf_fetch(struct vdo_completion *completion)
+{
+	struct leaf_fetch *fetch = container_of(completion,
+						struct leaf_fetch,
+						page_completion.completion);
+
+	vdo_release_page_completion(completion);
+	fetch->busy = false;
+}
+
+/**
+ * fetch_leaf_page() - Read ahead a leaf page into the zone's page cache.
+ * @detector: The detector of the zone.
+ * @page_number: The leaf page to read ahead, which must belong to the zone.
+ *
+ * Return: false if the page could not be read ahead because the zone is busy
+ *         or not operating normally.
+ */
+static bool fetch_leaf_page(struct stream_detector *detector,
+			    page_number_t page_number)
+{
+	struct block_map_zone *map_zone = detector->zone->block_map_zone;
+	struct leaf_fetch *fetch = NULL;
+	physical_block_number_t pbn;
+	unsigned int i;
+
+	if (!vdo_is_state_normal(&map_zone->state)) {
+		return false;
+	}
+
+	for (i = 0; i < MAXIMUM_LEAF_FETCHES; i++) {
+		if (!detector->fetches[i].busy) {
+			fetch = &detector->fetches[i];
+			break;
+		}
+	}
+
+	if (fetch == NULL) {
+		return false;
+	}
+
+	/* Pages which haven't been allocated have nothing to read. */
+	pbn = vdo_find_block_map_page_pbn(map_zone->block_map, page_number);
+	if (pbn == VDO_ZERO_BLOCK) {
+		return true;
+	}
+
+	fetch->busy = true;
+	vdo_init_page_completion(&fetch->page_completion,
+				 map_zone->page_cache,
+				 pbn,
+				 false,
+				 detector,
+				 finish_leaf_fetch,
+				 finish_leaf_fetch);
+	vdo_get_page(&fetch->page_completion.completion);
+	return true;
+}
+
+/**
+ * read_ahead() - Read ahead the leaf pages of a stream which belong to the
+ *                detector's zone.
+ * @detector: The detector.
+ * @stream: The stream to read ahead.
+ * @page_number: The leaf page the stream is currently reading.
+ * @depth: The number of leaf pages of all zones to read ahead.
+ */
+static void read_ahead(struct stream_detector *detector,
+		       struct read_stream *stream,
+		       page_number_t page_number,
+		       unsigned int depth)
+{
+	struct logical_zone *zone = detector->zone;
+	struct block_map *map = zone->block_map_zone->block_map;
+	page_count_t leaf_pages =
+		vdo_compute_block_map_page_count(map->entry_count);
+	page_number_t last = min_t(page_number_t,
+				   page_number + (depth * map->zone_count),
+				   leaf_pages - 1);
+	page_number_t next = max(page_number, stream->readahead_page) + 1;
+
+	for (; next <= last; next++) {
+		root_count_t root_index = next % map->root_count;
+
+		if ((root_index % map->zone_count) != zone->zone_number) {
+			continue;
+		}
+
+		if (!fetch_leaf_page(detector, next)) {
+			return;
+		}
+
+		stream->readahead_page = next;
+	}
+}
+
+/**
+ * finish_data_readahead() - Finish a data readahead.
+ * @detector: The detector whose readahead is done.
+ *
+ * This is called on the zone's thread whether or not anything was read.
+ */
+static void finish_data_readahead(struct stream_detector *detector)
+{
+	detector->data.busy = false;
+	vdo_check_for_logical_zone_drain(detector->zone);
+}
+
+/**
+ * handle_data_readahead_error() - Abandon a data readahead which failed.
+ * @completion: The completion of the readahead vio.
+ *
+ * The storage may fail a REQ_RAHEAD read at will, so the error is not
+ * recorded.
+ */
+static void handle_data_readahead_error(struct vdo_completion *completion)
+{
+	finish_data_readahead(completion->parent);
+}
+
+/**
+ * cache_data_readahead() - Cache the data blocks which have been read ahead.
+ * @completion: The completion of the readahead vio.
+ *
+ * This callback is registered in read_ahead_endio().
+ */
+static void cache_data_readahead(struct vdo_completion *completion)
+{
+	struct stream_detector *detector = completion->parent;
+	struct data_readahead *readahead = &detector->data;
+	struct vio *vio = readahead->vio;
+	struct vdo *vdo = detector->zone->zones->vdo;
+	unsigned int i;
+
+	for (i = 0; i < vio->block_count; i++) {
+		vdo_cache_block_at_epoch(vdo->readahead_cache,
+					 detector->zone->zone_number,
+					 readahead->pbn + i,
+					 readahead->epochs[i],
+					 vio->data + (i * VDO_BLOCK_SIZE));
+	}
+
+	atomic64_add(vio->block_count, &vdo->stats.blocks_read_ahead);
+	finish_data_readahead(detector);
+}
+
+static void read_ahead_endio(struct bio *bio)
+{
+	struct vio *vio = bio->bi_private;
+	struct stream_detector *detector = vio_as_completion(vio)->parent;
+
+	continue_vio_after_io(vio,
+			      cache_data_readahead,
+			      detector->zone->thread_id);
+}
+
+/**
+ * is_readable_ahead() - Check whether a logical block may be read ahead.
+ * @detector: The detector.
+ * @lbn: The logical block.
+ * @mapping: The mapping of the logical block.
+ *
+ * Return: true if the block is mapped to an uncompressed data block and is
+ *         not being read or written.
+ */
+static bool is_readable_ahead(struct stream_detector *detector,
+			      logical_block_number_t lbn,
+			      struct data_location *mapping)
+{
+	struct logical_zone *zone = detector->zone;
+
+	return ((mapping->state == VDO_MAPPING_STATE_UNCOMPRESSED) &&
+		(mapping->pbn != VDO_ZERO_BLOCK) &&
+		vdo_is_physical_data_block(zone->zones->vdo->depot,
+					   mapping->pbn) &&
+		(int_map_get(zone->lbn_operations, lbn) == NULL));
+}
+
+/**
+ * read_ahead_mapped_blocks() - Read ahead the first run of consecutive data
+ *                              blocks mapped by the fetched leaf page.
+ * @completion: The page completion of the readahead.
+ *
+ * This is both the callback and the error handler of the leaf page fetch
+ * started in read_ahead_data().
+ */
+static void read_ahead_mapped_blocks(struct vdo_completion *completion)
+{
+	struct stream_detector *detector = completion->parent;
+	struct data_readahead *readahead = &detector->data;
+	struct vdo *vdo = detector->zone->zones->vdo;
+	const struct block_map_page *page = NULL;
+	block_count_t run = 0;
+	block_count_t i;
+
+	if (completion->result == VDO_SUCCESS) {
+		page = vdo_dereference_readable_page(completion);
+	}
+
+	for (i = 0; (page != NULL) && (i < readahead->count); i++) {
+		logical_block_number_t lbn = readahead->lbn + i;
+		slot_number_t slot = lbn % VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
+		struct data_location mapping =
+			vdo_unpack_block_map_entry(&page->entries[slot]);
+
+		if (!is_readable_ahead(detector, lbn, &mapping)) {
+			if (run > 0) {
+				break;
+			}
+
+			continue;
+		}
+
+		if (run == 0) {
+			readahead->pbn = mapping.pbn;
+		} else if (mapping.pbn != readahead->pbn + run) {
+			break;
+		}
+
+		readahead->epochs[run++] =
+			vdo_get_cached_block_epoch(vdo->readahead_cache,
+						   mapping.pbn);
+	}
+
+	vdo_release_page_completion(completion);
+
+	/*
+	 * If the run ended early, let the stream resume from where it ended,
+	 * unless the stream has since moved on or been replaced.
+	 */
+	if ((run > 0) &&
+	    (i < readahead->count) &&
+	    (readahead->stream->readahead_lbn ==
+	     readahead->lbn + readahead->count)) {
+		readahead->stream->readahead_lbn = readahead->lbn + i;
+	}
+
+	if (run == 0) {
+		finish_data_readahead(detector);
+		return;
+	}
+
+	readahead->vio->block_count = run;
+	vdo_submit_readahead_io(readahead->vio,
+				readahead->pbn,
+				read_ahead_endio,
+				handle_data_readahead_error);
+}
+
+/**
+ * read_ahead_data() - Read ahead the data blocks of a stream which are mapped
+ *                     by the detector's zone.
+ * @detector: The detector.
+ * @stream: The stream to read ahead.
+ * @lbn: The logical block the stream is currently reading.
+ */
+static void read_ahead_data(struct stream_detector *detector,
+			    struct read_stream *stream,
+			    logical_block_number_t lbn)
+{
+	struct logical_zone *zone = detector->zone;
+	struct block_map_zone *map_zone = zone->block_map_zone;
+	struct block_map *map = map_zone->block_map;
+	struct data_readahead *readahead = &detector->data;
+	logical_block_number_t limit =
+		min_t(logical_block_number_t,
+		      lbn + 1 + (VDO_READAHEAD_BLOCKS_PER_ZONE / 2),
+		      map->entry_count);
+	logical_block_number_t page_end;
+	page_number_t page_number;
+	physical_block_number_t pbn;
+
+	if (readahead->busy ||
+	    !vdo_is_state_normal(&zone->state) ||
+	    !vdo_is_state_normal(&map_zone->state)) {
+		return;
+	}
+
+	stream->readahead_lbn = max(stream->readahead_lbn, lbn + 1);
+	if (stream->readahead_lbn >= limit) {
+		return;
+	}
+
+	/*
+	 * The blocks of a leaf page belonging to another zone will be read
+	 * ahead by that zone once the stream reaches it.
+	 */
+	page_number = stream->readahead_lbn / VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
+	if (((page_number % map->root_count) % map->zone_count) !=
+	    zone->zone_number) {
+		return;
+	}
+
+	page_end = min_t(logical_block_number_t,
+			 limit,
+			 (page_number + 1) * VDO_BLOCK_MAP_ENTRIES_PER_PAGE);
+	readahead->stream = stream;
+	readahead->lbn = stream->readahead_lbn;
+	readahead->count = min_t(block_count_t,
+				 page_end - readahead->lbn,
+				 VDO_READAHEAD_RUN_BLOCKS);
+	stream->readahead_lbn += readahead->count;
+
+	/* Pages which haven't been allocated map nothing to read. */
+	pbn = vdo_find_block_map_page_pbn(map, page_number);
+	if (pbn == VDO_ZERO_BLOCK) {
+		return;
+	}
+
+	readahead->busy = true;
+	vdo_init_page_completion(&readahead->page_completion,
+				 map_zone->page_cache,
+				 pbn,
+				 false,
+				 detector,
+				 read_ahead_mapped_blocks,
+				 read_ahead_mapped_blocks);
+	vdo_get_page(&readahead->page_completion.completion);
+}
+
+/**
+ * find_stream() - Find the stream to which a read belongs.
+ * @detector: The detector.
+ * @lbn: The logical block being read.
+ * @stream_count: The number of streams in use.
+ *
+ * Return: The stream, or NULL if the read does not continue any stream.
+ */
+static struct read_stream *find_stream(struct stream_detector *detector,
+				       logical_block_number_t lbn,
+				       unsigned int stream_count)
+{
+	unsigned int i;
+
+	for (i = 0; i < stream_count; i++) {
+		struct read_stream *stream = &detector->streams[i];
+
+		if ((stream->length > 0) &&
+		    (lbn + STREAM_WINDOW >= stream->next_lbn) &&
+		    (lbn <= stream->next_lbn + STREAM_WINDOW)) {
+			return stream;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * start_stream() - Replace the least recently used stream with a new one.
+ * @detector: The detector.
+ * @lbn: The logical block which starts the stream.
+ * @stream_count: The number of streams in use.
+ */
+static void start_stream(struct stream_detector *detector,
+			 logical_block_number_t lbn,
+			 unsigned int stream_count)
+{
+	struct read_stream *stream = &detector->streams[0];
+	unsigned int i;
+
+	for (i = 1; i < stream_count; i++) {
+		if (detector->streams[i].last_used < stream->last_used) {
+			stream = &detector->streams[i];
+		}
+	}
+
+	*stream = (struct read_stream) {
+		.next_lbn = lbn + 1,
+		.length = 1,
+		.readahead_page = lbn / VDO_BLOCK_MAP_ENTRIES_PER_PAGE,
+		.readahead_lbn = lbn + 1,
+		.last_used = ++detector->clock,
+	};
+}
+
+/**
+ * vdo_detect_read_stream() - Note a read in a logical zone, and read ahead
+ *                            the block map and data if it continues a
+ *                            sequential stream.
+ * @detector: The detector of the zone.
+ * @lbn: The logical block being read.
+ *
+ * This must be called from the logical zone's thread.
+ */
+void vdo_detect_read_stream(struct stream_detector *detector,
+			    logical_block_number_t lbn)
+{
+	struct vdo *vdo = detector->zone->zones->vdo;
+	unsigned int depth = READ_ONCE(vdo->readahead_depth);
+	unsigned int stream_count = min_t(unsigned int,
+					  READ_ONCE(vdo->readahead_streams),
+					  VDO_MAXIMUM_READAHEAD_STREAMS);
+	struct read_stream *stream;
+
+	if ((depth == 0) || (stream_count == 0)) {
+		return;
+	}
+
+	stream = find_stream(detector, lbn, stream_count);
+	if (stream == NULL) {
+		start_stream(detector, lbn, stream_count);
+		return;
+	}
+
+	stream->next_lbn = max(stream->next_lbn, lbn + 1);
+	stream->length++;
+	stream->last_used = ++detector->clock;
+	if (stream->length >= STREAM_THRESHOLD) {
+		read_ahead(detector,
+			   stream,
+			   lbn / VDO_BLOCK_MAP_ENTRIES_PER_PAGE,
+			   min_t(unsigned int,
+				 depth,
+				 VDO_MAXIMUM_READAHEAD_DEPTH));
+		read_ahead_data(detector, stream, lbn);
+	}
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright Red Hat
+ */
+
+#ifndef STREAM_DETECTOR_H
+#define STREAM_DETECTOR_H
+
+#include "kernel-types.h"
+#include "types.h"
+
+enum {
+	/* The maximum number of read streams tracked by each logical zone */
+	VDO_MAXIMUM_READAHEAD_STREAMS = 16,
+	/*
+	 * The maximum number of block map leaf pages a logical zone will read
+	 * ahead of a stream
+	 */
+	VDO_MAXIMUM_READAHEAD_DEPTH = 8,
+	/* The default number of read streams tracked by each logical zone */
+	VDO_DEFAULT_READAHEAD_STREAMS = 4,
+	/* The default number of leaf pages read ahead of a stream */
+	VDO_DEFAULT_READAHEAD_DEPTH = 2,
+	/* The maximum number of data blocks read ahead by a single read */
+	VDO_READAHEAD_RUN_BLOCKS = 16,
+	/* The number of read ahead data blocks cached by each logical zone */
+	VDO_READAHEAD_BLOCKS_PER_ZONE = 4 * VDO_READAHEAD_RUN_BLOCKS,
+};
+
+struct stream_detector;
+
+int __must_check
+vdo_make_stream_detector(struct logical_zone *zone,
+			 struct stream_detector **detector_ptr);
+
+void vdo_free_stream_detector(struct stream_detector *detector);
+
+bool __must_check
+vdo_is_reading_ahead(const struct stream_detector *detector);
+
+void vdo_detect_read_stream(struct stream_detector *detector,
+			    logical_block_number_t lbn);
+
+#endif /* STREAM_DETECTOR_H */
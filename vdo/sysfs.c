@@ -50,6 +50,18 @@ static int vdo_dedupe_timeout_interval_store(const char *buf,
 	return 0;
 }
 
+static int vdo_min_dedupe_timeout_interval_store(const char *buf,
+						 const struct kernel_param *kp)
+{
+	int result = param_set_uint(buf, kp);
+
+	if (result != 0) {
+		return result;
+	}
+	vdo_set_dedupe_index_min_timeout_interval(*(uint *)kp->arg);
+	return 0;
+}
+
 static int vdo_min_dedupe_timer_interval_store(const char *buf,
 					       const struct kernel_param *kp)
 {
@@ -73,6 +85,11 @@ static const struct kernel_param_ops dedupe_timeout_ops = {
 	.get = param_get_uint,
 };
 
+static const struct kernel_param_ops dedupe_min_timeout_ops = {
+	.set = vdo_min_dedupe_timeout_interval_store,
+	.get = param_get_uint,
+};
+
 static const struct kernel_param_ops dedupe_timer_ops = {
 	.set = vdo_min_dedupe_timer_interval_store,
 	.get = param_get_uint,
@@ -84,5 +101,8 @@ module_param_cb(log_level, &log_level_ops, NULL, 0644);
 module_param_cb(deduplication_timeout_interval, &dedupe_timeout_ops,
 		&vdo_dedupe_index_timeout_interval, 0644);
 
+module_param_cb(min_deduplication_timeout_interval, &dedupe_min_timeout_ops,
+		&vdo_dedupe_index_min_timeout_interval, 0644);
+
 module_param_cb(min_deduplication_timer_interval, &dedupe_timer_ops,
 		&vdo_dedupe_index_min_timer_interval, 0644);
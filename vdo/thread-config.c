@@ -46,6 +46,15 @@ static int allocate_thread_config(zone_count_t logical_zone_count,
 		return result;
 	}
 
+	result = UDS_ALLOCATE(physical_zone_count,
+			      thread_id_t,
+			      "packer thread array",
+			      &config->packer_threads);
+	if (result != VDO_SUCCESS) {
+		vdo_free_thread_config(config);
+		return result;
+	}
+
 	result = UDS_ALLOCATE(hash_zone_count,
 			      thread_id_t,
 			      "hash thread array",
@@ -92,8 +101,9 @@ static void assign_thread_ids(struct thread_config *config,
  * If the logical, physical, and hash zone counts are all 0, a single
  * thread will be shared by all three plus the packer and recovery
  * journal. Otherwise, there must be at least one of each type, and
- * each will have its own thread, as will the packer and recovery
- * journal.
+ * each will have its own thread, as will the recovery journal and the
+ * packer of each physical zone. The flusher shares the thread of the
+ * packer of the first physical zone.
  *
  * Return: VDO_SUCCESS or an error.
  */
@@ -117,6 +127,7 @@ int vdo_make_thread_config(struct thread_count_config counts,
 
 		config->logical_threads[0] = config->thread_count;
 		config->physical_threads[0] = config->thread_count;
+		config->packer_threads[0] = config->thread_count;
 		config->hash_zone_threads[0] = config->thread_count++;
 	} else {
 		result = allocate_thread_config(counts.logical_zones,
@@ -130,7 +141,10 @@ int vdo_make_thread_config(struct thread_count_config counts,
 
 		config->admin_thread = config->thread_count;
 		config->journal_thread = config->thread_count++;
-		config->packer_thread = config->thread_count++;
+		assign_thread_ids(config,
+				  config->packer_threads,
+				  counts.physical_zones);
+		config->packer_thread = config->packer_threads[0];
 		assign_thread_ids(config,
 				  config->logical_threads,
 				  counts.logical_zones);
@@ -165,6 +179,7 @@ void vdo_free_thread_config(struct thread_config *config)
 
 	UDS_FREE(UDS_FORGET(config->logical_threads));
 	UDS_FREE(UDS_FORGET(config->physical_threads));
+	UDS_FREE(UDS_FORGET(config->packer_threads));
 	UDS_FREE(UDS_FORGET(config->hash_zone_threads));
 	UDS_FREE(UDS_FORGET(config->bio_threads));
 	UDS_FREE(config);
@@ -225,9 +240,6 @@ void vdo_get_thread_name(const struct thread_config *thread_config,
 		 */
 		snprintf(buffer, buffer_length, "adminQ");
 		return;
-	} else if (thread_id == thread_config->packer_thread) {
-		snprintf(buffer, buffer_length, "packerQ");
-		return;
 	} else if (thread_id == thread_config->dedupe_thread) {
 		snprintf(buffer, buffer_length, "dedupeQ");
 		return;
@@ -257,6 +269,15 @@ void vdo_get_thread_name(const struct thread_config *thread_config,
 		return;
 	}
 
+	if (get_zone_thread_name(thread_config->packer_threads,
+				 thread_config->physical_zone_count,
+				 thread_id,
+				 "packerQ",
+				 buffer,
+				 buffer_length)) {
+		return;
+	}
+
 	if (get_zone_thread_name(thread_config->hash_zone_threads,
 				 thread_config->hash_zone_count,
 				 thread_id,
@@ -25,6 +25,7 @@ struct thread_config {
 	thread_id_t cpu_thread;
 	thread_id_t *logical_threads;
 	thread_id_t *physical_threads;
+	thread_id_t *packer_threads;
 	thread_id_t *hash_zone_threads;
 	thread_id_t *bio_threads;
 };
@@ -68,6 +69,23 @@ vdo_get_physical_zone_thread(const struct thread_config *thread_config,
 	return thread_config->physical_threads[physical_zone];
 }
 
+/**
+ * vdo_get_packer_zone_thread() - Get the thread id of the packer for a given
+ *                                physical zone.
+ * @thread_config: The thread config.
+ * @physical_zone: The number of the physical zone.
+ *
+ * Return: The thread id of the zone's packer.
+ */
+static inline thread_id_t __must_check
+vdo_get_packer_zone_thread(const struct thread_config *thread_config,
+			   zone_count_t physical_zone)
+{
+	ASSERT_LOG_ONLY((physical_zone < thread_config->physical_zone_count),
+			"physical zone valid");
+	return thread_config->packer_threads[physical_zone];
+}
+
 /**
  * vdo_get_hash_zone_thread() - Get the thread id for a given hash zone.
  * @thread_config: The thread config.
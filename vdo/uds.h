@@ -85,6 +85,8 @@ enum {
 	UDS_CHUNK_NAME_SIZE = 16,
 	/** The maximum metadata size in bytes. */
 	UDS_METADATA_SIZE = 16,
+	/** The maximum number of requests which may be started together. */
+	UDS_MAX_REQUEST_BATCH = 32,
 };
 
 /**
@@ -525,6 +527,22 @@ int __must_check uds_get_index_stats(struct uds_index_session *session,
  * @return Either #UDS_SUCCESS or an error code
  **/
 int __must_check uds_start_chunk_operation(struct uds_request *request);
+
+/**
+ * Start a batch of deduplication operations, as if by
+ * #uds_start_chunk_operation, but handing them to the index together so that
+ * each index queue is woken at most once for the batch. All of the requests
+ * must use the same index session. Either every request is started or, if an
+ * error is returned, none are. The order of the array may be changed.
+ *
+ * @param [in] requests  The operations to start.
+ * @param [in] count     The number of operations, which may not exceed
+ *                       #UDS_MAX_REQUEST_BATCH.
+ *
+ * @return Either #UDS_SUCCESS or an error code
+ **/
+int __must_check uds_start_chunk_operations(struct uds_request **requests,
+					    unsigned int count);
 /** @} */
 
 #endif /* UDS_H */
@@ -14,6 +14,7 @@
 #include "constants.h"
 #include "dedupe.h"
 #include "device-config.h"
+#include "hasher.h"
 #include "header.h"
 #include "kernel-types.h"
 #include "logical-zone.h"
@@ -284,6 +285,10 @@ static void load_callback(struct vdo_completion *completion)
 
 	case LOAD_PHASE_DATA_REDUCTION:
 		WRITE_ONCE(vdo->compressing, vdo->device_config->compression);
+		vdo_set_trusted_dedupe(vdo, vdo->device_config->trusted_dedupe);
+		vdo_set_compression_engine(vdo,
+					   vdo->device_config->compression_type,
+					   vdo->device_config->compression_level);
 		if (vdo->device_config->deduplication) {
 			/*
 			 * Don't try to load or rebuild the index first (and
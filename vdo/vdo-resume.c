@@ -14,6 +14,7 @@
 #include "completion.h"
 #include "data-vio-pool.h"
 #include "dedupe.h"
+#include "hasher.h"
 #include "kernel-types.h"
 #include "logical-zone.h"
 #include "recovery-journal.h"
@@ -65,7 +66,6 @@ get_thread_id_for_phase(struct admin_completion *admin_completion)
 	case RESUME_PHASE_JOURNAL:
 		return thread_config->journal_thread;
 
-	case RESUME_PHASE_PACKER:
 	case RESUME_PHASE_FLUSHER:
 		return thread_config->packer_thread;
 
@@ -170,9 +170,13 @@ static void resume_callback(struct vdo_completion *completion)
 		}
 		uds_log_info("compression is %s",
 			     (enable ? "enabled" : "disabled"));
+		vdo_set_compression_engine(vdo,
+					   vdo->device_config->compression_type,
+					   vdo->device_config->compression_level);
+		vdo_set_trusted_dedupe(vdo, vdo->device_config->trusted_dedupe);
 
-		vdo_resume_packer(vdo->packer,
-				  vdo_reset_admin_sub_task(completion));
+		vdo_resume_packers(vdo->packers,
+				   vdo_reset_admin_sub_task(completion));
 		return;
 	}
 
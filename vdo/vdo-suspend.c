@@ -61,7 +61,6 @@ get_thread_id_for_phase(struct admin_completion *admin_completion)
 	const struct thread_config *thread_config =
 		admin_completion->vdo->thread_config;
 	switch (admin_completion->phase) {
-	case SUSPEND_PHASE_PACKER:
 	case SUSPEND_PHASE_FLUSHES:
 		return thread_config->packer_thread;
 
@@ -147,8 +146,8 @@ static void suspend_callback(struct vdo_completion *completion)
 						  VDO_READ_ONLY);
 		}
 
-		vdo_drain_packer(vdo->packer,
-				 vdo_reset_admin_sub_task(completion));
+		vdo_drain_packers(vdo->packers,
+				  vdo_reset_admin_sub_task(completion));
 		return;
 
 	case SUSPEND_PHASE_DATA_VIOS:
@@ -12,7 +12,6 @@
 
 #include <linux/device-mapper.h>
 #include <linux/kernel.h>
-#include <linux/lz4.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 
@@ -22,8 +21,11 @@
 
 #include "bio.h"
 #include "block-map.h"
+#include "compressed-block-cache.h"
+#include "compressor.h"
 #include "data-vio-pool.h"
 #include "dedupe.h"
+#include "hasher.h"
 #include "device-registry.h"
 #include "header.h"
 #include "instance-number.h"
@@ -36,10 +38,12 @@
 #include "read-only-notifier.h"
 #include "recovery-journal.h"
 #include "release-versions.h"
+#include "shared-reads.h"
 #include "slab-depot.h"
 #include "slab-summary.h"
 #include "statistics.h"
 #include "status-codes.h"
+#include "stream-detector.h"
 #include "super-block.h"
 #include "super-block-codec.h"
 #include "sync-completion.h"
@@ -165,6 +169,8 @@ static int initialize_vdo(struct vdo *vdo,
 	vdo->starting_sector_offset = config->owning_target->begin;
 	vdo->instance = instance;
 	vdo->allocations_allowed = true;
+	vdo->readahead_depth = VDO_DEFAULT_READAHEAD_DEPTH;
+	vdo->readahead_streams = VDO_DEFAULT_READAHEAD_STREAMS;
 	vdo_set_admin_state_code(&vdo->admin_state, VDO_ADMIN_STATE_NEW);
 	INIT_LIST_HEAD(&vdo->device_config_list);
 	vdo_initialize_admin_completion(vdo, &vdo->admin_completion);
@@ -191,21 +197,18 @@ static int initialize_vdo(struct vdo *vdo,
 
 	/* Compression context storage */
 	result = UDS_ALLOCATE(config->thread_counts.cpu_threads,
-			      char *,
-			      "LZ4 context",
+			      struct compressor_context *,
+			      "compressor contexts",
 			      &vdo->compression_context);
 	if (result != VDO_SUCCESS) {
-		*reason = "cannot allocate LZ4 context";
+		*reason = "cannot allocate compressor contexts";
 		return result;
 	}
 
 	for (i = 0; i < config->thread_counts.cpu_threads; i++) {
-		result = UDS_ALLOCATE(LZ4_MEM_COMPRESS,
-				      char,
-				      "LZ4 context",
-				      &vdo->compression_context[i]);
+		result = vdo_make_compressor_context(&vdo->compression_context[i]);
 		if (result != VDO_SUCCESS) {
-			*reason = "cannot allocate LZ4 context";
+			*reason = "cannot allocate compressor context";
 			return result;
 		}
 	}
@@ -288,14 +291,44 @@ int vdo_make(unsigned int instance,
 		return result;
 	}
 
-	result = vdo_make_packer(vdo, DEFAULT_PACKER_BINS, &vdo->packer);
+	result = vdo_make_packers(vdo, DEFAULT_PACKER_BINS, &vdo->packers);
 	if (result != VDO_SUCCESS) {
 		*reason = "Cannot make packer zones";
 		return result;
 	}
 
+	result = vdo_make_compressed_block_cache(vdo->thread_config->logical_zone_count,
+						 VDO_COMPRESSED_BLOCKS_PER_ZONE,
+						 &vdo->compressed_block_cache);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot make compressed block cache";
+		return result;
+	}
+
+	result = vdo_make_compressed_block_cache(vdo->thread_config->logical_zone_count,
+						 VDO_READAHEAD_BLOCKS_PER_ZONE,
+						 &vdo->readahead_cache);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot make readahead cache";
+		return result;
+	}
+
+	result = vdo_make_shared_reads(&vdo->shared_reads);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot make shared reads table";
+		return result;
+	}
+
 	BUG_ON(vdo->device_config->logical_block_size <= 0);
 	BUG_ON(vdo->device_config->owned_device == NULL);
+	result = vdo_make_hashers(vdo,
+				  config->thread_counts.cpu_threads,
+				  &vdo->hashers);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot make hashers";
+		return result;
+	}
+
 	result = make_data_vio_pool(vdo,
 				    MAXIMUM_VDO_USER_VIOS,
 				    MAXIMUM_VDO_USER_VIOS * 3 / 4,
@@ -386,9 +419,13 @@ void vdo_destroy(struct vdo *vdo)
 	finish_vdo(vdo);
 	vdo_unregister(vdo);
 	free_data_vio_pool(vdo->data_vio_pool);
+	vdo_free_hashers(UDS_FORGET(vdo->hashers));
 	vdo_free_io_submitter(UDS_FORGET(vdo->io_submitter));
 	vdo_free_flusher(UDS_FORGET(vdo->flusher));
-	vdo_free_packer(UDS_FORGET(vdo->packer));
+	vdo_free_packers(UDS_FORGET(vdo->packers));
+	vdo_free_compressed_block_cache(UDS_FORGET(vdo->compressed_block_cache));
+	vdo_free_compressed_block_cache(UDS_FORGET(vdo->readahead_cache));
+	vdo_free_shared_reads(UDS_FORGET(vdo->shared_reads));
 	vdo_free_recovery_journal(UDS_FORGET(vdo->recovery_journal));
 	vdo_free_slab_depot(UDS_FORGET(vdo->depot));
 	vdo_free_layout(UDS_FORGET(vdo->layout));
@@ -412,7 +449,7 @@ void vdo_destroy(struct vdo *vdo)
 		for (i = 0;
 		     i < vdo->device_config->thread_counts.cpu_threads;
 		     i++) {
-			UDS_FREE(UDS_FORGET(vdo->compression_context[i]));
+			vdo_free_compressor_context(UDS_FORGET(vdo->compression_context[i]));
 		}
 
 		UDS_FREE(UDS_FORGET(vdo->compression_context));
@@ -769,18 +806,20 @@ static void set_compression_callback(struct vdo_completion *completion)
 	bool *enable = completion->parent;
 	bool was_enabled = vdo_get_compressing(vdo);
 
+	uds_log_info("compression is %s", (*enable ? "enabled" : "disabled"));
 	if (*enable != was_enabled) {
 		WRITE_ONCE(vdo->compressing, *enable);
 		if (was_enabled) {
 			/*
-			 * Signal the packer to flush since compression has
+			 * Signal the packers to flush since compression has
 			 * been disabled.
 			 */
-			vdo_flush_packer(vdo->packer);
+			*enable = was_enabled;
+			vdo_flush_packers(vdo->packers, completion);
+			return;
 		}
 	}
 
-	uds_log_info("compression is %s", (*enable ? "enabled" : "disabled"));
 	*enable = was_enabled;
 	vdo_complete_completion(completion);
 }
@@ -796,7 +835,7 @@ bool vdo_set_compressing(struct vdo *vdo, bool enable)
 {
 	vdo_perform_synchronous_action(vdo,
 				       set_compression_callback,
-				       vdo->thread_config->packer_thread,
+				       vdo->thread_config->admin_thread,
 				       &enable);
 	return enable;
 }
@@ -812,6 +851,119 @@ bool vdo_get_compressing(struct vdo *vdo)
 	return READ_ONCE(vdo->compressing);
 }
 
+/**
+ * get_compression_queue_limit() - Get the number of pending compressions at
+ *                                 which compression should be skipped.
+ * @vdo: The vdo.
+ *
+ * Return: The limit, or 0 if there is none.
+ */
+static unsigned int get_compression_queue_limit(struct vdo *vdo)
+{
+	return (READ_ONCE(vdo->compression_queue_budget) *
+		vdo->device_config->thread_counts.cpu_threads);
+}
+
+/**
+ * vdo_is_compression_over_budget() - Check whether so many data_vios are
+ *                                    waiting to be compressed that another
+ *                                    should not be.
+ * @vdo: The vdo.
+ *
+ * Return: true if compression should be skipped.
+ */
+bool vdo_is_compression_over_budget(struct vdo *vdo)
+{
+	unsigned int limit = get_compression_queue_limit(vdo);
+
+	return ((limit > 0) &&
+		(atomic_read(&vdo->compressions_pending) >= limit));
+}
+
+/**
+ * vdo_should_downgrade_compression() - Check whether the cpu threads are
+ *                                      busy enough that a faster
+ *                                      compression setting should be used.
+ * @vdo: The vdo.
+ * @context: The compressor context of the current thread.
+ *
+ * Compression is downgraded when the cpu threads are more than half way to
+ * the queue budget, or when the average compression latency of the current
+ * thread exceeds the latency budget. Since the average includes downgraded
+ * compressions, the latency budget settles into a duty cycle of full and
+ * downgraded compressions whose average latency is about the budget.
+ *
+ * Return: true if compression should be downgraded.
+ */
+bool vdo_should_downgrade_compression(struct vdo *vdo,
+				      struct compressor_context *context)
+{
+	unsigned int limit = get_compression_queue_limit(vdo);
+	u64 latency_budget = READ_ONCE(vdo->compression_latency_budget);
+
+	if ((limit > 0) &&
+	    ((2 * atomic_read(&vdo->compressions_pending)) >= limit)) {
+		return true;
+	}
+
+	return ((latency_budget > 0) &&
+		(vdo_get_compression_latency(context) >
+		 (latency_budget * NSEC_PER_USEC)));
+}
+
+/**
+ * get_compression_latency() - Get the average time the cpu threads have
+ *                             taken to compress a block.
+ * @vdo: The vdo.
+ *
+ * Each cpu thread keeps its own average, so that recording a compression
+ * never touches a cache line shared with the other threads. Threads which
+ * have not compressed anything are left out.
+ *
+ * Return: The average time, in nanoseconds.
+ */
+static u64 get_compression_latency(struct vdo *vdo)
+{
+	int threads = vdo->device_config->thread_counts.cpu_threads;
+	unsigned int active = 0;
+	u64 total = 0;
+	int i;
+
+	for (i = 0; i < threads; i++) {
+		u64 latency =
+			vdo_get_compression_latency(vdo->compression_context[i]);
+
+		if (latency > 0) {
+			total += latency;
+			active++;
+		}
+	}
+
+	return ((active == 0) ? 0 : div_u64(total, active));
+}
+
+/**
+ * vdo_set_compression_engine() - Set the compression engine and level used
+ *                                for subsequent writes.
+ * @vdo: The vdo.
+ * @type: The compression engine to use.
+ * @level: The level at which to run the engine.
+ *
+ * This may be called from any thread. Data_vios which are already being
+ * compressed will finish with the old engine; the packer will not combine
+ * their fragments with those in a different format.
+ */
+void vdo_set_compression_engine(struct vdo *vdo,
+				enum vdo_compression_type type,
+				int level)
+{
+	WRITE_ONCE(vdo->compression_setting,
+		   vdo_pack_compression_setting(type, level));
+	uds_log_info("compression engine is %s, level %d",
+		     vdo_get_compression_type_name(type),
+		     vdo_get_compression_level(type, level));
+}
+
 static size_t get_block_map_cache_size(const struct vdo *vdo)
 {
 	return ((size_t) vdo->device_config->cache_size) * VDO_BLOCK_SIZE;
@@ -849,6 +1001,18 @@ static void copy_bio_stat(struct bio_stats *b,
 	b->fua = atomic64_read(&a->fua);
 }
 
+static void copy_compression_stats(struct compression_statistics *c,
+				   const struct atomic_compression_stats *a)
+{
+	c->failures = atomic64_read(&a->failures);
+	c->entropy_skipped = atomic64_read(&a->entropy_skipped);
+	c->entropy_audited = atomic64_read(&a->entropy_audited);
+	c->entropy_mispredicted = atomic64_read(&a->entropy_mispredicted);
+	c->compressed = atomic64_read(&a->compressed);
+	c->downgraded = atomic64_read(&a->downgraded);
+	c->skipped_for_load = atomic64_read(&a->skipped_for_load);
+}
+
 static struct bio_stats subtract_bio_stats(struct bio_stats minuend,
 					   struct bio_stats subtrahend)
 {
@@ -953,7 +1117,12 @@ static void get_vdo_statistics(const struct vdo *vdo,
 		vdo_get_recovery_journal_logical_blocks_used(journal);
 	vdo_get_slab_depot_statistics(vdo->depot, stats);
 	stats->journal = vdo_get_recovery_journal_statistics(journal);
-	stats->packer = vdo_get_packer_statistics(vdo->packer);
+	stats->packer = vdo_get_packer_statistics(vdo->packers);
+	stats->compressed_block_cache =
+		vdo_get_compressed_block_cache_statistics(vdo->compressed_block_cache);
+	copy_compression_stats(&stats->compression, &vdo->stats.compression);
+	stats->compression.pending = atomic_read(&vdo->compressions_pending);
+	stats->compression.average_latency = get_compression_latency(vdo);
 	stats->block_map = vdo_get_block_map_statistics(vdo->block_map);
 	vdo_get_dedupe_statistics(vdo->hash_zones, stats);
 	stats->errors = get_vdo_error_statistics(vdo);
@@ -968,8 +1137,23 @@ static void get_vdo_statistics(const struct vdo *vdo,
 		get_data_vio_pool_active_requests(vdo->data_vio_pool);
 	stats->max_vios =
 		get_data_vio_pool_maximum_requests(vdo->data_vio_pool);
+	stats->request_limit =
+		get_data_vio_pool_request_limit(vdo->data_vio_pool);
+	stats->request_latency_target =
+		get_data_vio_pool_latency_target(vdo->data_vio_pool);
+	stats->request_latency_p50 =
+		get_data_vio_pool_latency_p50(vdo->data_vio_pool);
+	stats->request_latency_p99 =
+		get_data_vio_pool_latency_p99(vdo->data_vio_pool);
 
 	stats->flush_out = atomic64_read(&vdo->stats.flush_out);
+	stats->partial_writes_coalesced =
+		atomic64_read(&vdo->stats.partial_writes_coalesced);
+	stats->reads_shared = atomic64_read(&vdo->stats.reads_shared);
+	stats->blocks_read_ahead =
+		atomic64_read(&vdo->stats.blocks_read_ahead);
+	stats->readahead_hits =
+		vdo_get_compressed_block_cache_statistics(vdo->readahead_cache).hits;
 	stats->logical_block_size =
 		vdo->device_config->logical_block_size;
 	copy_bio_stat(&stats->bios_in, &vdo->stats.bios_in);
@@ -1062,7 +1246,7 @@ void vdo_dump_status(const struct vdo *vdo)
 
 	vdo_dump_flusher(vdo->flusher);
 	vdo_dump_recovery_journal_statistics(vdo->recovery_journal);
-	vdo_dump_packer(vdo->packer);
+	vdo_dump_packers(vdo->packers);
 	vdo_dump_slab_depot(vdo->depot);
 
 	for (zone = 0; zone < thread_config->logical_zone_count; zone++) {
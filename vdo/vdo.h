@@ -78,10 +78,39 @@ struct vdo {
 	/* The slab depot */
 	struct slab_depot *depot;
 
-	/* The compressed-block packer */
-	struct packer *packer;
+	/* The compressed-block packers, one per physical zone */
+	struct packers *packers;
+	/* The cache of recently read compressed blocks */
+	struct compressed_block_cache *compressed_block_cache;
+	/* The cache of data blocks read ahead of sequential read streams */
+	struct compressed_block_cache *readahead_cache;
+	/* The reads of physical blocks which are in progress */
+	struct shared_reads *shared_reads;
 	/* Whether incoming data should be compressed */
 	bool compressing;
+	/*
+	 * The compression engine to use and the level at which to run it,
+	 * packed by vdo_pack_compression_setting() so that both change at once
+	 */
+	u32 compression_setting;
+	/* The number of data_vios waiting for or undergoing compression */
+	atomic_t compressions_pending;
+	/*
+	 * The number of pending compressions per cpu thread at which
+	 * compression is skipped (half as many downgrade it), or 0 (the
+	 * default) for no limit
+	 */
+	unsigned int compression_queue_budget;
+	/*
+	 * The average compression latency, in microseconds, above which
+	 * compression is downgraded, or 0 for no limit
+	 */
+	unsigned int compression_latency_budget;
+
+	/* The number of block map leaf pages to read ahead of a read stream */
+	unsigned int readahead_depth;
+	/* The number of read streams each logical zone tracks */
+	unsigned int readahead_streams;
 
 	/* The handler for flush requests */
 	struct flusher *flusher;
@@ -98,6 +127,15 @@ struct vdo {
 	/* The hash lock zones of this vdo */
 	struct hash_zones *hash_zones;
 
+	/* The batchers for hashing data written to this vdo */
+	struct hashers *hashers;
+
+	/*
+	 * Whether blocks are named with SHA-256 so that dedupe advice for them
+	 * may be trusted without reading the advised block
+	 */
+	bool trusted_dedupe;
+
 	/*
 	 * Bio submission manager used for sending bios to the storage
 	 * device.
@@ -148,8 +186,8 @@ struct vdo {
 	struct kobject vdo_directory;
 	struct kobject stats_directory;
 
-	/* N blobs of context data for LZ4 code, one per CPU thread. */
-	char **compression_context;
+	/* N compressor contexts, one per CPU thread. */
+	struct compressor_context **compression_context;
 };
 
 
@@ -214,6 +252,16 @@ bool vdo_set_compressing(struct vdo *vdo, bool enable);
 
 bool vdo_get_compressing(struct vdo *vdo);
 
+bool __must_check vdo_is_compression_over_budget(struct vdo *vdo);
+
+bool __must_check
+vdo_should_downgrade_compression(struct vdo *vdo,
+				 struct compressor_context *context);
+
+void vdo_set_compression_engine(struct vdo *vdo,
+				enum vdo_compression_type type,
+				int level);
+
 void vdo_fetch_statistics(struct vdo *vdo, struct vdo_statistics *stats);
 
 thread_id_t vdo_get_callback_thread_id(void);
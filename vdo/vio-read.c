@@ -12,9 +12,13 @@
 
 #include "bio.h"
 #include "block-map.h"
+#include "compressed-block-cache.h"
 #include "data-vio.h"
 #include "io-submitter.h"
 #include "kernel-types.h"
+#include "logical-zone.h"
+#include "shared-reads.h"
+#include "stream-detector.h"
 #include "vdo.h"
 #include "vio-write.h"
 
@@ -55,12 +59,37 @@
 static unsigned int PASSTHROUGH_FLAGS =
 	(REQ_PRIO | REQ_META | REQ_SYNC | REQ_RAHEAD);
 
+/**
+ * continue_partial_write() - Merge any coalesced partial writes into the
+ *                            block and start writing it.
+ * @completion: The data_vio which has merged its own data.
+ *
+ * Once this runs, no more partial writes will be merged into the data_vio.
+ * The merged writes are applied in the order in which they arrived, all
+ * after the data_vio's own data.
+ */
 static void continue_partial_write(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
+	struct lbn_lock *lock = &data_vio->logical;
+	struct waiter *waiter;
 
 	assert_data_vio_in_logical_zone(data_vio);
 
+	lock->coalescing = false;
+	for (waiter = get_first_waiter(&lock->coalesced);
+	     waiter != NULL;
+	     waiter = get_next_waiter(&lock->coalesced, waiter)) {
+		struct data_vio *merged = waiter_as_data_vio(waiter);
+
+		vdo_bio_copy_data_in(merged->user_bio,
+				     data_vio->data_block + merged->offset);
+	}
+
+	if (has_waiters(&lock->coalesced)) {
+		data_vio->is_zero_block = is_zero_block(data_vio->data_block);
+	}
+
 	launch_write_data_vio(data_vio);
 }
 
@@ -97,6 +126,101 @@ static void modify_for_partial_write(struct vdo_completion *completion)
 	launch_data_vio_logical_callback(data_vio, continue_partial_write);
 }
 
+static void complete_read(struct vdo_completion *completion);
+
+/**
+ * share_block() - Give a copy of a block which has been read to a data_vio
+ *                 which was waiting for it.
+ * @waiter: The data_vio which was waiting.
+ * @context: The contents of the block which was read.
+ *
+ * Implements waiter_callback.
+ */
+static void share_block(struct waiter *waiter, void *context)
+{
+	struct data_vio *reader = waiter_as_data_vio(waiter);
+	char *block = context;
+
+	if (vdo_is_state_compressed(reader->mapped.state)) {
+		memcpy(reader->compression.block, block, VDO_BLOCK_SIZE);
+	} else if (is_read_modify_write_data_vio(reader) ||
+		   reader->is_partial) {
+		memcpy(reader->data_block, block, VDO_BLOCK_SIZE);
+	} else {
+		vdo_bio_copy_data_out(reader->user_bio, block);
+	}
+
+	launch_data_vio_cpu_callback(reader,
+				     complete_read,
+				     CPU_Q_COMPLETE_READ_PRIORITY);
+}
+
+/**
+ * share_read() - Send copies of the block a data_vio has read to any
+ *                data_vios which are waiting for it.
+ * @data_vio: The data_vio which has read its block.
+ */
+static void share_read(struct data_vio *data_vio)
+{
+	char *block = data_vio->data_block;
+	char *mapped = NULL;
+
+	vdo_finish_shared_read(vdo_from_data_vio(data_vio)->shared_reads,
+			       data_vio);
+	if (!has_waiters(&data_vio->shared_readers)) {
+		return;
+	}
+
+	if (vdo_is_state_compressed(data_vio->mapped.state)) {
+		block = (char *) data_vio->compression.block;
+	} else if (!is_read_modify_write_data_vio(data_vio) &&
+		   !data_vio->is_partial) {
+		/* A full block read went straight to the user bio. */
+		mapped = vdo_map_bio_block(data_vio->user_bio);
+		if (mapped != NULL) {
+			block = mapped;
+		} else {
+			vdo_bio_copy_data_in(data_vio->user_bio, block);
+		}
+	}
+
+	notify_all_waiters(&data_vio->shared_readers, share_block, block);
+	if (mapped != NULL) {
+		vdo_unmap_bio_block(mapped);
+	}
+}
+
+/**
+ * continue_shared_reader() - Continue a data_vio which was waiting for a read
+ *                            which failed.
+ * @waiter: The data_vio which was waiting.
+ * @context: A pointer to the error.
+ *
+ * Implements waiter_callback.
+ */
+static void continue_shared_reader(struct waiter *waiter, void *context)
+{
+	continue_data_vio(waiter_as_data_vio(waiter), *((int *) context));
+}
+
+/**
+ * fail_shared_read() - Handle an error reading a block which other data_vios
+ *                      may be waiting for.
+ * @completion: The data_vio which was reading.
+ *
+ * This error handler is registered in read_block().
+ */
+static void fail_shared_read(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+
+	vdo_finish_shared_read(completion->vdo->shared_reads, data_vio);
+	notify_all_waiters(&data_vio->shared_readers,
+			   continue_shared_reader,
+			   &completion->result);
+	complete_data_vio(completion);
+}
+
 static void complete_read(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
@@ -104,11 +228,39 @@ static void complete_read(struct vdo_completion *completion)
 
 	assert_data_vio_on_cpu_thread(data_vio);
 
+	share_read(data_vio);
+	completion->error_handler = complete_data_vio;
 	if (compressed) {
-		int result = uncompress_data_vio(data_vio,
-						 data_vio->mapped.state,
-						 data_vio->data_block);
+		char *block = NULL;
+		int result;
+
+		/*
+		 * A full block read whose bio is a single page can be
+		 * decompressed directly into the user's page.
+		 */
+		if (!is_read_modify_write_data_vio(data_vio) &&
+		    !data_vio->is_partial) {
+			block = vdo_map_bio_block(data_vio->user_bio);
+		}
 
+		if (block != NULL) {
+			result = uncompress_data_vio(data_vio,
+						     data_vio->mapped.state,
+						     block);
+			vdo_unmap_bio_block(block);
+			if (result != VDO_SUCCESS) {
+				finish_data_vio(data_vio, result);
+				return;
+			}
+
+			acknowledge_data_vio(data_vio);
+			complete_data_vio(completion);
+			return;
+		}
+
+		result = uncompress_data_vio(data_vio,
+					     data_vio->mapped.state,
+					     data_vio->data_block);
 		if (result != VDO_SUCCESS) {
 			finish_data_vio(data_vio, result);
 			return;
@@ -164,6 +316,42 @@ static void complete_zero_read(struct vdo_completion *completion)
 	complete_read(completion);
 }
 
+/**
+ * complete_read_ahead_read() - Complete a read of an uncompressed block which
+ *                              was found in the readahead cache.
+ * @completion: The data_vio which read the block into its data_block.
+ */
+static void complete_read_ahead_read(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+
+	assert_data_vio_on_cpu_thread(data_vio);
+
+	if (!is_read_modify_write_data_vio(data_vio) &&
+	    !data_vio->is_partial) {
+		vdo_bio_copy_data_out(data_vio->user_bio,
+				      data_vio->data_block);
+	}
+
+	complete_read(completion);
+}
+
+/**
+ * is_shareable_read() - Check whether the read of a data_vio's mapped block
+ *                       may be shared with other data_vios.
+ * @data_vio: The data_vio about to read.
+ *
+ * A read which passes REQ_RAHEAD down may be failed by the storage at will,
+ * so it must neither serve nor wait for any other data_vio.
+ *
+ * Return: true if the read may be shared.
+ */
+static bool is_shareable_read(struct data_vio *data_vio)
+{
+	return (vdo_is_state_compressed(data_vio->mapped.state) ||
+		((data_vio->user_bio->bi_opf & REQ_RAHEAD) == 0));
+}
+
 /**
  * read_block() - Read a block asynchronously.
  * @completion: The data_vio to read.
@@ -174,6 +362,7 @@ static void read_block(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
 	struct vio *vio = as_vio(completion);
+	struct vdo *vdo = vdo_from_data_vio(data_vio);
 	int result = VDO_SUCCESS;
 
 	if (completion->result != VDO_SUCCESS) {
@@ -192,6 +381,50 @@ static void read_block(struct vdo_completion *completion)
 
 	data_vio->last_async_operation = VIO_ASYNC_OP_READ_DATA_VIO;
 	completion->error_handler = complete_data_vio;
+	if (vdo_is_state_compressed(data_vio->mapped.state) &&
+	    vdo_get_cached_compressed_block(vdo->compressed_block_cache,
+					    data_vio->logical.zone->zone_number,
+					    data_vio->mapped.pbn,
+					    (char *) data_vio->compression.block)) {
+		launch_data_vio_cpu_callback(data_vio,
+					     complete_read,
+					     CPU_Q_COMPLETE_READ_PRIORITY);
+		return;
+	}
+
+	if (!vdo_is_state_compressed(data_vio->mapped.state) &&
+	    (READ_ONCE(vdo->readahead_depth) > 0) &&
+	    vdo_get_cached_compressed_block(vdo->readahead_cache,
+					    data_vio->logical.zone->zone_number,
+					    data_vio->mapped.pbn,
+					    data_vio->data_block)) {
+		launch_data_vio_cpu_callback(data_vio,
+					     complete_read_ahead_read,
+					     CPU_Q_COMPLETE_READ_PRIORITY);
+		return;
+	}
+
+	/*
+	 * If another data_vio is already reading this block, wait for it to
+	 * share the data rather than reading the block again.
+	 */
+	if (is_shareable_read(data_vio)) {
+		bool shared;
+
+		result = vdo_share_read(vdo->shared_reads, data_vio, &shared);
+		if (result != VDO_SUCCESS) {
+			continue_data_vio(data_vio, result);
+			return;
+		}
+
+		if (shared) {
+			atomic64_inc(&vdo->stats.reads_shared);
+			return;
+		}
+
+		completion->error_handler = fail_shared_read;
+	}
+
 	if (vdo_is_state_compressed(data_vio->mapped.state)) {
 		result = prepare_data_vio_for_io(data_vio,
 						 (char *) data_vio->compression.block,
@@ -259,6 +492,9 @@ static void read_block(struct vdo_completion *completion)
 static void read_block_mapping(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
+	struct logical_zone *zone = data_vio->logical.zone;
+	logical_block_number_t lbn = data_vio->logical.lbn;
+	bool is_read = is_read_data_vio(data_vio);
 
 	if (completion->result != VDO_SUCCESS) {
 		complete_data_vio(completion);
@@ -269,6 +505,15 @@ static void read_block_mapping(struct vdo_completion *completion)
 	set_data_vio_logical_callback(data_vio, read_block);
 	data_vio->last_async_operation = VIO_ASYNC_OP_GET_MAPPED_BLOCK_FOR_READ;
 	vdo_get_mapped_block(data_vio);
+
+	/*
+	 * Look for streams only after requesting this read's own leaf page,
+	 * so that reading ahead doesn't delay it. The data_vio may already
+	 * have moved on, so only the saved zone and LBN may be used.
+	 */
+	if (is_read) {
+		vdo_detect_read_stream(zone->stream_detector, lbn);
+	}
 }
 
 /**
@@ -299,6 +544,22 @@ static void release_logical_lock(struct vdo_completion *completion)
 	struct data_vio *data_vio = as_data_vio(completion);
 
 	assert_data_vio_in_logical_zone(data_vio);
+
+	/*
+	 * Cache a successfully read compressed block while the logical block
+	 * lock still pins the reference to it.
+	 */
+	if ((completion->result == VDO_SUCCESS) &&
+	    (data_vio->mapped.pbn != VDO_ZERO_BLOCK) &&
+	    vdo_is_state_compressed(data_vio->mapped.state)) {
+		struct vdo *vdo = vdo_from_data_vio(data_vio);
+
+		vdo_cache_compressed_block(vdo->compressed_block_cache,
+					   data_vio->logical.zone->zone_number,
+					   data_vio->mapped.pbn,
+					   (char *) data_vio->compression.block);
+	}
+
 	vdo_release_logical_block_lock(data_vio);
 	release_data_vio(data_vio);
 }
@@ -92,7 +92,6 @@
 #include "vio-write.h"
 
 #include <linux/bio.h>
-#include <linux/murmurhash3.h>
 
 #include "logger.h"
 #include "permassert.h"
@@ -102,6 +101,7 @@
 #include "compression-state.h"
 #include "data-vio.h"
 #include "dedupe.h"
+#include "hasher.h"
 #include "io-submitter.h"
 #include "kernel-types.h"
 #include "recovery-journal.h"
@@ -189,12 +189,15 @@ static void clean_hash_lock(struct vdo_completion *completion)
  * @data_vio: The data_vio which has finished cleaning up.
  *
  * If it is part of a multi-block discard, starts on the next block,
- * otherwise, returns it to the pool.
+ * otherwise, returns it to the pool. If the block just discarded was on a
+ * block map page which has not been allocated, every other block on that
+ * page is already unmapped, so they are skipped.
  */
 static void finish_cleanup(struct data_vio *data_vio)
 {
 	struct vdo_completion *completion = data_vio_as_completion(data_vio);
 	enum data_vio_operation operation;
+	logical_block_number_t lbn = data_vio->logical.lbn + 1;
 
 	ASSERT_LOG_ONLY(data_vio->allocation.lock == NULL,
 			"complete data_vio has no allocation lock");
@@ -209,6 +212,24 @@ static void finish_cleanup(struct data_vio *data_vio)
 	data_vio->remaining_discard -= min_t(uint32_t,
 					     data_vio->remaining_discard,
 					     VDO_BLOCK_SIZE - data_vio->offset);
+	if (is_trim_data_vio(data_vio) &&
+	    (data_vio->tree_lock.tree_slots[0].block_map_slot.pbn ==
+	     VDO_ZERO_BLOCK)) {
+		uint32_t skip = min_t(uint32_t,
+				      (VDO_BLOCK_MAP_ENTRIES_PER_PAGE -
+				       (lbn % VDO_BLOCK_MAP_ENTRIES_PER_PAGE)) %
+				      VDO_BLOCK_MAP_ENTRIES_PER_PAGE,
+				      (data_vio->remaining_discard /
+				       VDO_BLOCK_SIZE));
+
+		lbn += skip;
+		data_vio->remaining_discard -= skip * VDO_BLOCK_SIZE;
+		if (data_vio->remaining_discard == 0) {
+			release_data_vio(data_vio);
+			return;
+		}
+	}
+
 	data_vio->is_partial = (data_vio->remaining_discard < VDO_BLOCK_SIZE);
 	data_vio->offset = 0;
 
@@ -223,7 +244,7 @@ static void finish_cleanup(struct data_vio *data_vio)
 	}
 
 	completion->requeue = true;
-	launch_data_vio(data_vio, data_vio->logical.lbn + 1, operation);
+	launch_data_vio(data_vio, lbn, operation);
 }
 
 /**
@@ -646,6 +667,17 @@ static void compress_data_vio_callback(struct vdo_completion *completion)
 
 	assert_data_vio_on_cpu_thread(data_vio);
 	compress_data_vio(data_vio);
+	atomic_dec(&completion->vdo->compressions_pending);
+	if (!vdo_data_is_sufficiently_compressible(data_vio)) {
+		/*
+		 * There is no need to visit the packer thread just to learn
+		 * that this data_vio can't be packed.
+		 */
+		set_vio_compression_done(data_vio);
+		abort_deduplication(data_vio);
+		return;
+	}
+
 	launch_data_vio_packer_callback(data_vio,
 					pack_compressed_data);
 }
@@ -659,6 +691,8 @@ static void compress_data_vio_callback(struct vdo_completion *completion)
  */
 void launch_compress_data_vio(struct data_vio *data_vio)
 {
+	struct vdo *vdo = vdo_from_data_vio(data_vio);
+
 	ASSERT_LOG_ONLY(!data_vio->is_duplicate,
 			"compressing a non-duplicate block");
 	if (!may_compress_data_vio(data_vio)) {
@@ -666,6 +700,18 @@ void launch_compress_data_vio(struct data_vio *data_vio)
 		return;
 	}
 
+	if (vdo_is_compression_over_budget(vdo)) {
+		/*
+		 * The cpu threads are backed up, so write the data
+		 * uncompressed rather than add to the backlog.
+		 */
+		atomic64_inc(&vdo->stats.compression.skipped_for_load);
+		set_vio_compression_done(data_vio);
+		abort_deduplication(data_vio);
+		return;
+	}
+
+	atomic_inc(&vdo->compressions_pending);
 	data_vio->last_async_operation = VIO_ASYNC_OP_COMPRESS_DATA_VIO;
 	launch_data_vio_cpu_callback(data_vio,
 				     compress_data_vio_callback,
@@ -741,7 +787,7 @@ void launch_deduplicate_data_vio(struct data_vio *data_vio)
  *                       dedupe for that name.
  * @completion: The data_vio to lock.
  *
- * This is the callback registered in hash_data_vio().
+ * This is the callback registered in prepare_for_dedupe().
  */
 static void lock_hash_in_zone(struct vdo_completion *completion)
 {
@@ -772,34 +818,6 @@ static void lock_hash_in_zone(struct vdo_completion *completion)
 	vdo_enter_hash_lock(data_vio);
 }
 
-/**
- * hash_data_vio() - Hash the data in a data_vio and set the hash zone (which
- *                   also flags the chunk name as set).
- * @completion: The data_vio to hash.
-
- * This callback is registered in prepare_for_dedupe().
- */
-static void hash_data_vio(struct vdo_completion *completion)
-{
-	struct data_vio *data_vio = as_data_vio(completion);
-
-	assert_data_vio_on_cpu_thread(data_vio);
-	ASSERT_LOG_ONLY(!data_vio->is_zero_block,
-			"zero blocks should not be hashed");
-
-	murmurhash3_128(data_vio->data_block,
-			VDO_BLOCK_SIZE,
-			0x62ea60be,
-			&data_vio->chunk_name);
-
-	data_vio->hash_zone =
-		vdo_select_hash_zone(vdo_from_data_vio(data_vio)->hash_zones,
-				     &data_vio->chunk_name);
-	data_vio->last_async_operation = VIO_ASYNC_OP_ACQUIRE_VDO_HASH_LOCK;
-	launch_data_vio_hash_zone_callback(data_vio,
-					   lock_hash_in_zone);
-}
-
 /**
  * prepare_for_dedupe() - Prepare for the dedupe path after attempting to get
  *                        an allocation.
@@ -822,9 +840,7 @@ static void prepare_for_dedupe(struct data_vio *data_vio)
 	 * step is to hash the block data.
 	 */
 	data_vio->last_async_operation = VIO_ASYNC_OP_HASH_DATA_VIO;
-	launch_data_vio_cpu_callback(data_vio,
-				     hash_data_vio,
-				     CPU_Q_HASH_BLOCK_PRIORITY);
+	vdo_hash_data_vio(data_vio, lock_hash_in_zone);
 }
 
 /**
@@ -1030,6 +1046,51 @@ static void write_block(struct data_vio *data_vio)
 	submit_data_vio_io(data_vio);
 }
 
+/**
+ * journal_trim() - Journal a trim unless the block is already unmapped.
+ * @completion: The trim data_vio.
+ *
+ * This callback is registered in read_old_block_mapping_for_trim().
+ */
+static void journal_trim(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+
+	assert_data_vio_in_journal_zone(data_vio);
+	if (abort_on_error(completion->result, data_vio, READ_ONLY)) {
+		return;
+	}
+
+	if (data_vio->mapped.state == VDO_MAPPING_STATE_UNMAPPED) {
+		/*
+		 * Trimming a block which is already unmapped changes nothing,
+		 * so there is nothing to journal or update.
+		 */
+		finish_data_vio(data_vio, VDO_SUCCESS);
+		return;
+	}
+
+	finish_block_write(completion);
+}
+
+/**
+ * read_old_block_mapping_for_trim() - Get the current mapping of a block to
+ *                                     be trimmed before journaling anything.
+ * @completion: The trim data_vio.
+ *
+ * This callback is registered in acknowledge_write_callback() and
+ * continue_write_with_block_map_slot().
+ */
+static void read_old_block_mapping_for_trim(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+
+	assert_data_vio_in_logical_zone(data_vio);
+	set_data_vio_journal_callback(data_vio, journal_trim);
+	data_vio->last_async_operation = VIO_ASYNC_OP_GET_MAPPED_BLOCK_FOR_WRITE;
+	vdo_get_mapped_block(data_vio);
+}
+
 /**
  * acknowledge_write_callback() - Acknowledge a write to the requestor.
  * @completion: The data_vio being acknowledged.
@@ -1049,8 +1110,14 @@ static void acknowledge_write_callback(struct vdo_completion *completion)
 	ASSERT_LOG_ONLY(data_vio->has_flush_generation_lock,
 			"write VIO to be acknowledged has a flush generation lock");
 	acknowledge_data_vio(data_vio);
+	if (is_trim_data_vio(data_vio)) {
+		launch_data_vio_logical_callback(data_vio,
+						 read_old_block_mapping_for_trim);
+		return;
+	}
+
 	if (data_vio->new_mapped.pbn == VDO_ZERO_BLOCK) {
-		/* This is a zero write or discard */
+		/* This is a zero write */
 		launch_data_vio_journal_callback(data_vio, finish_block_write);
 		return;
 	}
@@ -1171,7 +1238,8 @@ continue_write_with_block_map_slot(struct vdo_completion *completion)
                  * This is not the final block of a discard so we can't
                  * acknowledge it yet.
 		 */
-		launch_data_vio_journal_callback(data_vio, finish_block_write);
+		launch_data_vio_logical_callback(data_vio,
+						 read_old_block_mapping_for_trim);
 		return;
 	}
 